@@ -16,6 +16,9 @@ cc1101 Driver for RC Switch. Mod by Little Satan. With permission to modify and
 #include <SPI.h>
 #include "ELECHOUSE_CC1101_SRC_DRV2.h"
 #include <Arduino.h>
+#if defined(CONFIG_IDF_TARGET_ESP32)
+#include <soc/gpio_struct.h>
+#endif
 
 /****************************************************************/
 #define   WRITE_BURST       0x40            //write burst
@@ -23,6 +26,9 @@ cc1101 Driver for RC Switch. Mod by Little Satan. With permission to modify and
 #define   READ_BURST        0xC0            //read burst
 #define   BYTES_IN_RXFIFO   0x7F            //byte number in RXfifo
 #define   max_modul 6
+#define   TX_TIMEOUT_MS     1000            //SendData gives up waiting for GDO0 after this
+#define   READY_RETRIES     2               //CS toggles before a chip that does not get ready is given up
+#define   READY_HIST_BINS   8
 
 byte modulation_2 = 2;
 byte frend0_2;
@@ -67,7 +73,35 @@ byte clb1_2[2]= {24,28};
 byte clb2_2[2]= {31,38};
 byte clb3_2[2]= {65,76};
 byte clb4_2[2]= {77,79};
+bool batch_2 = 0;
+byte batchRegs_2[CC1101_TEST0+1];
+uint64_t batchDirty_2 = 0;
+int batchWrites_2 = 0;
+int batchTransfers_2 = 0;
+int txTimeouts_2 = 0;
+unsigned long readyTimeout_2 = 2000;        //us, see setReadyTimeout()
+int readyTimeouts_2 = 0;
+int readyRetries_2 = 0;
+bool degraded_2 = 0;
+unsigned int readyHist_2[READY_HIST_BINS];
 
+/****************************************************************
+*FUNCTION NAME:pinRead_2, pinHigh_2, pinLow_2
+*FUNCTION     :GPIO access for the SPI ready waits, CS and GDO0 polling.
+*               Direct register access on the ESP32 (digitalRead/Write look
+*               the pin up on every call), the Arduino calls elsewhere.
+*               Same as src/fast_gpio.h of the sketch, which a library
+*               can not include.
+****************************************************************/
+#if defined(CONFIG_IDF_TARGET_ESP32)
+static inline bool pinRead_2(byte pin){return pin < 32 ? (GPIO.in >> pin) & 1 : (GPIO.in1.data >> (pin - 32)) & 1;}
+static inline void pinHigh_2(byte pin){if (pin < 32){GPIO.out_w1ts = 1UL << pin;} else {GPIO.out1_w1ts.data = 1UL << (pin - 32);}}
+static inline void pinLow_2(byte pin){if (pin < 32){GPIO.out_w1tc = 1UL << pin;} else {GPIO.out1_w1tc.data = 1UL << (pin - 32);}}
+#else
+static inline bool pinRead_2(byte pin){return digitalRead(pin);}
+static inline void pinHigh_2(byte pin){digitalWrite(pin, HIGH);}
+static inline void pinLow_2(byte pin){digitalWrite(pin, LOW);}
+#endif
 /****************************************************************/
 uint8_t PA_TABLE_2[8]     {0x00,0xC0,0x00,0x00,0x00,0x00,0x00,0x00};
 //                       -30  -20  -15  -10   0    5    7    10
@@ -139,15 +173,15 @@ void ELECHOUSE_CC1101_2::GDO0_Set (void)
 ****************************************************************/
 void ELECHOUSE_CC1101_2::Reset (void)
 {
-	digitalWrite(SS_PIN_2, LOW);
+	pinLow_2(SS_PIN_2);
 	delay(1);
-	digitalWrite(SS_PIN_2, HIGH);
+	pinHigh_2(SS_PIN_2);
 	delay(1);
-	digitalWrite(SS_PIN_2, LOW);
-	while(digitalRead(MISO_PIN_2));
+	pinLow_2(SS_PIN_2);
+	if (!waitReady()){pinHigh_2(SS_PIN_2); return;}
   SPI.transfer(CC1101_SRES);
-  while(digitalRead(MISO_PIN_2));
-	digitalWrite(SS_PIN_2, HIGH);
+  waitReady();
+	pinHigh_2(SS_PIN_2);
 }
 /****************************************************************
 *FUNCTION NAME:Init
@@ -157,9 +191,10 @@ void ELECHOUSE_CC1101_2::Reset (void)
 ****************************************************************/
 void ELECHOUSE_CC1101_2::Init(void)
 {
+  degraded_2 = 0;               //give a degraded module another chance
   setSpi();
   SpiStart();                   //spi_2 initialization
-  digitalWrite(SS_PIN_2, HIGH);
+  pinHigh_2(SS_PIN_2);
   digitalWrite(SCK_PIN_2, HIGH);
   digitalWrite(MOSI_PIN_2, LOW);
   Reset();                    //CC1101 reset
@@ -174,12 +209,18 @@ void ELECHOUSE_CC1101_2::Init(void)
 ****************************************************************/
 void ELECHOUSE_CC1101_2::SpiWriteReg(byte addr, byte value)
 {
+  if (batch_2 && addr <= CC1101_TEST0){
+  batchRegs_2[addr] = value;
+  batchDirty_2 |= 1ULL << addr;
+  batchWrites_2++;
+  return;
+  }
   SpiStart();
-  digitalWrite(SS_PIN_2, LOW);
-  while(digitalRead(MISO_PIN_2));
+  pinLow_2(SS_PIN_2);
+  if (!waitReady()){pinHigh_2(SS_PIN_2); SpiEnd(); return;}
   SPI.transfer(addr);
   SPI.transfer(value); 
-  digitalWrite(SS_PIN_2, HIGH);
+  pinHigh_2(SS_PIN_2);
   SpiEnd();
 }
 /****************************************************************
@@ -191,16 +232,17 @@ void ELECHOUSE_CC1101_2::SpiWriteReg(byte addr, byte value)
 void ELECHOUSE_CC1101_2::SpiWriteBurstReg(byte addr, byte *buffer, byte num)
 {
   byte i, temp;
+  if (batchDirty_2){flushBatch();}
   SpiStart();
   temp = addr | WRITE_BURST;
-  digitalWrite(SS_PIN_2, LOW);
-  while(digitalRead(MISO_PIN_2));
+  pinLow_2(SS_PIN_2);
+  if (!waitReady()){pinHigh_2(SS_PIN_2); SpiEnd(); return;}
   SPI.transfer(temp);
   for (i = 0; i < num; i++)
   {
   SPI.transfer(buffer[i]);
   }
-  digitalWrite(SS_PIN_2, HIGH);
+  pinHigh_2(SS_PIN_2);
   SpiEnd();
 }
 /****************************************************************
@@ -211,11 +253,12 @@ void ELECHOUSE_CC1101_2::SpiWriteBurstReg(byte addr, byte *buffer, byte num)
 ****************************************************************/
 void ELECHOUSE_CC1101_2::SpiStrobe(byte strobe)
 {
+  if (batchDirty_2){flushBatch();}
   SpiStart();
-  digitalWrite(SS_PIN_2, LOW);
-  while(digitalRead(MISO_PIN_2));
+  pinLow_2(SS_PIN_2);
+  if (!waitReady()){pinHigh_2(SS_PIN_2); SpiEnd(); return;}
   SPI.transfer(strobe);
-  digitalWrite(SS_PIN_2, HIGH);
+  pinHigh_2(SS_PIN_2);
   SpiEnd();
 }
 /****************************************************************
@@ -227,13 +270,14 @@ void ELECHOUSE_CC1101_2::SpiStrobe(byte strobe)
 byte ELECHOUSE_CC1101_2::SpiReadReg(byte addr) 
 {
   byte temp, value;
+  if (batch_2 && addr <= CC1101_TEST0 && (batchDirty_2 >> addr & 1)){return batchRegs_2[addr];}
   SpiStart();
   temp = addr| READ_SINGLE;
-  digitalWrite(SS_PIN_2, LOW);
-  while(digitalRead(MISO_PIN_2));
+  pinLow_2(SS_PIN_2);
+  if (!waitReady()){pinHigh_2(SS_PIN_2); SpiEnd(); return 0;}
   SPI.transfer(temp);
   value=SPI.transfer(0);
-  digitalWrite(SS_PIN_2, HIGH);
+  pinHigh_2(SS_PIN_2);
   SpiEnd();
   return value;
 }
@@ -247,16 +291,17 @@ byte ELECHOUSE_CC1101_2::SpiReadReg(byte addr)
 void ELECHOUSE_CC1101_2::SpiReadBurstReg(byte addr, byte *buffer, byte num)
 {
   byte i,temp;
+  if (batchDirty_2){flushBatch();}
   SpiStart();
   temp = addr | READ_BURST;
-  digitalWrite(SS_PIN_2, LOW);
-  while(digitalRead(MISO_PIN_2));
+  pinLow_2(SS_PIN_2);
+  if (!waitReady()){pinHigh_2(SS_PIN_2); SpiEnd(); memset(buffer, 0, num); return;}
   SPI.transfer(temp);
   for(i=0;i<num;i++)
   {
   buffer[i]=SPI.transfer(0);
   }
-  digitalWrite(SS_PIN_2, HIGH);
+  pinHigh_2(SS_PIN_2);
   SpiEnd();
 }
 
@@ -269,13 +314,14 @@ void ELECHOUSE_CC1101_2::SpiReadBurstReg(byte addr, byte *buffer, byte num)
 byte ELECHOUSE_CC1101_2::SpiReadStatus(byte addr) 
 {
   byte value,temp;
+  if (batch_2 && addr <= CC1101_TEST0 && (batchDirty_2 >> addr & 1)){return batchRegs_2[addr];}
   SpiStart();
   temp = addr | READ_BURST;
-  digitalWrite(SS_PIN_2, LOW);
-  while(digitalRead(MISO_PIN_2));
+  pinLow_2(SS_PIN_2);
+  if (!waitReady()){pinHigh_2(SS_PIN_2); SpiEnd(); return 0;}
   SPI.transfer(temp);
   value=SPI.transfer(0);
-  digitalWrite(SS_PIN_2, HIGH);
+  pinHigh_2(SS_PIN_2);
   SpiEnd();
   return value;
 }
@@ -1192,12 +1238,27 @@ void ELECHOUSE_CC1101_2::SendData(byte *txBuffer,byte size)
   SpiWriteBurstReg(CC1101_TXFIFO,txBuffer,size);      //write data to send
   SpiStrobe(CC1101_SIDLE);
   SpiStrobe(CC1101_STX);                  //start send
-    while (!digitalRead(GDO0_2));               // Wait for GDO0_2 to be set -> sync transmitted  
-    while (digitalRead(GDO0_2));                // Wait for GDO0_2 to be cleared -> end of packet
+  unsigned long start = millis();         //a misconfigured GDO0 or a dead module must not hang us
+    while (!pinRead_2(GDO0_2)){if (millis() - start > TX_TIMEOUT_MS){break;}}   // Wait for GDO0_2 to be set -> sync transmitted
+    while (pinRead_2(GDO0_2)){if (millis() - start > TX_TIMEOUT_MS){break;}}    // Wait for GDO0_2 to be cleared -> end of packet
+  if (millis() - start > TX_TIMEOUT_MS){
+    txTimeouts_2++;
+    SpiStrobe(CC1101_SIDLE);
+  }
   SpiStrobe(CC1101_SFTX);                 //flush TXfifo
   trxstate_2=1;
 }
 /****************************************************************
+*FUNCTION NAME:getTxTimeouts
+*FUNCTION     :number of SendData() calls that gave up waiting for GDO0
+*INPUT        :none
+*OUTPUT       :count since power up
+****************************************************************/
+int ELECHOUSE_CC1101_2::getTxTimeouts(void)
+{
+  return txTimeouts_2;
+}
+/****************************************************************
 *FUNCTION NAME:Char direct SendData
 *FUNCTION     :use CC1101 send data without GDO
 *INPUT        :txBuffer: data array to send; size: number of data to send, no more than 61
@@ -1267,9 +1328,9 @@ return 0;
 byte ELECHOUSE_CC1101_2::CheckReceiveFlag(void)
 {
   if(trxstate_2!=2){SetRx();}
-	if(digitalRead(GDO0_2))			//receive data
+	if(pinRead_2(GDO0_2))			//receive data
 	{
-		while (digitalRead(GDO0_2));
+		while (pinRead_2(GDO0_2));
 		return 1;
 	}
 	else							// no data
@@ -1304,4 +1365,148 @@ byte ELECHOUSE_CC1101_2::ReceiveData(byte *rxBuffer)
  		return 0;
 	}
 }
+/****************************************************************
+*FUNCTION NAME:beginBatch
+*FUNCTION     :defer configuration register writes until endBatch().
+*               Strobes and burst accesses still happen in order, pending
+*               writes are flushed before them.
+*INPUT        :none
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101_2::beginBatch(void)
+{
+  batch_2 = 1;
+  batchDirty_2 = 0;
+  batchWrites_2 = 0;
+  batchTransfers_2 = 0;
+}
+/****************************************************************
+*FUNCTION NAME:endBatch
+*FUNCTION     :write the deferred registers and leave batch mode
+*INPUT        :none
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101_2::endBatch(void)
+{
+  flushBatch();
+  batch_2 = 0;
+}
+/****************************************************************
+*FUNCTION NAME:getBatchStats
+*FUNCTION     :register writes made during the last batch and the SPI
+*               transfers they were coalesced into
+*INPUT        :writes, transfers: results
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101_2::getBatchStats(int *writes, int *transfers)
+{
+  *writes = batchWrites_2;
+  *transfers = batchTransfers_2;
+}
+/****************************************************************
+*FUNCTION NAME:flushBatch
+*FUNCTION     :write every run of consecutive deferred registers with one
+*               burst. Only written registers are touched, so values the
+*               chip updates itself (FSCAL after calibration) survive.
+*INPUT        :none
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101_2::flushBatch(void)
+{
+  uint64_t dirty = batchDirty_2;
+  byte addr = 0;
+  batchDirty_2 = 0;
+  while (dirty){
+  if (!(dirty & 1)){dirty >>= 1; addr++; continue;}
+  byte n = 0;
+  while (dirty >> n & 1){n++;}
+  SpiWriteBurstReg(addr, &batchRegs_2[addr], n);
+  batchTransfers_2++;
+  dirty >>= n;
+  addr += n;
+  }
+}
+/****************************************************************
+*FUNCTION NAME:waitReady
+*FUNCTION     :wait for the chip to pull SO low (CHIP_RDYn) once CS is low.
+*               Bounded by the ready timeout, then CS is
+*               toggled up to READY_RETRIES times. A chip that never gets
+*               ready marks the module degraded: every SPI call returns at
+*               once from then on, until Init() or clearDegraded().
+*INPUT        :none
+*OUTPUT       :1 when ready, 0 on timeout or when degraded
+****************************************************************/
+bool ELECHOUSE_CC1101_2::waitReady(void)
+{
+  if (degraded_2){return 0;}
+  if (!pinRead_2(MISO_PIN_2)){readyHist_2[0]++; return 1;}   //the usual case, no timing needed
+  unsigned long start = micros();
+  byte tries = 0;
+  for(;;){
+    while(pinRead_2(MISO_PIN_2)){
+      if (micros() - start > readyTimeout_2){break;}
+    }
+    if (!pinRead_2(MISO_PIN_2)){
+      unsigned long us = micros() - start;
+      int bin = (33 - __builtin_clz(us | 1)) / 2;   //<4, <16, <64 ... us
+      readyHist_2[bin < READY_HIST_BINS ? bin : READY_HIST_BINS - 1]++;
+      return 1;
+    }
+    if (tries >= READY_RETRIES){
+      readyTimeouts_2++;
+      degraded_2 = 1;
+      return 0;
+    }
+    tries++;
+    readyRetries_2++;
+    pinHigh_2(SS_PIN_2);
+    delayMicroseconds(10);
+    pinLow_2(SS_PIN_2);
+    start = micros();
+  }
+}
+/****************************************************************
+*FUNCTION NAME:setReadyTimeout
+*FUNCTION     :how long each SPI call waits for the chip to get ready
+*INPUT        :us: timeout in microseconds, per try
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101_2::setReadyTimeout(unsigned long us)
+{
+  readyTimeout_2 = us;
+}
+/****************************************************************
+*FUNCTION NAME:isDegraded
+*FUNCTION     :module stopped answering, SPI calls are skipped
+*INPUT        :none
+*OUTPUT       :1 when degraded
+****************************************************************/
+bool ELECHOUSE_CC1101_2::isDegraded(void)
+{
+  return degraded_2;
+}
+/****************************************************************
+*FUNCTION NAME:clearDegraded
+*FUNCTION     :try the module again on the next SPI call
+*INPUT        :none
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101_2::clearDegraded(void)
+{
+  degraded_2 = 0;
+}
+/****************************************************************
+*FUNCTION NAME:getSpiStats
+*FUNCTION     :ready wait timeouts, CS retries and the histogram of ready
+*               wait times: ready at once, <4, <16, <64, <256, <1024,
+*               <4096 us and longer
+*INPUT        :timeouts, retries: results; hist: READY_HIST_BINS (8) entries
+*OUTPUT       :none
+****************************************************************/
+void ELECHOUSE_CC1101_2::getSpiStats(int *timeouts, int *retries, unsigned int *hist)
+{
+  *timeouts = readyTimeouts_2;
+  *retries = readyRetries_2;
+  memcpy(hist, readyHist_2, sizeof(readyHist_2));
+}
 ELECHOUSE_CC1101_2 ELECHOUSE_cc1101_2;
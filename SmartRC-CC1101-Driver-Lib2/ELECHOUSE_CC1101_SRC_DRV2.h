@@ -127,6 +127,8 @@ private:
   void Split_MDMCFG1(void);
   void Split_MDMCFG2(void);
   void Split_MDMCFG4(void);
+  void flushBatch(void);
+  bool waitReady(void);
 public:
   void Init(void);
   byte SpiReadStatus(byte addr);
@@ -159,6 +161,11 @@ public:
   void SendData(char *txchar);
   void SendData(byte *txBuffer, byte size, int t);
   void SendData(char *txchar, int t);
+  int getTxTimeouts(void);
+  void setReadyTimeout(unsigned long us);
+  bool isDegraded(void);
+  void clearDegraded(void);
+  void getSpiStats(int *timeouts, int *retries, unsigned int *hist);
   byte CheckReceiveFlag(void);
   byte ReceiveData(byte *rxBuffer);
   bool CheckCRC(void);
@@ -187,6 +194,9 @@ public:
   void setAppendStatus(bool v);
   void setAdrChk(byte v);
   bool CheckRxFifo(int t);
+  void beginBatch(void);
+  void endBatch(void);
+  void getBatchStats(int *writes, int *transfers);
 };
 
 extern ELECHOUSE_CC1101_2 ELECHOUSE_cc1101_2;
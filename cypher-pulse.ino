@@ -27,8 +27,10 @@
  * - OLED display interface with menu system
  * - Button controls for navigation
  * - Customizable frequency presets (currently: 433.90MHz, 434.00MHz, 434.30MHz, 434.40MHz)
- * - Serial command interface
+ * - Serial command interface, human readable text or COBS framed binary ("proto bin")
  * - EEPROM storage for recorded signals
+ * - Radio profiles (register images) stored in NVS and restored at boot
+ * - FreeRTOS tasks: one per radio on core 0, UI and serial CLI on core 1
  * 
  * Hardware Requirements:
  * - ESP32 development board
@@ -69,6 +71,9 @@
 // ESP32
 #include <Wire.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_wifi.h"
 #include "esp_wifi_types.h"
 #include "esp_system.h"
@@ -76,6 +81,9 @@
 #include "esp_event_loop.h"
 #include "nvs_flash.h"
 #include "driver/gpio.h"
+#include "driver/uart.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
 #include "esp_event_loop.h"
 
 // OLED Display
@@ -92,10 +100,33 @@
 
 // EEPROM for storing signals
 #include <EEPROM.h>
+// NVS key/value storage for radio profiles
+#include <Preferences.h>
+#include <esp_system.h>
+#include <esp_heap_caps.h>
 
 // from fork, ez button becuase the og button code was a lil buggy
 #include <ezButton.h>
 
+// Sketch modules (src/ folder)
+#include "src/radio_port.h"
+#include "src/radio_profile.h"
+#include "src/rx_packet.h"
+#include "src/packet_ring.h"
+#include "src/frame_proto.h"
+#include "src/hex_codec.h"
+#include "src/diversity.h"
+#include "src/rx_stats.h"
+#include "src/packet_filter.h"
+#include "src/chat_link.h"
+#include "src/fast_gpio.h"
+#include "src/oled_flush.h"
+#include "src/text_render.h"
+#include "src/waveform.h"
+#include "src/loopback.h"
+#include "src/wor.h"
+#include "src/radio_power.h"
+
 
 /* Uncomment if adding BT / WiFi Features
 // BT
@@ -134,7 +165,9 @@ struct SignalInfo {
 #define SCREEN_HEIGHT 64
 #define OLED_RESET -1
 #define SSD1306_I2C_ADDRESS 0x3C
-Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);
+#define OLED_I2C_HZ 400000  // SSD1306 fast mode, the library keeps the bus at this rate after begin()
+Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET, OLED_I2C_HZ, OLED_I2C_HZ);
+OledFlush oledflush;  // what the panel shows, showDisplay() only sends the difference
 // U8g2 for Adafruit GFX
 U8G2_FOR_ADAFRUIT_GFX u8g2_for_adafruit_gfx;
 
@@ -150,6 +183,28 @@ ezButton UP_BUTTON(UP_BUTTON_PIN);
 ezButton DOWN_BUTTON(DOWN_BUTTON_PIN);
 ezButton SELECT_BUTTON(SELECT_BUTTON_PIN);
 
+// All button input goes through one queue of debounced presses. The debouncing is
+// ezButton's, run by the UI task; a GPIO interrupt on every edge wakes that task, so
+// it only polls fast while a button is bouncing.
+enum ButtonId {
+  BUTTON_UP,
+  BUTTON_DOWN,
+  BUTTON_SELECT,
+  NUM_BUTTONS
+};
+ezButton *buttons[NUM_BUTTONS] = { &UP_BUTTON, &DOWN_BUTTON, &SELECT_BUTTON };
+const uint8_t buttonpins[NUM_BUTTONS] = { UP_BUTTON_PIN, DOWN_BUTTON_PIN, SELECT_BUTTON_PIN };
+
+struct ButtonEvent {
+  ButtonId button;
+  uint32_t edgeus;  // micros() of the first edge of the press
+};
+QueueHandle_t buttonqueue;
+volatile uint32_t buttonedgeus[NUM_BUTTONS];  // first edge since the button settled, 0 = none
+uint32_t buttonpresses;
+uint32_t buttonlatencysum;  // us from the first edge to the press being handled
+uint32_t buttonlatencymax;
+
 //button debounce time
 #define Debounce_Time 25
 
@@ -171,6 +226,341 @@ const byte ss2 = 17;
 const int gdo0_2 = 25;
 const int gdo2_2 = 33;
 
+// Both radios behind one interface, index 0 = CC#1, 1 = CC#2
+typedef FastPin<gdo0_1> Gdo0Pin1;  // raw record / sniff / replay sample this one
+RadioPortT<ELECHOUSE_CC1101> radio1(CC1, "CC#1", gdo0_1, gdo2_1);
+RadioPortT<ELECHOUSE_CC1101_2> radio2(CC2, "CC#2", gdo0_2, gdo2_2);
+RadioPort *radios[NUM_RADIOS] = { &radio1, &radio2 };
+
+// Radio profiles in NVS
+// Keys: "p<radio>.<name>" = RadioProfile, "i<radio>" = list of names, "b<radio>" = profile restored at boot
+#define PROFILE_NAMESPACE "profiles"
+#define PROFILE_NAME_LEN 12  // NVS keys are max 15 chars, "p1." takes 3
+#define MAX_PROFILES 8       // per radio
+Preferences profilestore;
+
+// Boot
+// Fast boot (the default) skips the splash and status holds and brings the radios up
+// on the radio core while this core does the display. "fastboot 0" brings the slow,
+// showy boot back. After a brown-out, watchdog or panic reset the fast path is always
+// taken and the receive mode that was running is resumed.
+#define SETTINGS_NAMESPACE "settings"
+#define FAST_BOOT_DEFAULT true
+#define SPLASH_MS 5000       // slow boot only
+#define STATUS_HOLD_MS 3000  // slow boot only
+#define RESUME_MAGIC 0x52534D31
+#define RESUME_RX 0x01
+#define RESUME_RECORD 0x02
+#define RESUME_DIVERSITY 0x04
+#define RESUME_DUALRX 0x08
+#define RESUME_WOR 0x10
+Preferences settingsstore;
+bool fastboot = FAST_BOOT_DEFAULT;
+esp_reset_reason_t resetreason;
+
+enum BootPhase {
+  BOOT_SERIAL,   // serial port, settings, NVS
+  BOOT_DISPLAY,  // I2C and OLED
+  BOOT_SPLASH,
+  BOOT_RADIOS,   // waiting for the radio init task, the part that did not overlap
+  BOOT_SETUP,    // the rest of setup(), tasks started
+  NUM_BOOT_PHASES
+};
+const char *const bootPhaseNames[NUM_BOOT_PHASES] = { "serial", "display", "splash", "radio wait", "setup" };
+uint32_t bootphaseus[NUM_BOOT_PHASES];
+uint32_t bootmarkus;
+uint32_t radioinitus;  // how long the radio init task took, in parallel to the above
+
+// Receive modes as of the last CLI pass. RTC memory is not cleared by a watchdog, panic
+// or brown-out reset, so these tell the new boot what was running.
+struct ResumeState {
+  uint32_t magic;
+  uint8_t modes;  // RESUME_*
+  uint8_t check;  // ~modes
+  uint8_t worrxtime;  // RESUME_WOR settings
+  uint16_t worinterval;
+};
+RTC_NOINIT_ATTR ResumeState resumestate;
+
+// Tasks
+// Core 0 runs one task per radio so RX servicing never waits for the display or the
+// serial port, core 1 runs the UI (buttons, OLED, menu) and the serial CLI.
+#define RADIO_CORE 0
+#define APP_CORE 1
+#define RADIO_TASK_PRIO 3
+#define CLI_TASK_PRIO 2
+#define UI_TASK_PRIO 1
+#define RADIO_TASK_STACK 4096
+#define UI_TASK_STACK 8192
+#define CLI_TASK_STACK 6144
+#define RADIO_POLL_MS 5  // RX FIFO is checked at least this often, GDO0 wakes the task earlier
+#define CLI_POLL_MS 2
+#define UI_POLL_MS 5    // while a button is bouncing
+#define UI_IDLE_MS 100  // nothing ticking and no button moving, edges and state changes wake the task earlier
+#define RADIO_CMD_QUEUE_LEN 8  // a whole chat burst fits
+#define APP_EVENT_QUEUE_LEN 8
+#define BUTTON_QUEUE_LEN 8
+
+enum TaskId {
+  TASK_RADIO1,
+  TASK_RADIO2,
+  TASK_UI,
+  TASK_CLI,
+  NUM_TASKS
+};
+
+// Busy time per task, printed (and reset) by the "tasks" command
+struct TaskLoad {
+  const char *name;
+  TaskHandle_t handle;
+  volatile uint32_t busyus;     // busy time since the last report
+  volatile uint32_t busysince;  // micros() when the current busy slice started, 0 = waiting
+};
+TaskLoad taskloads[NUM_TASKS] = { { "radio1" }, { "radio2" }, { "ui" }, { "cli" } };
+uint32_t taskloadwindow = 0;  // micros() of the last report
+
+// Work handed to a radio task. Anything that has to use a radio while it may be
+// listening (chat TX, ...) goes through its queue instead of talking to the chip directly.
+enum RadioCommandType {
+  RADIO_CMD_SEND,  // transmit data[0..len)
+};
+struct RadioCommand {
+  RadioCommandType type;
+  uint8_t len;
+  byte data[CCBUFFERSIZE];
+};
+
+QueueHandle_t radiocmdqueue[NUM_RADIOS];
+
+// RADIO_CMD_SEND is asynchronous: the radio task starts the packet and goes on with its
+// queue / RX work once it is out. GDO0 falling at the end of the packet wakes it.
+#define TX_TIMEOUT_MS 500  // 64 bytes at 1.2 kBaud
+uint32_t txdone[NUM_RADIOS];
+uint32_t txtimeouts[NUM_RADIOS];
+
+// Listen before talk for RADIO_CMD_SEND, switched with "lbt". The CC1101 does the clear
+// channel assessment itself (MCSM1.CCA_MODE): STX from RX is ignored while the channel
+// is busy, txPoll() in the radio task then backs off a random number of slots and tries
+// again, up to LBT_MAX_WAIT_MS. Counted per radio in RadioPort::ccaStats().
+#define LBT_MAX_WAIT_MS 50  // frame dropped (and counted) after this
+int lbtmode = 0;       // MCSM1.CCA_MODE: 0 = off, 1 = RSSI below threshold, 2 = not receiving a packet, 3 = both
+int lbtthreshold = 0;  // AGCCTRL1.CARRIER_SENSE_ABS_THR, dB relative to MAGN_TARGET, -8 = absolute threshold off
+
+// Power management, switched with "power" (stored in flash). A radio that no mode, command
+// or task has used for RADIO_IDLE_SLEEP_MS goes to SPWD, see src/radio_power.h; the next
+// task that takes the radio lock gets it back first. With both radios asleep, or CC1 in WOR,
+// the CLI task puts the ESP32 into light sleep whenever nothing is pending, woken by a
+// button, serial input, GDO0 (WOR only) or the timer. The characters that wake the UART
+// are lost, after that it stays awake long enough to type a command.
+#define POWER_SAVE_DEFAULT true
+#define RADIO_IDLE_SLEEP_MS 1000
+#define RADIO_SLEEP_POLL_MS 50            // radio task poll while its radio is asleep
+#define SLEEP_MAX_MS 1000                 // timer wake, housekeeping of the other tasks
+#define SLEEP_UART_WAKE_EDGES 3
+#define SLEEP_AWAKE_AFTER_INPUT_MS 10000
+#define SLEEP_AWAKE_AFTER_BUTTON_MS 200   // debounce and menu redraw
+struct SleepStats {
+  int64_t sleepus;
+  uint32_t sleeps;
+  uint32_t timerwakes;
+  uint64_t timerlateus;  // timer wakes: time past the requested wake-up, entry and exit
+  uint32_t timerlatemax;
+};
+bool powersave = POWER_SAVE_DEFAULT;
+RadioPower radiopower[NUM_RADIOS];
+SleepStats sleepstats;
+uint32_t awakeat, awakems;  // no light sleep for awakems from awakeat
+
+// Wake-on-Radio receive ("wor"), see src/wor.h: receive mode with CC1 polling the channel
+// on its own while the ESP32 light sleeps (above), woken by GDO0 when it found a sync word
+#define WOR_DEFAULT_INTERVAL_MS 500
+#define WOR_DEFAULT_RX_TIME 3  // 1.56 % of the interval in RX
+struct WorStats {
+  int64_t startus;  // esp_timer_get_time(), micros() wraps after 71 minutes
+  int64_t sleepus;
+  uint32_t sleeps;
+  uint32_t radiowakes;  // light sleeps ended by GDO0
+  uint32_t packets;     // GDO0 falls serviced
+};
+int wormode = 0;  // together with receivingmode
+uint32_t worinterval = WOR_DEFAULT_INTERVAL_MS;
+uint8_t worrxtime = WOR_DEFAULT_RX_TIME;
+WorStats worstats;
+RadioProfile worsaved;                    // CC1 before "wor", restored when it stops
+volatile uint32_t gdo0falls[NUM_RADIOS];  // counted by radioGdo0Isr()
+uint32_t worseen;                         // gdo0falls[0] the radio task has serviced
+
+// Received packets: one SPSC ring per radio and consumer. The radio task pushes into the
+// rings of the active consumers and the CLI task drains every ring on its own, so a slow
+// printer never holds up the recorder or the next SetRx().
+enum RxConsumer {
+  RX_PRINTER,   // receive mode, hex dump
+  RX_RECORDER,  // recording mode, frames into bigrecordingbuffer
+  RX_DECODER,   // chat mode, packet as text
+  RX_DIVERSITY, // diversity mode, copies from both radios into diversitywindow
+  RX_MERGER,    // dual receive, both radios as one time ordered stream
+  NUM_RX_CONSUMERS
+};
+const char *rxConsumerNames[NUM_RX_CONSUMERS] = { "printer", "recorder", "decoder", "diversity", "merger" };
+#define MERGE_HOLD_US 2000  // how long a packet waits for an older one from the other radio
+
+// Receive statistics per radio and frequency, written by the radio tasks with the radio
+// lock held. "stats" prints them, the RX STATS menu page shows the current frequency.
+RxStatsTable rxstats[NUM_RADIOS];
+#define STATS_PAGE_MS 500  // refresh interval of the OLED page
+
+// Live RSSI meter (GET RSSI menu page). Each radio gets 4 display pages: value text,
+// bar with peak hold, 16 px sparkline. The bars are sampled and redrawn at 50 Hz, text
+// and sparkline at 10 Hz, so most frames only touch the two bar pages.
+#define METER_TICK_MS 20  // 50 Hz
+#define METER_SLOW_EVERY 5
+#define METER_PEAK_HOLD_MS 1000
+#define METER_MIN_DBM -120
+#define METER_MAX_DBM -20
+#define METER_HISTORY SCREEN_WIDTH  // one sparkline column per slow tick
+
+struct RssiMeter {
+  int peak;
+  uint32_t peakat;  // millis() the peak was set
+  int slowmax;      // strongest sample since the last sparkline column
+  int last;
+  int8_t history[METER_HISTORY];  // ring of dBm, oldest at head
+  uint8_t head;
+};
+RssiMeter meters[NUM_RADIOS];
+uint8_t meterslow;
+
+// Raw record / replay on GDO0 of CC1 ("recraw", "playraw" and the menu). The job runs in
+// slices of up to RAW_SLICE_BYTES, the menu runs one per UI tick so SELECT and state
+// changes get through in between. Samples keep one running deadline across the slices,
+// the few 10 us between two ticks only make the next sample late, nothing adds up.
+// Recording waits for the first high level, RAW_WAIT_SLICE_MS per slice and gives up
+// after RAW_WAIT_MAX_MS. Sniffing ("sniffraw") records round the buffer without a wait
+// until a key is pressed, and sleeps a tick between slices for the UI task.
+#define RAW_MENU_INTERVAL_US 100  // menu record / replay, as "recraw 100"
+#define RAW_SLICE_BYTES 16        // 12.8 ms at 100 us
+#define RAW_WAIT_SLICE_MS 20
+#define RAW_WAIT_MAX_MS 30000
+#define RAW_SHOW_TICK_MS 5        // menu "show raw" sends one row per tick
+#define RESET_TICK_MS 10          // menu "reset": CC1, CC2, then the status, one per tick
+enum RawMode { RAW_RECORD, RAW_PLAY, RAW_SNIFF };
+struct RawJob {
+  bool active;
+  RawMode mode;
+  bool waiting;     // recording, no signal yet
+  uint32_t since;   // millis() the wait started
+  int interval;     // us per sample
+  int pos;          // next byte of bigrecordingbuffer
+  uint32_t next;    // micros() deadline of the next sample
+};
+RawJob rawjob;
+int rawshowpos;     // next byte of the capture the menu sends to serial
+int resetstep;
+
+// Waveform viewer (WAVEFORM menu page, "wave"): the raw capture drawn one column per
+// 1 << wavezoom samples, from min/max summaries built when the page is opened.
+// UP / DOWN move the cursor (kept in the middle of the screen but at the ends) or zoom
+// around it, SELECT switches between the two, holding SELECT leaves.
+#define WAVE_TICK_MS 50
+#define WAVE_EXIT_HOLD_MS 800
+#define WAVE_PAN_COLUMNS 32  // a quarter screen per press
+#define WAVE_CURSOR_X (SCREEN_WIDTH / 2)
+#define WAVE_HIGH_Y 14
+#define WAVE_LOW_Y 46
+int rawinterval = 0;  // microseconds per sample of the last recraw / sniffraw, 0 = unknown
+WaveSummary wave;
+uint8_t wavestore[RECORDINGBUFFERSIZE];
+uint8_t wavezoom;     // log2 samples per column
+uint8_t wavemaxzoom;  // whole capture on one screen
+uint32_t wavepos;     // first sample on screen, a multiple of 1 << wavezoom
+uint32_t wavecursor;  // sample under the cursor
+bool wavezooming;     // UP / DOWN zoom instead of pan
+uint32_t waveselectat;
+
+// Loopback self-test (TEST_CC1101 menu page, "selftest"), see src/loopback.h. One step
+// per tick: send a test packet, or check the receiver once the packet is out. Every
+// test point is run CC1 -> CC2, then CC2 -> CC1.
+#define LOOPBACK_TICK_MS 2
+#define LOOPBACK_SLACK_US 5000  // calibration and SPI on top of twice the airtime
+#define LOOPBACK_MAX_PER 100    // 1/1000, a test point passes below 10 % PER
+const LoopbackPoint loopbackpoints[] = {
+  { 433200000, 1200 }, { 433920000, 1200 }, { 434600000, 1200 },
+  { 433200000, 38400 }, { 433920000, 38400 }, { 434600000, 38400 },
+  { 433200000, 250000 }, { 433920000, 250000 }, { 434600000, 250000 },
+};
+#define NUM_LOOPBACK_POINTS (sizeof(loopbackpoints) / sizeof(loopbackpoints[0]))
+// "calibrate <radio>" is the same run on one test point, only with the other radio as
+// the sender. The receiver's FREQOFF + mean FREQEST is the correction that puts it on
+// the sender's frequency, stored as the module's crystal error (ppb) in settingsstore.
+const LoopbackPoint calibrationpoint = { 433920000, 38400 };
+#define CALIBRATION_MIN_PACKETS (LOOPBACK_PACKETS / 2)
+#define FREQ_CORR_NONE INT32_MIN  // settingsstore value of an uncalibrated module
+const char *freqcorrkeys[NUM_RADIOS] = { "freqcorr1", "freqcorr2" };
+int8_t calibrateradio = -1;  // set by "calibrate", taken by the next loopbackEnter()
+struct LoopbackRun {
+  bool active;
+  int8_t calibrate;  // radio being calibrated, -1 = self-test
+  const LoopbackPoint *points;
+  uint8_t numpoints;
+  uint8_t point;  // index into points
+  uint8_t tx;     // sending radio, the other one receives
+  uint16_t seq;
+  bool inflight;
+  uint32_t sentat;   // micros() of sendAsync()
+  uint32_t startat;  // micros() of the first packet of the test point
+  uint16_t passed;
+  LoopbackResult result;
+  RadioProfile saved[NUM_RADIOS];  // configuration before the test, restored after
+};
+LoopbackRun loopback;
+
+// Software filter in front of the printer and recorder, see "filter". Evaluated by the
+// radio tasks with the radio lock held, before the packet is queued.
+PacketFilter rxfilter;
+PacketRing rxrings[NUM_RADIOS][NUM_RX_CONSUMERS];
+
+// Serial commands
+// One table, sorted by name, searched with a binary search. Arguments are split in
+// place in the line buffer and checked against the kind the handler takes before it runs.
+#define MAX_COMMAND_ARGS 4
+#define MAX_BATCH_COMMANDS 16
+enum CommandArgs {
+  ARGS_NONE,         // void fn()
+  ARGS_INT,          // void fn(int)
+  ARGS_INT_INT,      // void fn(int, int)
+  ARGS_FLOAT,        // void fn(float)
+  ARGS_FLOAT_FLOAT,  // void fn(float, float)
+  ARGS_TEXT,         // void fn(const char *), exactly one word
+  ARGS_RAW,          // void fn(int argc, char **argv), up to MAX_COMMAND_ARGS words
+  ARGS_LINE,         // void fn(char *), the rest of the line unsplit
+};
+typedef void (*CommandFn)();  // cast back to the real type according to args
+struct Command {
+  const char *name;
+  CommandArgs args;
+  CommandFn fn;
+  bool staged;  // a CC1 register setter that edits the batch image, see runBatch()
+};
+// A command line that passed parsing, ready to run
+struct ParsedCommand {
+  const Command *cmd;
+  int argc;
+  char *argv[MAX_COMMAND_ARGS];
+  int ints[2];
+  float floats[2];
+};
+// CC1 in a batch. Its driver writes every register on its own, so the setters edit
+// a register image instead, which goes to the chip with one profileApply().
+struct Cc1Batch {
+  bool active;
+  bool dirty;   // image captured and edited, not on the chip yet
+  bool failed;  // a read back did not match
+  int edits;
+  int applies;
+  RadioProfile image;
+};
+Cc1Batch cc1batch;
+
 // This is the state machine for the app, it is used to keep track of the current state of the app.
 // Add more states as needed when you add more menu options and features.
 enum AppState {
@@ -192,11 +582,36 @@ enum AppState {
   STATE_SET_43400,
   STATE_SET_43390,
   STATE_TEST_CC1101,
+  STATE_RX_STATS,
+  STATE_WAVE_VIEW,
+  STATE_RESULT,  // holds the last screen of a finished action until SELECT
+  NUM_APP_STATES
 };
 
 // Global variable to keep track of the current state
 AppState currentState = STATE_MENU;
 
+// State changes are posted as events and applied by the UI task, so the menu, the CLI
+// or a radio task can ask for another screen without racing the UI on currentState.
+struct AppEvent {
+  AppState state;
+};
+QueueHandle_t appeventqueue;
+
+// What the UI does in a state, see uistates[]. enter runs when the state is entered,
+// tick every tickms while in it, leave when switching away. SELECT leaves every state
+// but the menu, unless the state has a button hook, which then gets every press.
+struct UiState {
+  AppState state;
+  const char *name;  // "Exiting <name> Mode"
+  void (*enter)();
+  void (*tick)();
+  uint16_t tickms;
+  void (*leave)();
+  void (*button)(ButtonId button);
+};
+extern const UiState uistates[NUM_APP_STATES];
+
 // Menu VARIABLES
 // Add more items as needed when you add more STATE variables. 
 // This creates a list of menu items that can be used to navigate the app.
@@ -218,6 +633,8 @@ enum MenuItem {
   SET_43430,
   SET_43400,
   SET_43390,
+  RX_STATS,
+  WAVE_VIEW,
   SETTINGS,
   HELP,
   NUM_MENU_ITEMS
@@ -229,7 +646,7 @@ const char *menuLabels[NUM_MENU_ITEMS] = {
   "2X CC JAM", "CC#1 JAM", "CC#2 JAM", "SCAN", "TEST_CC1101", "REC RAW", "PLAY RAW", "SHOW RAW", "SHOW BUFF", "GET RSSI", "FLUSH BUFF", "STOP ALL", "SET_43440",
   "SET_43430",
   "SET_43400",
-  "SET_43390", "RESET CC", "Settings", "Help"
+  "SET_43390", "RESET CC", "RX STATS", "WAVEFORM", "Settings", "Help"
 };
 
 // Menu/button variables
@@ -273,16 +690,13 @@ void drawMenu() {
     display.println(menuLabels[menuIndex]);
   }
 
-  display.display();
+  showDisplay();
 }
 
 // Use this instead of delay()
 void nonBlockingDelay(unsigned long ms) {
-  unsigned long start = millis();
-  while (millis() - start < ms) {
-    // Allow ESP32 to handle background processes
-    yield();  // Very important!
-  }
+  // Sleeps only the calling task, the radio and CLI tasks keep running
+  vTaskDelay(pdMS_TO_TICKS(ms));
 }
 
 // position in big recording buffer
@@ -303,8 +717,34 @@ int recordingmode = 0;
 // check if CLI chat mode enabled
 int chatmode = 0;
 
+// chat mode link layer (fragments, acks, retransmits), CLI task only
+ChatLink chatlink;
+char chatline[CHAT_MAX_MESSAGE];  // message being typed
+int chatlinelen = 0;
+
+// check if diversity receive (CC1 + CC2 on the same channel) enabled
+int diversitymode = 0;
+DiversityWindow diversitywindow;  // CLI task only
+
+// check if dual channel receive (CC1 and CC2 each on their own settings) enabled
+int dualrxmode = 0;
+
+// carrier and channel of each radio, taken when diversity / dual receive starts, for tagging packets
+uint32_t rxtaghz[NUM_RADIOS];
+uint8_t rxtagchannel[NUM_RADIOS];
+
 static bool do_echo = true;
 
+// Serial output format, switched with "proto text|bin"
+enum SerialProto {
+  PROTO_TEXT,
+  PROTO_BIN,
+};
+SerialProto serialproto = PROTO_TEXT;
+
+// sequence number of the next binary frame, shared by all tasks
+uint8_t frameseq = 0;
+
 // buffer for receiving  CC1101
 byte ccreceivingbuffer[CCBUFFERSIZE] = { 0 };
 
@@ -319,56 +759,6 @@ byte bigrecordingbuffer[RECORDINGBUFFERSIZE] = { 0 };
 byte textbuffer[BUF_LENGTH];
 // char textbuffer[BUF_LENGTH];
 
-// convert bytes in table to string with hex numbers
-void asciitohex(byte *ascii_ptr, byte *hex_ptr, int len) {
-  byte i, j, k;
-  for (i = 0; i < len; i++) {
-    // Convert high nibble (4 bits) to hex
-    j = ascii_ptr[i] / 16;
-    if (j > 9) {
-      k = j - 10 + 65;  // Convert to A-F
-    } else {
-      k = j + 48;       // Convert to 0-9
-    }
-    hex_ptr[2 * i] = k;
-    
-    // Convert low nibble (4 bits) to hex
-    j = ascii_ptr[i] % 16;
-    if (j > 9) {
-      k = j - 10 + 65;  // Convert to A-F
-    } else {
-      k = j + 48;       // Convert to 0-9
-    }
-    hex_ptr[(2 * i) + 1] = k;
-  };
-  hex_ptr[(2 * i) + 2] = '\0';  // Null terminate the string
-}
-
-// convert string with hex numbers to array of bytes
-void hextoascii(byte *ascii_ptr, byte *hex_ptr, int len) {
-  byte i, j;
-  for (i = 0; i < (len / 2); i++) {
-    // Process high nibble
-    j = hex_ptr[i * 2];
-    if ((j > 47) && (j < 58))
-      ascii_ptr[i] = (j - 48) * 16;  // Convert 0-9
-    if ((j > 64) && (j < 71))
-      ascii_ptr[i] = (j - 55) * 16;  // Convert A-F
-    if ((j > 96) && (j < 103))
-      ascii_ptr[i] = (j - 87) * 16;  // Convert a-f
-    
-    // Process low nibble
-    j = hex_ptr[i * 2 + 1];
-    if ((j > 47) && (j < 58))
-      ascii_ptr[i] = ascii_ptr[i] + (j - 48);  // Add 0-9
-    if ((j > 64) && (j < 71))
-      ascii_ptr[i] = ascii_ptr[i] + (j - 55);  // Add A-F
-    if ((j > 96) && (j < 103))
-      ascii_ptr[i] = ascii_ptr[i] + (j - 87);  // Add a-f
-  };
-  ascii_ptr[i++] = '\0';  // Null terminate the string
-}
-
 /*
 FIX FOR BAD GDO0
 INCASE YOU HAVE GDO0 AS OUTPUT SUCH AS ESP32 PIN 34, 36, 39. 
@@ -384,15 +774,21 @@ void CC1::GDO_Set (void)
 
 // Initialize CC1101 #1 board with default settings, you may change your preferences here
 static void cc1101initialize(void) {
+  RadioLock lock;
   // initializing library with custom pins selected
   CC1.setSpiPin(sck1, miso1, mosi1, ss1);
   CC1.setGDO(gdo0_1, gdo2_1);
+  // Fast path: restore the last used profile with one burst write instead of the setters below
+  if (restoreBootProfile(0)) {
+    return;
+  }
   // Main part to tune CC1101 with proper frequency, modulation and encoding
   CC1.Init();  // must be set to initialize the cc1101!
   CC1.setGDO0(gdo0_1);
   CC1.setCCMode(1);           // set config for internal transmission mode. value 0 is for RAW recording/replaying
   CC1.setModulation(2);       // set modulation mode. 0 = 2-FSK, 1 = GFSK, 2 = ASK/OOK, 3 = 4-FSK, 4 = MSK.
   CC1.setMHZ(433.92);         // Here you can set your basic frequency. The lib calculates the frequency automatically (default = 433.92).The cc1101 can: 300-348 MHZ, 387-464MHZ and 779-928MHZ. Read More info from datasheet.
+  radio1.applyFreqCorrection();  // measured crystal error of this module, see "calibrate"
   CC1.setDeviation(47.60);    // Set the Frequency deviation in kHz. Value from 1.58 to 380.85. Default is 47.60 kHz.
   CC1.setChannel(0);          // Set the Channelnumber from 0 to 255. Default is cahnnel 0.
   CC1.setChsp(199.95);        // The channel spacing is multiplied by the channel number CHAN and added to the base frequency in kHz. Value from 25.39 to 405.45. Default is 199.95 kHz.
@@ -419,15 +815,21 @@ static void cc1101initialize(void) {
 
 // CC1101 #2 inititialization using 2nd library
 static void cc1101initialize_2(void) {
+  RadioLock lock;
   // initializing library with custom pins selected
   CC2.setSpiPin(sck2, miso2, mosi2, ss2);
   CC2.setGDO(gdo0_2, gdo2_2);
+  // Fast path: restore the last used profile with one burst write instead of the setters below
+  if (restoreBootProfile(1)) {
+    return;
+  }
   // Main part to tune CC1101 with proper frequency, modulation and encoding
   CC2.Init();  // must be set to initialize the cc1101!
   CC2.setGDO0(gdo0_2);
   CC2.setCCMode(1);           // set config for internal transmission mode. value 0 is for RAW recording/replaying
   CC2.setModulation(2);       // set modulation mode. 0 = 2-FSK, 1 = GFSK, 2 = ASK/OOK, 3 = 4-FSK, 4 = MSK.
   CC2.setMHZ(434.50);         // Here you can set your basic frequency. The lib calculates the frequency automatically (default = 433.92).The cc1101 can: 300-348 MHZ, 387-464MHZ and 779-928MHZ. Read More info from datasheet.
+  radio2.applyFreqCorrection();  // measured crystal error of this module, see "calibrate"
   CC2.setDeviation(47.60);    // Set the Frequency deviation in kHz. Value from 1.58 to 380.85. Default is 47.60 kHz.
   CC2.setChannel(0);          // Set the Channelnumber from 0 to 255. Default is cahnnel 0.
   CC2.setChsp(199.95);        // The channel spacing is multiplied by the channel number CHAN and added to the base frequency in kHz. Value from 25.39 to 405.45. Default is 199.95 kHz.
@@ -482,25 +884,59 @@ void getRssi();
 void scan(float settingf1, float settingf2);
 void save();
 void load();
+void saveProfile(int radio, const char *name);
+void loadProfile(int radio, const char *name);
+void listProfiles(int radio);
+void deleteProfile(int radio, const char *name);
+bool restoreBootProfile(int radio);
 void toggleRxMode();
 void toggleChatMode();
+void chatInput(int data);
+void toggleDiversityMode();
+void printDiversityStats();
+void statsCommand(int argc, char **argv);
+void filterCommand(int argc, char **argv);
+void lbtCommand(int argc, char **argv);
+void dualRxCommand(int argc, char **argv);
+void worCommand(int argc, char **argv);
+void worStart(uint32_t intervalms, uint8_t rxtime);
+void worStop();
+void printWorStats();
+void powerCommand(int argc, char **argv);
+void stayAwake(uint32_t ms);
 void toggleJammingMode();
 void bruteForce(int setting, int setting2);
-void transmitData(char *cmdline);
+void transmitData(const char *hexData);
 void recordRawData(int setting);
 void sniffRawData(int setting);
 void playRawData(int setting);
 void showRawData();
 void showBitData();
-void addRawData(char *cmdline);
+void showWaveform();
+void exitToMenu();
+void selfTest();
+void calibrateCommand(int argc, char **argv);
+void calibrateFinish();
+void loadFreqCorrections();
+void addRawData(const char *hexData);
 void toggleRecordingMode();
 void playRecordedFrames(int setting);
-void addFrame(char *cmdline);
+void addFrame(const char *hexData);
 void showRecordedFrames();
 void flushRecordingBuffer();
 void setEchoMode(int do_echo);
+void setFastBoot(int mode);
+void setSpiTimeout(int us);
 void stopAllModes();
 void initializeCC1101();
+void printTaskLoad();
+void executeCommandLine(char *line);
+void runBatch(char *line);
+RadioProfile *cc1Staged();
+void cc1BatchApply();
+void profileCommand(int argc, char **argv);
+void protoCommand(const char *mode);
+void setProtocol(int mode);
 
 // Function Definitions
 
@@ -514,13 +950,55 @@ void printHelp() {
     "setrxbw <Receive bndwth> : Set the Receive Bandwidth in kHz. Value from 58.03 to 812.50. \r\n\r\n"
     "setdrate <datarate> : Set the Data Rate in kBaud. Value from 0.02 to 1621.83.\r\n\r\n"
     "setpa <power value> : Set RF transmission power. The following settings are possible depending on the frequency band.  (-30  -20  -15  -10  -6    0    5    7    10   11   12) Default is max!\r\n\r\n"
-    "setsyncmode  <sync mode> : Combined sync-word qualifier mode. 0 = No preamble/sync. 1 = 16 sync word bits detected. 2 = 16/16 sync word bits detected. 3 = 30/32 sync word bits detected. 4 = No preamble/sync, carrier-sense above threshold. 5 = 15/16 + carrier-sense above threshold. 6 = 16/16 + carrier-sense above threshold. 7 = 30/32 + carrier-sense above threshold.\r\n"));
-  // Add the rest of the help text here...
+    "setsyncmode  <sync mode> : Combined sync-word qualifier mode. 0 = No preamble/sync. 1 = 16 sync word bits detected. 2 = 16/16 sync word bits detected. 3 = 30/32 sync word bits detected. 4 = No preamble/sync, carrier-sense above threshold. 5 = 15/16 + carrier-sense above threshold. 6 = 16/16 + carrier-sense above threshold. 7 = 30/32 + carrier-sense above threshold.\r\n\r\n"
+    "profile save <radio> <name> : Save the complete configuration of radio 1 or 2 into flash. Max 12 chars, 8 profiles per radio.\r\n\r\n"
+    "profile load <radio> <name> : Restore a saved configuration. The last saved / loaded profile is restored at boot.\r\n\r\n"
+    "profile list <radio> : List saved profiles.\r\n\r\n"
+    "profile del <radio> <name> : Delete a saved profile.\r\n\r\n"
+    "proto <text|bin> : Serial output format. bin = COBS framed binary messages (packets, metadata, scan sweeps, captures), commands are then sent as command frames. See tools/frame_decode.py.\r\n\r\n"
+    "tasks : Show CPU load and free stack of the radio, UI and CLI tasks, queued / dropped packets per RX consumer, SPI errors of CC2.\r\n\r\n"
+    "spitimeout <us> : How long CC2 SPI calls wait for the chip to get ready (default 2000). A module that stays busy is marked degraded and skipped until init.\r\n\r\n"
+    "setsyncword <high> <low> : Set sync word. Values 0-255, decimal or 0x hex.\r\n\r\n"
+    "setadrchk <mode> / setaddr <addr> / setwhitedata <0|1> / setpktformat <mode> / setlengthconfig <mode> / setpacketlength <len> : Packet handling.\r\n\r\n"
+    "setcrc <0|1> / setcrcaf <0|1> / setdcfilteroff <0|1> / setmanchester <0|1> / setfec <0|1> / setpre <n> / setpqt <n> / setappendstatus <0|1> : Packet options.\r\n\r\n"
+    "getrssi : Display quality information about last received frames over RF.\r\n\r\n"
+    "scan <start> <stop> : Scan frequency range for the highest signal.\r\n\r\n"
+    "rx : Enable or disable printing of received RF packets on serial terminal.\r\n\r\n"
+    "wor [<interval ms> [<rx time>]] : Low power rx. CC1 wakes every interval (1..1890 ms, default 500) and listens for 12.5 % >> rx time (0..6, default 3) of it, the ESP32 light sleeps in between. Transmitters need a preamble longer than the interval. Serial input wakes the CLI, the first characters are lost. Again without parameters (or x) to stop, prints the duty cycles and estimated current.\r\n\r\n"
+    "chat : Enable chat mode between devices. Enter sends the line (up to 4 KB) as one message, it is fragmented, acknowledged and resent until it is through. /quit leaves chat mode.\r\n\r\n"
+    "dualrx [<profile 1> <profile 2>] : Receive with both radios at once, each on its own frequency / channel / modulation (optionally loaded from saved profiles), as one time ordered stream tagged with radio and channel. Again without parameters to stop.\r\n\r\n"
+    "diversity : Receive with both radios on the settings of CC1 (separate antennas) and print each packet once, the copy with the best RSSI / LQI. Disabling prints per radio hit rates.\r\n\r\n"
+    "tx <hex-vals> : Send packet of max 60 bytes <hex values> over RF.\r\n\r\n"
+    "rec : Enable or disable recording frames in the buffer.\r\n\r\n"
+    "add <hex-vals> : Manually add single frame payload (max 60 hex values) to the buffer so it can be replayed.\r\n\r\n"
+    "show : Show content of recording buffer.\r\n\r\n"
+    "flush : Clear the recording buffer.\r\n\r\n"
+    "play <N> : Replay 0 = all frames or N-th recorded frame previously stored in the buffer.\r\n\r\n"
+    "recraw <microseconds> / sniffraw <microseconds> / playraw <microseconds> : Record, sniff or replay raw RF data sampled with the given interval.\r\n\r\n"
+    "showraw / showbit / addraw <hex-vals> : Show the raw buffer as hex or bits, add hex data to it.\r\n\r\n"
+    "wave : Show the raw buffer as a waveform on the display. UP / DOWN pan, SELECT switches them to zoom and back, hold SELECT to leave. Bottom line: pulse widths at the cursor.\r\n\r\n"
+    "save / load : Store or restore the recording buffer in EEPROM.\r\n\r\n"
+    "echo <mode> : Enable or disable Echo on serial terminal. 1 = enabled, 0 = disabled.\r\n\r\n"
+    "fastboot <0|1> : 1 = boot in under a second (default), 0 = splash screens and status holds. Stored in flash.\r\n\r\n"
+    "x : Stop jamming, receiving or recording.\r\n\r\n"
+    "power [<0|1>] : 1 = power save (default): radios unused for a second go to power-down and are restored on the next use, the ESP32 light sleeps while both are down (serial input wakes it, the first characters are lost). Stored in flash. Without parameters shows sleep times and wake-up latencies.\r\n\r\n"
+    "init : Restarts CC1101 board with default parameters.\r\n\r\n"
+    "calibrate [<radio> [clear]] : Measure the frequency error of radio 1 or 2 against the other one (test packets at -30 dBm, FREQEST) and store the correction in flash. It is applied on every tune. clear = back to the driver defaults. Without parameters shows the corrections.\r\n\r\n"
+    "selftest : CC1 and CC2 send each other numbered packets at -30 dBm on 3 frequencies x 3 data rates, both ways. Prints packet error rate, RSSI, LQI, frequency offset and throughput per test point. Receive modes must be off.\r\n\r\n"
+    "filter [clear | byte <offset> <hex> [<mask>] | len <min> <max> | rssi <dBm> | dedup <ms>] : Only packets matching every rule are printed (rx) or recorded (rec). Without parameters lists the rules.\r\n\r\n"
+    "lbt [<mode> [<threshold>]] : Listen before talk for chat / tx. mode = CCA mode: 0 = off, 1 = RSSI below threshold, 2 = unless receiving a packet, 3 = both. threshold = carrier sense in dB relative to the AGC target (-8..7). Without parameters shows deferrals and failures.\r\n\r\n"
+    "stats [reset] : Per radio and frequency: packets, CRC fails, FIFO overflows, RSSI / LQI histograms and time between packets.\r\n\r\n"
+    "batch <cmd>; <cmd>; ... : Run up to 16 commands as one transaction. All are checked first, nothing runs if one is wrong. CC1 settings are written as one register image, CC2 register writes as burst writes, at the end.\r\n"));
 }
 
 // Sets the modulation for the radio
 void setModulation(int setting) {
-  CC1.setModulation(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetModulation(*image, setting);
+  } else {
+    CC1.setModulation(setting);
+  }
   Serial.print(F("\r\nModulation: "));
   if (setting == 0) {
     Serial.print(F("2-FSK"));
@@ -538,57 +1016,93 @@ void setModulation(int setting) {
 
 // Use to set specific frequency
 void setMhz(float settingf1) {
-  CC1.setMHZ(settingf1);
-  CC2.setMHZ(settingf1);
+  RadioLock lock;
+  radio1.setMHZ(settingf1);
+  radio2.setMHZ(settingf1);
   Serial.print(F("\r\nFrequency: "));
   Serial.print(settingf1);
   Serial.print(F(" MHz\r\n"));
 }
 
 void setDeviation(float settingf1) {
-  CC1.setDeviation(settingf1);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetDeviation(*image, settingf1);
+  } else {
+    CC1.setDeviation(settingf1);
+  }
   Serial.print(F("\r\nDeviation: "));
   Serial.print(settingf1);
   Serial.print(F(" KHz\r\n"));
 }
 
 void setChannel(int setting) {
-  CC1.setChannel(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetChannel(*image, setting);
+  } else {
+    CC1.setChannel(setting);
+  }
   Serial.print(F("\r\nChannel:"));
   Serial.print(setting);
   Serial.print(F("\r\n"));
 }
 
 void setChsp(float settingf1) {
-  CC1.setChsp(settingf1);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetChsp(*image, settingf1);
+  } else {
+    CC1.setChsp(settingf1);
+  }
   Serial.print(F("\r\nChann spacing: "));
   Serial.print(settingf1);
   Serial.print(F(" kHz\r\n"));
 }
 
 void setRxBw(float settingf1) {
-  CC1.setRxBW(settingf1);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetRxBW(*image, settingf1);
+  } else {
+    CC1.setRxBW(settingf1);
+  }
   Serial.print(F("\r\nRX bandwidth: "));
   Serial.print(settingf1);
   Serial.print(F(" kHz \r\n"));
 }
 
 void setDRate(float settingf1) {
-  CC1.setDRate(settingf1);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetDRate(*image, settingf1);
+  } else {
+    CC1.setDRate(settingf1);
+  }
   Serial.print(F("\r\nDatarate: "));
   Serial.print(settingf1);
   Serial.print(F(" kbaud\r\n"));
 }
 
 void setPa(int setting) {
-  CC1.setPA(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetPA(*image, setting);
+  } else {
+    CC1.setPA(setting);
+  }
   Serial.print(F("\r\nTX PWR: "));
   Serial.print(setting);
   Serial.print(F(" dBm\r\n"));
 }
 
 void setSyncMode(int setting) {
-  CC1.setSyncMode(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetSyncMode(*image, setting);
+  } else {
+    CC1.setSyncMode(setting);
+  }
   Serial.print(F("\r\nSynchronization: "));
   if (setting == 0) {
     Serial.print(F("No preamble"));
@@ -611,7 +1125,12 @@ void setSyncMode(int setting) {
 }
 
 void setSyncWord(int setting, int setting2) {
-  CC1.setSyncWord(setting2, setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetSyncWord(*image, setting2, setting);
+  } else {
+    CC1.setSyncWord(setting2, setting);
+  }
   Serial.print(F("\r\nSynchronization:\r\n"));
   Serial.print(F("high = "));
   Serial.print(setting);
@@ -621,7 +1140,12 @@ void setSyncWord(int setting, int setting2) {
 }
 
 void setAdrChk(int setting) {
-  CC1.setAdrChk(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetAdrChk(*image, setting);
+  } else {
+    CC1.setAdrChk(setting);
+  }
   Serial.print(F("\r\nAddress checking:"));
   if (setting == 0) {
     Serial.print(F("No adr chk"));
@@ -636,14 +1160,24 @@ void setAdrChk(int setting) {
 }
 
 void setAddr(int setting) {
-  CC1.setAddr(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetAddr(*image, setting);
+  } else {
+    CC1.setAddr(setting);
+  }
   Serial.print(F("\r\nAddress: "));
   Serial.print(setting);
   Serial.print(F("\r\n"));
 }
 
 void setWhiteData(int setting) {
-  CC1.setWhiteData(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetWhiteData(*image, setting);
+  } else {
+    CC1.setWhiteData(setting);
+  }
   Serial.print(F("\r\nWhitening "));
   if (setting == 0) {
     Serial.print(F("OFF"));
@@ -654,7 +1188,12 @@ void setWhiteData(int setting) {
 }
 
 void setPktFormat(int setting) {
-  CC1.setPktFormat(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetPktFormat(*image, setting);
+  } else {
+    CC1.setPktFormat(setting);
+  }
   Serial.print(F("\r\nPacket format: "));
   if (setting == 0) {
     Serial.print(F("Normal mode"));
@@ -669,7 +1208,12 @@ void setPktFormat(int setting) {
 }
 
 void setLengthConfig(int setting) {
-  CC1.setLengthConfig(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetLengthConfig(*image, setting);
+  } else {
+    CC1.setLengthConfig(setting);
+  }
   Serial.print(F("\r\nPkt length mode: "));
   if (setting == 0) {
     Serial.print(F("Fixed"));
@@ -684,14 +1228,24 @@ void setLengthConfig(int setting) {
 }
 
 void setPacketLength(int setting) {
-  CC1.setPacketLength(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetPacketLength(*image, setting);
+  } else {
+    CC1.setPacketLength(setting);
+  }
   Serial.print(F("\r\nPkt length: "));
   Serial.print(setting);
   Serial.print(F(" bytes\r\n"));
 }
 
 void setCrc(int setting) {
-  CC1.setCrc(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetCrc(*image, setting);
+  } else {
+    CC1.setCrc(setting);
+  }
   Serial.print(F("\r\nCRC checking: "));
   if (setting == 0) {
     Serial.print(F("Disabled"));
@@ -702,7 +1256,12 @@ void setCrc(int setting) {
 }
 
 void setCrcAf(int setting) {
-  CC1.setCRC_AF(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetCRC_AF(*image, setting);
+  } else {
+    CC1.setCRC_AF(setting);
+  }
   Serial.print(F("\r\nCRC Autoflush: "));
   if (setting == 0) {
     Serial.print(F("Disabled"));
@@ -713,7 +1272,12 @@ void setCrcAf(int setting) {
 }
 
 void setDcFilterOff(int setting) {
-  CC1.setDcFilterOff(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetDcFilterOff(*image, setting);
+  } else {
+    CC1.setDcFilterOff(setting);
+  }
   Serial.print(F("\r\nDC filter: "));
   if (setting == 0) {
     Serial.print(F("Enabled"));
@@ -724,7 +1288,12 @@ void setDcFilterOff(int setting) {
 }
 
 void setManchester(int setting) {
-  CC1.setManchester(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetManchester(*image, setting);
+  } else {
+    CC1.setManchester(setting);
+  }
   Serial.print(F("\r\nManchester coding: "));
   if (setting == 0) {
     Serial.print(F("Disabled"));
@@ -735,7 +1304,12 @@ void setManchester(int setting) {
 }
 
 void setFec(int setting) {
-  CC1.setFEC(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetFEC(*image, setting);
+  } else {
+    CC1.setFEC(setting);
+  }
   Serial.print(F("\r\nForward Error Correction: "));
   if (setting == 0) {
     Serial.print(F("Disabled"));
@@ -746,21 +1320,36 @@ void setFec(int setting) {
 }
 
 void setPre(int setting) {
-  CC1.setPRE(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetPRE(*image, setting);
+  } else {
+    CC1.setPRE(setting);
+  }
   Serial.print(F("\r\nMinimum preamble bytes:"));
   Serial.print(setting);
   Serial.print(F(" means 0 = 2 bytes, 1 = 3b, 2 = 4b, 3 = 6b, 4 = 8b, 5 = 12b, 6 = 16b, 7 = 24 bytes\r\n"));
 }
 
 void setPqt(int setting) {
-  CC1.setPQT(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetPQT(*image, setting);
+  } else {
+    CC1.setPQT(setting);
+  }
   Serial.print(F("\r\nPQT: "));
   Serial.print(setting);
   Serial.print(F("\r\n"));
 }
 
 void setAppendStatus(int setting) {
-  CC1.setAppendStatus(setting);
+  RadioLock lock;
+  if (RadioProfile *image = cc1Staged()) {
+    profileSetAppendStatus(*image, setting);
+  } else {
+    CC1.setAppendStatus(setting);
+  }
   Serial.print(F("\r\nStatus bytes appending: "));
   if (setting == 0) {
     Serial.print(F("Enabled"));
@@ -771,6 +1360,7 @@ void setAppendStatus(int setting) {
 }
 
 void getRssi() {
+  RadioLock lock;
   Serial.print(F("Rssi: "));
   Serial.println(CC1.getRssi());
   Serial.print(F(" LQI: "));
@@ -781,15 +1371,21 @@ void getRssi() {
 
 
 
-void scan(float settingf1, float settingf2) {
-  SignalInfo foundSignals[MAX_SIGNALS];
-  int signalCount = 0;
+// Scan state, shared by the "scan" command and the menu. scanTick() runs in the UI task.
+SignalInfo scansignals[MAX_SIGNALS];
+int scancount;
+float scanfrom;
+float scanto;
+float scanfreq;
+unsigned long scandrawtime;
 
+// Sets up CC1 and the screen, the UI task then steps through the range until SELECT
+void scan(float settingf1, float settingf2) {
   Serial.print(F("\r\nScanning frequency range from : "));
   Serial.print(settingf1);
   Serial.print(F(" MHz to "));
   Serial.print(settingf2);
-  Serial.print(F(" MHz, press any key to stop...\r\n"));
+  Serial.print(F(" MHz, press SELECT or send x to stop...\r\n"));
 
   // Initialize display
   display.clearDisplay();
@@ -802,99 +1398,114 @@ void scan(float settingf1, float settingf2) {
   display.print(" MHz to ");
   display.print(settingf2);
   display.print(" MHz");
-  display.display();
+  showDisplay();
 
   // Initialize CC1 for scanning
-  CC1.Init();
-  CC1.setRxBW(58);
-  CC1.SetRx();
+  {
+    RadioLock lock;
+    CC1.Init();
+    CC1.setRxBW(58);
+    CC1.SetRx();
+  }
 
-  float freq = settingf1;
-  unsigned long displayUpdateTime = 0;
+  scancount = 0;
+  scanfrom = settingf1;
+  scanto = settingf2;
+  scanfreq = settingf1;
+  scandrawtime = 0;
+  postAppEvent(STATE_CC_SCAN);
+}
+
+// One frequency step of the scan
+void scanTick() {
   const unsigned long DISPLAY_HOLD_TIME = 3000;  // 5 seconds to hold signal info
+  float freq = scanfreq;
+  float rssi;
+  {
+    RadioLock lock;
+    radio1.setMHZ(freq);
+    rssi = CC1.getRssi();
+  }
+  if (serialproto == PROTO_BIN) {
+    sendSweepFrame(freq, rssi);
+  }
 
-  while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-    CC1.setMHZ(freq);
-    float rssi = CC1.getRssi();
-
-    // Update display with current scanning frequency
-    display.clearDisplay();
-    display.setCursor(0, 0);
-    display.print("Scanning: ");
-    display.print(freq, 2);  // Print with 2 decimal places
-    display.print(" MHz");
-
-    // Check for strong signals
-    if (rssi > -75) {
-      // Check if this signal is already in our list
-      bool signalExists = false;
-      for (int i = 0; i < signalCount; i++) {
-        if (abs(foundSignals[i].frequency - freq) < 0.05) {
-          signalExists = true;
-          foundSignals[i].rssi = rssi;
-          foundSignals[i].timestamp = millis();
-          break;
-        }
-      }
+  // Update display with current scanning frequency
+  display.clearDisplay();
+  display.setCursor(0, 0);
+  display.print("Scanning: ");
+  display.print(freq, 2);  // Print with 2 decimal places
+  display.print(" MHz");
 
-      // If signal is new and we have space, add it
-      if (!signalExists && signalCount < MAX_SIGNALS) {
-        foundSignals[signalCount].frequency = freq;
-        foundSignals[signalCount].rssi = rssi;
-        foundSignals[signalCount].timestamp = millis();
-        signalCount++;
+  // Check for strong signals
+  if (rssi > -75) {
+    // Check if this signal is already in our list
+    bool signalExists = false;
+    for (int i = 0; i < scancount; i++) {
+      if (abs(scansignals[i].frequency - freq) < 0.05) {
+        signalExists = true;
+        scansignals[i].rssi = rssi;
+        scansignals[i].timestamp = millis();
+        break;
       }
+    }
+
+    // If signal is new and we have space, add it
+    if (!signalExists && scancount < MAX_SIGNALS) {
+      scansignals[scancount].frequency = freq;
+      scansignals[scancount].rssi = rssi;
+      scansignals[scancount].timestamp = millis();
+      scancount++;
+    }
 
-      // Print signal immediately
+    // Print signal immediately
+    if (serialproto == PROTO_TEXT) {
       Serial.print(F("\r\nSignal detected at "));
       Serial.print(F("Freq: "));
       Serial.print(freq, 2);
       Serial.print(F(" Rssi: "));
       Serial.println(rssi);
     }
+  }
 
-    // Periodically update display with found signals
-    if (millis() - displayUpdateTime > 500) {  // Update display every 500ms
-      // Remove old signals
-      unsigned long currentTime = millis();
-      for (int i = 0; i < signalCount; i++) {
-        if (currentTime - foundSignals[i].timestamp > DISPLAY_HOLD_TIME) {
-          // Remove this signal by shifting the array
-          for (int j = i; j < signalCount - 1; j++) {
-            foundSignals[j] = foundSignals[j + 1];
-          }
-          signalCount--;
-          i--;
+  // Periodically update display with found signals
+  if (millis() - scandrawtime > 500) {  // Update display every 500ms
+    // Remove old signals
+    unsigned long currentTime = millis();
+    for (int i = 0; i < scancount; i++) {
+      if (currentTime - scansignals[i].timestamp > DISPLAY_HOLD_TIME) {
+        // Remove this signal by shifting the array
+        for (int j = i; j < scancount - 1; j++) {
+          scansignals[j] = scansignals[j + 1];
         }
+        scancount--;
+        i--;
       }
+    }
 
-      // Display found signals
-      if (signalCount > 0) {
-        display.setCursor(0, 10);
-        display.print("Signals:");
-        for (int i = 0; i < signalCount; i++) {
-          display.setCursor(0, 20 + (i * 10));
-          display.print(foundSignals[i].frequency, 2);
-          display.print(" MHz ");
-          display.print(foundSignals[i].rssi, 1);
-          display.print(" dBm");
-        }
+    // Display found signals
+    if (scancount > 0) {
+      display.setCursor(0, 10);
+      display.print("Signals:");
+      for (int i = 0; i < scancount; i++) {
+        display.setCursor(0, 20 + (i * 10));
+        display.print(scansignals[i].frequency, 2);
+        display.print(" MHz ");
+        display.print(scansignals[i].rssi, 1);
+        display.print(" dBm");
       }
-
-      display.display();
-      displayUpdateTime = millis();
     }
 
-    // Increment frequency
-    freq += 0.05;  // Slightly larger increment for faster scanning
+    showDisplay();
+    scandrawtime = millis();
+  }
 
-    // Reset scan if exceeded range
-    if (freq > settingf2) {
-      freq = settingf1;
-    }
+  // Increment frequency
+  scanfreq += 0.05;  // Slightly larger increment for faster scanning
 
-    // Small delay to prevent overwhelming the system
-    delay(10);
+  // Reset scan if exceeded range
+  if (scanfreq > scanto) {
+    scanfreq = scanfrom;
   }
 }
 
@@ -922,28 +1533,345 @@ void load() {
   Serial.print(F("\r\nLoading complete. Enter 'show' or 'showraw' to see the buffer content.\r\n\r\n"));
 }
 
+// Reads the list of profile names for a radio, returns number of used slots
+static int readProfileIndex(int radio, char names[MAX_PROFILES][PROFILE_NAME_LEN + 1]) {
+  char key[4];
+  snprintf(key, sizeof(key), "i%d", radio + 1);
+  memset(names, 0, MAX_PROFILES * (PROFILE_NAME_LEN + 1));
+  profilestore.getBytes(key, names, MAX_PROFILES * (PROFILE_NAME_LEN + 1));
+  int count = 0;
+  for (int i = 0; i < MAX_PROFILES; i++) {
+    if (names[i][0] != '\0') count++;
+  }
+  return count;
+}
+
+static void writeProfileIndex(int radio, char names[MAX_PROFILES][PROFILE_NAME_LEN + 1]) {
+  char key[4];
+  snprintf(key, sizeof(key), "i%d", radio + 1);
+  profilestore.putBytes(key, names, MAX_PROFILES * (PROFILE_NAME_LEN + 1));
+}
+
+static bool checkProfileArgs(int radio, const char *name) {
+  if ((radio < 0) || (radio >= NUM_RADIOS) || (name == NULL) || (strlen(name) == 0) || (strlen(name) > PROFILE_NAME_LEN)) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return false;
+  }
+  return true;
+}
+
+// Remember which profile to restore at next boot
+static void setBootProfile(int radio, const char *name) {
+  char key[4];
+  snprintf(key, sizeof(key), "b%d", radio + 1);
+  profilestore.putString(key, name);
+}
+
+void saveProfile(int radio, const char *name) {
+  RadioLock lock;
+  if (!checkProfileArgs(radio, name)) return;
+
+  char names[MAX_PROFILES][PROFILE_NAME_LEN + 1];
+  readProfileIndex(radio, names);
+  int slot = -1;
+  for (int i = 0; i < MAX_PROFILES; i++) {
+    if (strcmp(names[i], name) == 0) {
+      slot = i;  // overwrite existing
+      break;
+    }
+    if ((slot < 0) && (names[i][0] == '\0')) slot = i;
+  }
+  if (slot < 0) {
+    Serial.print(F("\r\nNo free profile slot, delete one first.\r\n"));
+    return;
+  }
+
+  RadioProfile profile;
+  profileCapture(*radios[radio], profile);
+
+  char key[16];
+  snprintf(key, sizeof(key), "p%d.%s", radio + 1, name);
+  if (profilestore.putBytes(key, &profile, sizeof(profile)) != sizeof(profile)) {
+    Serial.print(F("\r\nProfile could not be written to flash.\r\n"));
+    return;
+  }
+  strncpy(names[slot], name, PROFILE_NAME_LEN);
+  names[slot][PROFILE_NAME_LEN] = '\0';
+  writeProfileIndex(radio, names);
+  setBootProfile(radio, name);
+
+  Serial.print(F("\r\nProfile '"));
+  Serial.print(name);
+  Serial.print(F("' saved for "));
+  Serial.print(radios[radio]->name);
+  Serial.print(F(": "));
+  Serial.print(profileMhz(profile), 3);
+  Serial.print(F(" MHz\r\n"));
+}
+
+// Loads and applies a profile from flash, returns time taken in us or -1 on error
+static long applyStoredProfile(int radio, const char *name) {
+  char key[16];
+  RadioProfile profile;
+  snprintf(key, sizeof(key), "p%d.%s", radio + 1, name);
+  if (profilestore.getBytes(key, &profile, sizeof(profile)) != sizeof(profile)) {
+    return -1;
+  }
+  unsigned long start = micros();
+  if (!profileApply(*radios[radio], profile)) {
+    return -1;
+  }
+  return micros() - start;
+}
+
+void loadProfile(int radio, const char *name) {
+  RadioLock lock;
+  if (!checkProfileArgs(radio, name)) return;
+
+  long took = applyStoredProfile(radio, name);
+  if (took < 0) {
+    Serial.print(F("\r\nProfile not found, corrupt or radio did not accept it.\r\n"));
+    return;
+  }
+  setBootProfile(radio, name);
+  Serial.print(F("\r\nProfile '"));
+  Serial.print(name);
+  Serial.print(F("' loaded into "));
+  Serial.print(radios[radio]->name);
+  Serial.print(F(" in "));
+  Serial.print(took);
+  Serial.print(F(" us\r\n"));
+}
+
+void listProfiles(int radio) {
+  if ((radio < 0) || (radio >= NUM_RADIOS)) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return;
+  }
+  char names[MAX_PROFILES][PROFILE_NAME_LEN + 1];
+  char bootname[PROFILE_NAME_LEN + 1] = "";
+  char key[16];
+  int count = readProfileIndex(radio, names);
+  snprintf(key, sizeof(key), "b%d", radio + 1);
+  profilestore.getString(key, bootname, sizeof(bootname));
+
+  Serial.print(F("\r\nProfiles for "));
+  Serial.print(radios[radio]->name);
+  Serial.print(F(": "));
+  Serial.print(count);
+  Serial.print(F("\r\n"));
+  for (int i = 0; i < MAX_PROFILES; i++) {
+    if (names[i][0] == '\0') continue;
+    RadioProfile profile;
+    snprintf(key, sizeof(key), "p%d.%s", radio + 1, names[i]);
+    bool ok = (profilestore.getBytes(key, &profile, sizeof(profile)) == sizeof(profile)) && profileIsValid(profile);
+    Serial.print(strcmp(names[i], bootname) == 0 ? F(" * ") : F("   "));
+    Serial.print(names[i]);
+    if (ok) {
+      Serial.print(F("  "));
+      Serial.print(profileMhz(profile), 3);
+      Serial.print(F(" MHz, mod "));
+      Serial.print(profileModulation(profile));
+      Serial.print(F(", rxbw "));
+      Serial.print(profileRxBw(profile));
+      Serial.print(F(" kHz, pa "));
+      Serial.print(profilePa(profile));
+    } else {
+      Serial.print(F("  (corrupt)"));
+    }
+    Serial.print(F("\r\n"));
+  }
+}
+
+void deleteProfile(int radio, const char *name) {
+  if (!checkProfileArgs(radio, name)) return;
+
+  char names[MAX_PROFILES][PROFILE_NAME_LEN + 1];
+  char bootname[PROFILE_NAME_LEN + 1] = "";
+  char key[16];
+  readProfileIndex(radio, names);
+  for (int i = 0; i < MAX_PROFILES; i++) {
+    if (strcmp(names[i], name) == 0) {
+      names[i][0] = '\0';
+      writeProfileIndex(radio, names);
+      snprintf(key, sizeof(key), "p%d.%s", radio + 1, name);
+      profilestore.remove(key);
+      // Deleting the boot profile means defaults at next boot
+      snprintf(key, sizeof(key), "b%d", radio + 1);
+      profilestore.getString(key, bootname, sizeof(bootname));
+      if (strcmp(bootname, name) == 0) profilestore.remove(key);
+      Serial.print(F("\r\nProfile deleted.\r\n"));
+      return;
+    }
+  }
+  Serial.print(F("\r\nProfile not found.\r\n"));
+}
+
+// Called from cc1101initialize(): reset the chip and restore the boot profile, if any.
+// Returns false (and the caller falls back to the default setters) when there is none
+// or it does not validate.
+bool restoreBootProfile(int radio) {
+  char key[4];
+  char name[PROFILE_NAME_LEN + 1] = "";
+  snprintf(key, sizeof(key), "b%d", radio + 1);
+  if (profilestore.getString(key, name, sizeof(name)) == 0 || name[0] == '\0') {
+    return false;
+  }
+  radios[radio]->SpiStrobe(CC1101_SRES);
+  long took = applyStoredProfile(radio, name);
+  if (took < 0) {
+    Serial.print(F("Boot profile '"));
+    Serial.print(name);
+    Serial.print(F("' failed to restore, using defaults\r\n"));
+    return false;
+  }
+  Serial.print(radios[radio]->name);
+  Serial.print(F(" restored profile '"));
+  Serial.print(name);
+  Serial.print(F("' in "));
+  Serial.print(took);
+  Serial.print(F(" us\r\n"));
+  return true;
+}
+
 void toggleRxMode() {
+  if (wormode == 1) {
+    worStop();  // WOR is receive mode as well, so "rx" switches it off
+    return;
+  }
   Serial.print(F("\r\nReceiving and printing RF packet changed to "));
   if (receivingmode == 1) {
     receivingmode = 0;
     Serial.print(F("Disabled"));
   } else if (receivingmode == 0) {
-    CC1.SetRx();
+    {
+      RadioLock lock;
+      CC1.SetRx();
+    }
     Serial.print(F("Enabled"));
     receivingmode = 1;
     jammingmode = 0;
     recordingmode = 0;
+    diversitymode = 0;
+    dualrxmode = 0;
   }
   Serial.print(F("\r\n"));
+  // tell a binary host which settings the packets will come with
+  if (receivingmode == 1 && serialproto == PROTO_BIN) {
+    sendMetaFrame(0);
+  }
 }
 
 void toggleChatMode() {
-  Serial.print(F("\r\nEntering chat mode:\r\n\r\n"));
+  if (wormode == 1) {
+    worStop();  // CC1 gets its configuration back before chat takes it
+  }
+  Serial.print(F("\r\nEntering chat mode, /quit to leave:\r\n\r\n"));
   if (chatmode == 0) {
+    chatlinelen = 0;
     chatmode = 1;
     jammingmode = 0;
     receivingmode = 0;
     recordingmode = 0;
+    diversitymode = 0;
+    dualrxmode = 0;
+  }
+}
+
+// Function to handle DIVERSITY command
+void toggleDiversityMode() {
+  if (wormode == 1) {
+    worStop();  // CC1 gets its configuration back before CC2 copies it
+  }
+  Serial.print(F("\r\nDiversity receive changed to "));
+  if (diversitymode == 1) {
+    diversitymode = 0;
+    Serial.print(F("Disabled\r\n"));
+    printDiversityStats();
+    return;
+  }
+
+  {
+    RadioLock lock;
+    // CC2 listens with exactly the settings of CC1, only the antenna differs
+    RadioProfile profile;
+    profileCapture(*radios[0], profile);
+    if (!profileApply(*radios[1], profile)) {
+      Serial.print(F("Failed, CC2 did not take the settings of CC1\r\n"));
+      return;
+    }
+    diversityReset(diversitywindow);
+    rxtaghz[0] = rxtaghz[1] = profileChannelHz(profile);
+    rxtagchannel[0] = rxtagchannel[1] = profile.regs[CC1101_CHANNR];
+    CC1.SetRx();
+    CC2.SetRx();
+    diversitymode = 1;
+    dualrxmode = 0;
+    receivingmode = 0;
+    jammingmode = 0;
+    recordingmode = 0;
+  }
+  Serial.print(F("Enabled\r\n"));
+  if (serialproto == PROTO_BIN) {
+    sendMetaFrame(0);
+    sendMetaFrame(1);
+  }
+}
+
+// Function to handle DUALRX command: dualrx [<CC1 profile> <CC2 profile>]
+// Both radios receive at once, each on its own settings (frequency, channel,
+// modulation, ...), optionally loaded from two saved profiles first.
+void dualRxCommand(int argc, char **argv) {
+  if (wormode == 1) {
+    worStop();  // CC1 gets its configuration back before the profiles are applied
+  }
+  if (argc == 0 && dualrxmode == 1) {
+    dualrxmode = 0;
+    Serial.print(F("\r\nDual receive changed to Disabled\r\n"));
+    return;
+  }
+  if (argc != 0 && argc != 2) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return;
+  }
+
+  {
+    RadioLock lock;
+    for (int r = 0; r < argc; r++) {
+      if (!checkProfileArgs(r, argv[r])) return;
+      if (applyStoredProfile(r, argv[r]) < 0) {
+        Serial.print(F("\r\nProfile not found, corrupt or radio did not accept it: "));
+        Serial.print(argv[r]);
+        Serial.print(F("\r\n"));
+        return;
+      }
+    }
+    for (int r = 0; r < NUM_RADIOS; r++) {
+      RadioProfile profile;
+      profileCapture(*radios[r], profile);
+      rxtaghz[r] = profileChannelHz(profile);
+      rxtagchannel[r] = profile.regs[CC1101_CHANNR];
+      Serial.print(F("\r\n"));
+      Serial.print(radios[r]->name);
+      Serial.print(F(": "));
+      Serial.print(rxtaghz[r] / 1000000.0f, 3);
+      Serial.print(F(" MHz, channel "));
+      Serial.print(rxtagchannel[r]);
+      Serial.print(F(", mod "));
+      Serial.print(profileModulation(profile));
+    }
+    CC1.SetRx();
+    CC2.SetRx();
+    dualrxmode = 1;
+    diversitymode = 0;
+    receivingmode = 0;
+    jammingmode = 0;
+    recordingmode = 0;
+  }
+  Serial.print(F("\r\nDual receive changed to Enabled\r\n"));
+  if (serialproto == PROTO_BIN) {
+    sendMetaFrame(0);
+    sendMetaFrame(1);
   }
 }
 
@@ -1005,131 +1933,230 @@ void bruteForce(int setting, int setting2) {
     Serial.print(F("Wrong parameters.\r\n"));
   };
 }
-/*
 // Function to handle TX command
 void transmitData(const char *hexData) {
-  if ((strlen(hexData) <= 120) && (strlen(hexData) > 0)) {
-    hextoascii(textbuffer, (byte *)hexData, strlen(hexData));
-    memcpy(ccsendingbuffer, textbuffer, strlen(hexData) / 2);
-    ccsendingbuffer[strlen(hexData) / 2] = 0x00;
-    Serial.print("\r\nTransmitting RF packets.\r\n");
-
-    // Send these data to radio over CC1101
-        CC1.SendData(ccsendingbuffer, (byte)(strlen(hexData) / 2);
-
-        // For DEBUG only
-        asciitohex(ccsendingbuffer, textbuffer, strlen(hexData) / 2);
-        Serial.print(F("Sent frame: "));
-        Serial.print((char*)textbuffer);
-        Serial.print(F("\r\n"));
+  RadioCommand cmd;
+  int len = strlen(hexData);
+
+  // Convert the hex content to array of bytes, 0 if it is not valid hex
+  len = (len <= 120) ? hexDecode(hexData, len, cmd.data, sizeof(cmd.data)) : 0;
+  if (len > 0) {
+    Serial.print(F("\r\nTransmitting RF packets.\r\n"));
+
+    // Hand the data to the CC1101 #1 task, it sends them between two RX checks
+    cmd.type = RADIO_CMD_SEND;
+    cmd.len = len;
+    if (!sendRadioCommand(0, cmd)) {
+      Serial.print(F("Radio busy, frame dropped\r\n"));
+      return;
+    }
+    Serial.print(F("Sent frame: "));
+    Serial.print(hexData);
+    Serial.print(F("\r\n"));
   } else {
     Serial.print(F("Wrong parameters.\r\n"));
   }
 }
-*/
-// Function to handle RECRAW command
-void recordRawData(int interval) {
-  if (interval > 0) {
+// Puts CC1 into asynchronous serial mode for recording (RX) or replay (TX) on GDO0 and
+// sets up rawjob. False if a receive mode uses CC1 or the CLI and the menu both want
+// the job, which is claimed under the radio lock.
+bool rawBegin(RawMode mode, int interval) {
+  bool play = mode == RAW_PLAY;
+  {
+    RadioLock lock;
+    if (rawjob.active) {
+      Serial.print(F("\r\nRAW recording or replay already running.\r\n"));
+      return false;
+    }
+    if (radioListening(0)) {
+      Serial.print(F("\r\nCC1 is receiving, stop it first (x).\r\n"));
+      updateDisplay("CC1 is receiving");
+      return false;
+    }
+    rawjob.active = true;
+    rawjob.mode = mode;
     CC1.setCCMode(0);
     CC1.setPktFormat(3);
-    CC1.SetRx();
+    if (play) {
+      CC1.SetTx();
+    } else {
+      CC1.SetRx();
+    }
+  }
+  pinMode(gdo0_1, play ? OUTPUT : INPUT);
+  rawjob.waiting = mode == RAW_RECORD;
+  rawjob.since = millis();
+  rawjob.interval = interval;
+  rawjob.pos = play ? 1 : 0;  // replay has always skipped the first byte
+  rawjob.next = micros();
+  if (play) {
+    Serial.println(F("Replaying RAW data..."));
+    updateDisplay("Replaying RAW data...");
+  } else if (mode == RAW_SNIFF) {
+    rawinterval = interval;
+    Serial.println(F("Sniffer enabled..."));
+    updateDisplay("Sniffer enabled...");
+  } else {
+    rawinterval = interval;
     Serial.println(F("Waiting for radio signal to start RAW recording..."));
     updateDisplay("Waiting for signal...");
+  }
+  return true;
+}
 
-    pinMode(gdo0_1, INPUT);
-    while (digitalRead(gdo0_1) == LOW)
-      ;
-
+// One slice of the raw job: the wait for a signal (at most RAW_WAIT_SLICE_MS), then up
+// to bytes of samples. Only GDO0 is touched, the radio lock is not needed. Returns false
+// once the buffer is done or the wait gave up, the sniffer starts over at the front.
+bool rawStep(int bytes) {
+  radiopower[0].usedat = millis();  // keeps power save from putting CC1 into SPWD
+  if (rawjob.waiting) {
+    uint32_t start = millis();
+    while (!Gdo0Pin1::read()) {
+      if (millis() - start >= RAW_WAIT_SLICE_MS) {
+        return millis() - rawjob.since < RAW_WAIT_MAX_MS;
+      }
+    }
+    rawjob.waiting = false;
+    rawjob.next = micros();
     Serial.println(F("Starting RAW recording..."));
     updateDisplay("Recording RAW data...");
+  }
 
-    for (int i = 0; i < RECORDINGBUFFERSIZE; i++) {
+  int end = min(rawjob.pos + bytes, RECORDINGBUFFERSIZE);
+  uint32_t next = rawjob.next;
+  for (int i = rawjob.pos; i < end; i++) {
+    if (rawjob.mode == RAW_PLAY) {
+      byte sendbyte = bigrecordingbuffer[i];
+      for (int j = 7; j > -1; j--) {
+        Gdo0Pin1::write(bitRead(sendbyte, j));
+        next += rawjob.interval;
+        while ((int32_t)(micros() - next) < 0)
+          ;
+      }
+    } else {
       byte receivedbyte = 0;
       for (int j = 7; j > -1; j--) {
-        bitWrite(receivedbyte, j, digitalRead(gdo0_1));
-        delayMicroseconds(interval);
+        bitWrite(receivedbyte, j, Gdo0Pin1::read());
+        next += rawjob.interval;
+        while ((int32_t)(micros() - next) < 0)
+          ;
       }
       bigrecordingbuffer[i] = receivedbyte;
     }
-
-    Serial.println(F("Recording complete."));
-    updateDisplay("Recording complete.");
-  } else {
-    Serial.println(F("Wrong parameters."));
-    updateDisplay("Wrong parameters.");
   }
+  rawjob.next = next;
+  rawjob.pos = end;
+  if (rawjob.mode == RAW_SNIFF && end == RECORDINGBUFFERSIZE) {
+    rawjob.pos = 0;
+  }
+  return rawjob.mode == RAW_SNIFF || end < RECORDINGBUFFERSIZE;
 }
 
-void sniffRawData(int interval) {
-  if (interval > 0) {
-    CC1.setCCMode(0);
-    CC1.setPktFormat(3);
-    CC1.SetRx();
-    Serial.println(F("Sniffer enabled..."));
-    updateDisplay("Sniffer enabled...");
-
-    pinMode(gdo0_1, INPUT);
-    while (!Serial.available()) {
-      for (int i = 0; i < RECORDINGBUFFERSIZE; i++) {
-        byte receivedbyte = 0;
-        for (int j = 7; j > -1; j--) {
-          bitWrite(receivedbyte, j, digitalRead(gdo0_1));
-          delayMicroseconds(interval);
-        }
-        bigrecordingbuffer[i] = receivedbyte;
-      }
-    }
+// Reports how the raw job ended
+void rawEnd() {
+  rawjob.active = false;
+  if (rawjob.waiting) {
+    Serial.println(F("No signal, recording stopped."));
+    updateDisplay("No signal.");
+  } else if (rawjob.mode == RAW_SNIFF) {
     Serial.println(F("Stopping the sniffer."));
     updateDisplay("Sniffer stopped.");
+  } else if (rawjob.mode == RAW_PLAY) {
+    Serial.println(F("Replaying complete."));
+    updateDisplay("Replay complete.");
   } else {
-    Serial.println(F("Wrong parameters."));
-    updateDisplay("Wrong parameters.");
+    Serial.println(F("Recording complete."));
+    updateDisplay("Recording complete.");
   }
 }
 
-void playRawData(int interval) {
-  if (interval > 0) {
-    CC1.setCCMode(0);
-    CC1.setPktFormat(3);
-    CC1.SetTx();
-    Serial.println(F("Replaying RAW data..."));
-    updateDisplay("Replaying RAW data...");
+// Function to handle RECRAW command
+void recordRawData(int interval) {
+  if (interval <= 0) {
+    Serial.println(F("Wrong parameters."));
+    updateDisplay("Wrong parameters.");
+    return;
+  }
+  if (rawBegin(RAW_RECORD, interval)) {
+    while (rawStep(RECORDINGBUFFERSIZE))
+      ;
+    rawEnd();
+  }
+}
 
-    pinMode(gdo0_1, OUTPUT);
-    for (int i = 1; i < RECORDINGBUFFERSIZE; i++) {
-      byte receivedbyte = bigrecordingbuffer[i];
-      for (int j = 7; j > -1; j--) {
-        digitalWrite(gdo0_1, bitRead(receivedbyte, j));
-        delayMicroseconds(interval);
-      }
+// Function to handle SNIFFRAW command
+void sniffRawData(int interval) {
+  if (interval <= 0) {
+    Serial.println(F("Wrong parameters."));
+    updateDisplay("Wrong parameters.");
+    return;
+  }
+  if (rawBegin(RAW_SNIFF, interval)) {
+    // The CLI task is above the UI task, a tick's sleep lets it run. The samples
+    // start on a fresh deadline after it rather than catching up on the gap.
+    while (!Serial.available() && rawStep(RAW_SLICE_BYTES)) {
+      vTaskDelay(1);
+      rawjob.next = micros();
     }
+    rawEnd();
+  }
+}
 
-    Serial.println(F("Replaying complete."));
-    updateDisplay("Replay complete.");
-  } else {
+void playRawData(int interval) {
+  if (interval <= 0) {
     Serial.println(F("Wrong parameters."));
     updateDisplay("Wrong parameters.");
+    return;
+  }
+  if (rawBegin(RAW_PLAY, interval)) {
+    while (rawStep(RECORDINGBUFFERSIZE))
+      ;
+    rawEnd();
   }
 }
-// Function to handle SHOWRAW command
-void showRawData() {
-  Serial.print(F("\r\nRecorded RAW data:\r\n"));
+
+// The first rows of the raw capture in hex on screen
+void showRawScreen() {
   display.clearDisplay();
   display.setTextSize(1);
   display.setTextColor(SSD1306_WHITE);
   display.setCursor(0, 0);
   display.print(F("RAW Data:"));
-  int y = 10;
-  for (int i = 0; i < RECORDINGBUFFERSIZE; i = i + 32) {
-    asciitohex(&bigrecordingbuffer[i], textbuffer, 32);
-    Serial.print((char *)textbuffer);
+  char line[2 * 32 + 1];
+  for (int i = 0, y = 10; y <= 50; i += 32, y += 10) {  // Prevent overflow on screen
+    hexEncode(&bigrecordingbuffer[i], 32, line, sizeof(line));
     display.setCursor(0, y);
-    display.print((char *)textbuffer);
-    y += 10;
-    if (y > 50) break;  // Prevent overflow on screen
+    display.print(line);
+  }
+  showDisplay();
+}
+
+// Sends the raw capture from offset on to serial, one hex line of 32 bytes or one
+// capture frame. Returns the number of bytes sent.
+int sendRawRow(int offset) {
+  if (serialproto == PROTO_BIN) {
+    return sendCaptureFrame(offset);
+  }
+  char line[2 * 32 + 3];
+  size_t n = hexEncode(&bigrecordingbuffer[offset], 32, line, sizeof(line));
+  line[n] = '\r';
+  line[n + 1] = '\n';
+  Serial.write((const uint8_t *)line, n + 2);
+  return 32;
+}
+
+// Function to handle SHOWRAW command
+void showRawData() {
+  if (serialproto == PROTO_TEXT) {
+    Serial.print(F("\r\nRecorded RAW data:\r\n"));
+  }
+  for (int i = 0; i < RECORDINGBUFFERSIZE;) {
+    i += sendRawRow(i);
+  }
+  showRawScreen();
+  if (serialproto == PROTO_TEXT) {
+    Serial.print(F("\r\n\r\n"));
   }
-  display.display();
-  Serial.print(F("\r\n\r\n"));
 }
 
 // Shows recorded data in bits
@@ -1140,48 +2167,35 @@ void showBitData() {
   display.setTextColor(SSD1306_WHITE);
   display.setCursor(0, 0);
   display.print(F("Bit Stream:"));
+  TextOut out;
+  textBegin(out, Serial);
+  char strip[8 * 8 + 1];
   int y = 10;
   for (int i = 0; i < RECORDINGBUFFERSIZE; i = i + 32) {
-    asciitohex((byte *)&bigrecordingbuffer[i], (byte *)textbuffer, 32);
-    String bitStream = "";
-    for (int setting = 0; setting < 64; setting++) {
-      char setting2 = textbuffer[setting];
-      switch (setting2) {
-        case '0': bitStream += "____"; break;
-        case '1': bitStream += "___-"; break;
-        case '2': bitStream += "__-_"; break;
-        case '3': bitStream += "__--"; break;
-        case '4': bitStream += "_-__"; break;
-        case '5': bitStream += "_-_-"; break;
-        case '6': bitStream += "_--_"; break;
-        case '7': bitStream += "_---"; break;
-        case '8': bitStream += "-___"; break;
-        case '9': bitStream += "-__-"; break;
-        case 'A': bitStream += "-_-_"; break;
-        case 'B': bitStream += "-_--"; break;
-        case 'C': bitStream += "--__"; break;
-        case 'D': bitStream += "--_-"; break;
-        case 'E': bitStream += "---_"; break;
-        case 'F': bitStream += "----"; break;
+    // 32 bytes per row, rendered 8 at a time
+    for (int j = 0; j < 32; j += 8) {
+      size_t n = bitStrip(&bigrecordingbuffer[i + j], 8, strip, sizeof(strip));
+      textWrite(out, strip, n);
+      if (j == 0) {
+        strip[21] = '\0';  // Limit to screen width
+        display.setCursor(0, y);
+        display.print(strip);
       }
     }
-    Serial.print(bitStream);
-    display.setCursor(0, y);
-    display.print(bitStream.substring(0, 21));  // Limit to screen width
     y += 10;
     if (y > 50) break;
   }
-  display.display();
+  textFlush(out);
+  showDisplay();
   Serial.print(F("\r\n\r\n"));
 }
 // Function to handle ADDRAW command
 void addRawData(const char *hexData) {
   int len = strlen(hexData);
 
-  if ((len <= 120) && (len > 0)) {
-    // Convert the hex content to array of bytes
-    hextoascii(textbuffer, (byte *)hexData, len);
-    len = len / 2;
+  // Convert the hex content to array of bytes, 0 if it is not valid hex
+  len = (len <= 120) ? hexDecode(hexData, len, textbuffer, sizeof(textbuffer)) : 0;
+  if (len > 0) {
 
     // Check if the frame fits into the buffer and store it
     if ((bigrecordingbufferpos + len) < RECORDINGBUFFERSIZE) {
@@ -1200,6 +2214,10 @@ void addRawData(const char *hexData) {
 
 // Function to handle REC command
 void toggleRecordingMode() {
+  if (wormode == 1) {
+    worStop();  // CC1 gets its configuration back before recording takes it
+  }
+  RadioLock lock;
   Serial.print(F("\r\nRecording mode set to "));
   if (recordingmode == 1) {
     Serial.print(F("Disabled"));
@@ -1216,15 +2234,20 @@ void toggleRecordingMode() {
     recordingmode = 1;
     jammingmode = 0;
     receivingmode = 0;
+    diversitymode = 0;
+    dualrxmode = 0;
     // Start counting frames in the buffer
     framesinbigrecordingbuffer = 0;
   }
   Serial.print(F("\r\n"));
 }
 
-// Function to handle PLAY command
+// Function to handle PLAY command. The frames go through the CC1101 #1 task like "tx",
+// so a dead GDO0 ends in a TX timeout instead of a hang with the radio lock held.
 void playRecordedFrames(int frameNumber) {
   if (frameNumber <= framesinbigrecordingbuffer) {
+    RadioCommand cmd;
+    int dropped = 0;
     Serial.print(F("\r\nReplaying recorded frames.\r\n "));
     // Rewind recording buffer position to the beginning
     bigrecordingbufferpos = 0;
@@ -1236,9 +2259,12 @@ void playRecordedFrames(int frameNumber) {
         int len = bigrecordingbuffer[bigrecordingbufferpos];
         if (((len <= 60) && (len > 0)) && ((i == frameNumber) || (frameNumber == 0))) {
           // Take next frame from the buffer for replay
-          memcpy(ccsendingbuffer, &bigrecordingbuffer[bigrecordingbufferpos + 1], len);
-          // Send these data to radio over CC1101
-          ELECHOUSE_cc1101.SendData(ccsendingbuffer, (byte)len);
+          cmd.type = RADIO_CMD_SEND;
+          cmd.len = len;
+          memcpy(cmd.data, &bigrecordingbuffer[bigrecordingbufferpos + 1], len);
+          if (!sendRadioCommand(0, cmd)) {
+            dropped++;
+          }
         }
         // Increase position to the buffer and check exception
         bigrecordingbufferpos = bigrecordingbufferpos + 1 + len;
@@ -1248,6 +2274,10 @@ void playRecordedFrames(int frameNumber) {
     }
     // Rewind buffer position
     bigrecordingbufferpos = 0;
+    if (dropped > 0) {
+      Serial.print(dropped);
+      Serial.print(F(" frames dropped, radio busy\r\n"));
+    }
     Serial.print(F("Done.\r\n"));
   } else {
     Serial.print(F("Wrong parameters.\r\n"));
@@ -1258,10 +2288,9 @@ void playRecordedFrames(int frameNumber) {
 void addFrame(const char *hexData) {
   int len = strlen(hexData);
 
-  if ((len <= 120) && (len > 0)) {
-    // Convert the hex content to array of bytes
-    hextoascii(textbuffer, (byte *)hexData, len);
-    len = len / 2;
+  // Convert the hex content to array of bytes, 0 if it is not valid hex
+  len = (len <= 120) ? hexDecode(hexData, len, textbuffer, sizeof(textbuffer)) : 0;
+  if (len > 0) {
 
     // Check if the frame fits into the buffer and store it
     if ((bigrecordingbufferpos + len + 1) < RECORDINGBUFFERSIZE) {
@@ -1298,11 +2327,7 @@ void showRecordedFrames() {
       int len = bigrecordingbuffer[bigrecordingbufferpos];
       if ((len <= 60) && (len > 0)) {
         // Take next frame from the buffer for replay
-        // Flush textbuffer
-        for (int setting2 = 0; setting2 < BUF_LENGTH; setting2++) {
-          textbuffer[setting2] = 0;
-        }
-        asciitohex(&bigrecordingbuffer[bigrecordingbufferpos + 1], textbuffer, len);
+        hexEncode(&bigrecordingbuffer[bigrecordingbufferpos + 1], len, (char *)textbuffer, sizeof(textbuffer));
         Serial.print(F("\r\nFrame "));
         Serial.print(setting);
         Serial.print(F(" : "));
@@ -1337,77 +2362,588 @@ void setEchoMode(int mode) {
   do_echo = mode;
 }
 
+// Function to handle FASTBOOT command
+void setFastBoot(int mode) {
+  if (mode != 0 && mode != 1) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return;
+  }
+  fastboot = mode;
+  settingsstore.putBool("fastboot", fastboot);
+  Serial.print(F("\r\nFast boot: "));
+  Serial.print(fastboot ? F("Enabled") : F("Disabled"));
+  Serial.print(F("\r\n"));
+}
+
+// Function to handle SPITIMEOUT command, CC2 only: the stock driver of CC1 has no timeout.
+// Only sets a variable of the driver, there is no SPI traffic to lock.
+void setSpiTimeout(int us) {
+  if (us < 10) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return;
+  }
+  CC2.setReadyTimeout(us);
+  Serial.print(F("\r\nSPI ready timeout: "));
+  Serial.print(us);
+  Serial.print(F(" us\r\n"));
+}
+
 // Function to handle X command
 void stopAllModes() {
+  if (wormode == 1) {
+    worStop();
+  }
   receivingmode = 0;
   jammingmode = 0;
   recordingmode = 0;
+  diversitymode = 0;
+  dualrxmode = 0;
+  if (currentState == STATE_CC_SCAN) {
+    postAppEvent(STATE_MENU);
+  }
   Serial.print(F("\r\n"));
 }
 
 // Function to handle INIT command
 void initializeCC1101() {
-  // Initialize CC1101
-  cc1101initialize();
-  cc1101initialize_2();
+  {
+    RadioLock lock;
+    cc1101initialize();
+    cc1101initialize_2();
+  }
+  showRadioStatus(1000);
+
+  // Give feedback
+  Serial.print(F("CC1101 initialized\r\n"));
+}
+
+// Reports the SPI connection of both radios on serial and the OLED, holding each
+// line on screen for holdms
+void showRadioStatus(uint32_t holdms) {
+  bool ok1, ok2;
+  {
+    RadioLock lock;
+    ok1 = CC1.getCC1101();  // Check the CC1101 Spi connection.
+    ok2 = CC2.getCC1101();
+  }
   display.clearDisplay();
   u8g2_for_adafruit_gfx.setFont(u8g2_font_baby_tf);
 
-  if (CC1.getCC1101()) {  // Check the CC1101 Spi connection.
+  if (ok1) {
     Serial.println(F("cc1101 #1 initialized. Connection OK\n\r"));
     u8g2_for_adafruit_gfx.setCursor(0, 30);
     u8g2_for_adafruit_gfx.print("cc1101 initialized. Connection OK");
-    display.display();
-    nonBlockingDelay(1000);
   } else {
     Serial.println(F("cc1101 #1 connection error! check the wiring.\n\r"));
     u8g2_for_adafruit_gfx.setCursor(0, 30);
     u8g2_for_adafruit_gfx.print("cc1101 connection ERROR!. Connection OK");
     u8g2_for_adafruit_gfx.setCursor(0, 40);
     u8g2_for_adafruit_gfx.print("CHECK WIRING!");
-
-    display.display();
-    nonBlockingDelay(1000);
-  };
-  if (CC2.getCC1101()) {  // Check the CC1101 Spi connection.
+  }
+  showDisplay();
+  nonBlockingDelay(holdms);
+  if (ok2) {
     Serial.println(F("cc1101 #2 initialized. Connection OK\n\r"));
     u8g2_for_adafruit_gfx.setCursor(0, 40);
     u8g2_for_adafruit_gfx.print("cc1101 initialized. Connection OK");
-    display.display();
-    nonBlockingDelay(1000);
   } else {
-    Serial.println(F("cc1101 #1 connection error! check the wiring.\n\r"));
-    u8g2_for_adafruit_gfx.setCursor(0, 40);
+    Serial.println(F("cc1101 #2 connection error! check the wiring.\n\r"));
+    u8g2_for_adafruit_gfx.setCursor(0, 45);
     u8g2_for_adafruit_gfx.print("cc1101 connection ERROR!. Connection OK");
-    u8g2_for_adafruit_gfx.setCursor(0, 50);
+    u8g2_for_adafruit_gfx.setCursor(0, 55);
     u8g2_for_adafruit_gfx.print("CHECK WIRING!");
-    display.display();
-    nonBlockingDelay(1000);
-  };
-
-  // Give feedback
-  Serial.print(F("CC1101 initialized\r\n"));
+  }
+  showDisplay();
+  nonBlockingDelay(holdms);
 }
 
 // ------- END OF CC1101 COMMAND HANDLERS ------------
 
+// ------- BINARY PROTOCOL ------------
+
+// One frame = one Serial.write(), so frames from different tasks never interleave
+void sendFrame(uint8_t type, const uint8_t *payload, size_t len) {
+  uint8_t frame[FRAME_MAX_ENCODED];
+  size_t n = frameEncode(type, __atomic_fetch_add(&frameseq, 1, __ATOMIC_RELAXED), payload, len, frame);
+  if (n) {
+    Serial.write(frame, n);
+  }
+}
+
+void sendPacketFrame(const RxPacket &pkt) {
+  uint8_t payload[7 + RX_PACKET_MAX];
+  payload[0] = pkt.radio;
+  payload[1] = pkt.rssi;
+  payload[2] = pkt.lqi;
+  framePut32(&payload[3], pkt.timestamp);
+  memcpy(&payload[7], pkt.data, pkt.len);
+  sendFrame(MSG_PACKET, payload, 7 + pkt.len);
+}
+
+// Current settings of a radio, decoded from its registers
+void sendMetaFrame(int radio) {
+  RadioProfile profile;
+  uint8_t payload[10];
+  {
+    RadioLock lock;
+    profileCapture(*radios[radio], profile);
+  }
+  payload[0] = radio;
+  framePut32(&payload[1], profileHz(profile));
+  payload[5] = profileModulation(profile);
+  framePut16(&payload[6], (uint16_t)profileRxBw(profile));
+  payload[8] = (int8_t)profilePa(profile);
+  payload[9] = profile.regs[CC1101_CHANNR];
+  sendFrame(MSG_META, payload, sizeof(payload));
+}
+
+void sendSweepFrame(float mhz, int rssi) {
+  uint8_t payload[5];
+  framePut32(payload, (uint32_t)(mhz * 1000.0f + 0.5f));
+  payload[4] = (int8_t)rssi;
+  sendFrame(MSG_SWEEP, payload, sizeof(payload));
+}
+
+// One capture frame of the raw capture buffer from offset on, returns the bytes it holds
+int sendCaptureFrame(int offset) {
+  uint8_t payload[FRAME_MAX_PAYLOAD];
+  int n = min(FRAME_MAX_PAYLOAD - 4, RECORDINGBUFFERSIZE - offset);
+  framePut16(payload, offset);
+  framePut16(&payload[2], RECORDINGBUFFERSIZE);
+  memcpy(&payload[4], &bigrecordingbuffer[offset], n);
+  sendFrame(MSG_CAPTURE, payload, 4 + n);
+  return n;
+}
+
+void setProtocol(int mode) {
+  if (mode == PROTO_BIN) {
+    Serial.print(F("\r\nSerial protocol: binary frames\r\n"));
+    serialproto = PROTO_BIN;
+    for (int r = 0; r < NUM_RADIOS; r++) {
+      sendMetaFrame(r);
+    }
+  } else {
+    serialproto = PROTO_TEXT;
+    Serial.print(F("\r\nSerial protocol: text\r\n"));
+  }
+}
+
+// Binary mode input: collects one COBS frame up to the 0x00 delimiter and runs
+// the command line of a valid command frame. Anything else is ignored.
+void readFrameByte(uint8_t data) {
+  static uint8_t framebuffer[FRAME_MAX_ENCODED];
+  static size_t framelength = 0;
+  static bool overflow = false;
+
+  if (data != 0x00) {
+    if (framelength < sizeof(framebuffer)) {
+      framebuffer[framelength++] = data;
+    } else {
+      overflow = true;
+    }
+    return;
+  }
+
+  uint8_t type, seq, len;
+  if (framelength > 0 && !overflow && frameDecode(framebuffer, framelength, &type, &seq, &len) && type == MSG_COMMAND) {
+    char line[BUF_LENGTH];
+    len = min((int)len, BUF_LENGTH - 1);
+    memcpy(line, &framebuffer[FRAME_HEADER_SIZE], len);
+    line[len] = '\0';
+    executeCommandLine(line);
+  }
+  framelength = 0;
+  overflow = false;
+}
+
+// ------- SERIAL COMMANDS ------------
+
+#define CMD(name, args, fn) { name, args, (CommandFn)fn, false }
+#define CC1_SETTER(name, args, fn) { name, args, (CommandFn)fn, true }
+
+// Must stay sorted by name (strcmp order), checkCommandTable() complains at boot if not
+const Command commands[] = {
+  CMD("add", ARGS_TEXT, addFrame),
+  CMD("addraw", ARGS_TEXT, addRawData),
+  CMD("batch", ARGS_LINE, runBatch),
+  CMD("calibrate", ARGS_RAW, calibrateCommand),
+  CMD("chat", ARGS_NONE, toggleChatMode),
+  CMD("diversity", ARGS_NONE, toggleDiversityMode),
+  CMD("dualrx", ARGS_RAW, dualRxCommand),
+  CMD("echo", ARGS_INT, setEchoMode),
+  CMD("fastboot", ARGS_INT, setFastBoot),
+  CMD("filter", ARGS_RAW, filterCommand),
+  CMD("flush", ARGS_NONE, flushRecordingBuffer),
+  CMD("getrssi", ARGS_NONE, getRssi),
+  CMD("help", ARGS_NONE, printHelp),
+  CMD("init", ARGS_NONE, initializeCC1101),
+  CMD("lbt", ARGS_RAW, lbtCommand),
+  CMD("load", ARGS_NONE, load),
+  CMD("play", ARGS_INT, playRecordedFrames),
+  CMD("playraw", ARGS_INT, playRawData),
+  CMD("power", ARGS_RAW, powerCommand),
+  CMD("profile", ARGS_RAW, profileCommand),
+  CMD("proto", ARGS_TEXT, protoCommand),
+  CMD("rec", ARGS_NONE, toggleRecordingMode),
+  CMD("recraw", ARGS_INT, recordRawData),
+  CMD("rx", ARGS_NONE, toggleRxMode),
+  CMD("save", ARGS_NONE, save),
+  CMD("scan", ARGS_FLOAT_FLOAT, scan),
+  CMD("selftest", ARGS_NONE, selfTest),
+  CC1_SETTER("setaddr", ARGS_INT, setAddr),
+  CC1_SETTER("setadrchk", ARGS_INT, setAdrChk),
+  CC1_SETTER("setappendstatus", ARGS_INT, setAppendStatus),
+  CC1_SETTER("setchannel", ARGS_INT, setChannel),
+  CC1_SETTER("setchsp", ARGS_FLOAT, setChsp),
+  CC1_SETTER("setcrc", ARGS_INT, setCrc),
+  CC1_SETTER("setcrcaf", ARGS_INT, setCrcAf),
+  CC1_SETTER("setdcfilteroff", ARGS_INT, setDcFilterOff),
+  CC1_SETTER("setdeviation", ARGS_FLOAT, setDeviation),
+  CC1_SETTER("setdrate", ARGS_FLOAT, setDRate),
+  CC1_SETTER("setfec", ARGS_INT, setFec),
+  CC1_SETTER("setlengthconfig", ARGS_INT, setLengthConfig),
+  CC1_SETTER("setmanchester", ARGS_INT, setManchester),
+  CMD("setmhz", ARGS_FLOAT, setMhz),
+  CC1_SETTER("setmodulation", ARGS_INT, setModulation),
+  CC1_SETTER("setpa", ARGS_INT, setPa),
+  CC1_SETTER("setpacketlength", ARGS_INT, setPacketLength),
+  CC1_SETTER("setpktformat", ARGS_INT, setPktFormat),
+  CC1_SETTER("setpqt", ARGS_INT, setPqt),
+  CC1_SETTER("setpre", ARGS_INT, setPre),
+  CC1_SETTER("setrxbw", ARGS_FLOAT, setRxBw),
+  CC1_SETTER("setsyncmode", ARGS_INT, setSyncMode),
+  CC1_SETTER("setsyncword", ARGS_INT_INT, setSyncWord),
+  CC1_SETTER("setwhitedata", ARGS_INT, setWhiteData),
+  CMD("show", ARGS_NONE, showRecordedFrames),
+  CMD("showbit", ARGS_NONE, showBitData),
+  CMD("showraw", ARGS_NONE, showRawData),
+  CMD("sniffraw", ARGS_INT, sniffRawData),
+  CMD("spitimeout", ARGS_INT, setSpiTimeout),
+  CMD("stats", ARGS_RAW, statsCommand),
+  CMD("tasks", ARGS_NONE, printTaskLoad),
+  CMD("tx", ARGS_TEXT, transmitData),
+  CMD("wave", ARGS_NONE, showWaveform),
+  CMD("wor", ARGS_RAW, worCommand),
+  CMD("x", ARGS_NONE, stopAllModes),
+};
+#define NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+void checkCommandTable() {
+  for (size_t i = 1; i < NUM_COMMANDS; i++) {
+    if (strcmp(commands[i - 1].name, commands[i].name) >= 0) {
+      Serial.print(F("Command table not sorted at "));
+      Serial.println(commands[i].name);
+    }
+  }
+}
+
+const Command *findCommand(const char *name) {
+  size_t lo = 0, hi = NUM_COMMANDS;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    int c = strcmp(name, commands[mid].name);
+    if (c == 0) {
+      return &commands[mid];
+    }
+    if (c < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return NULL;
+}
+
+// Cuts the next space separated word out of *cursor, NULL at the end of the line
+char *nextWord(char **cursor) {
+  char *p = *cursor;
+  while (*p == ' ' || *p == '\t') p++;
+  if (*p == '\0') {
+    *cursor = p;
+    return NULL;
+  }
+  char *word = p;
+  while (*p != '\0' && *p != ' ' && *p != '\t') p++;
+  if (*p != '\0') *p++ = '\0';
+  *cursor = p;
+  return word;
+}
+
+// Decimal or 0x hex, the whole word must be a number
+bool parseInt(const char *word, int &value) {
+  char *end;
+  long v = strtol(word, &end, (word[0] == '0' && (word[1] == 'x' || word[1] == 'X')) ? 16 : 10);
+  if (end == word || *end != '\0') return false;
+  value = v;
+  return true;
+}
+
+bool parseFloat(const char *word, float &value) {
+  char *end;
+  value = strtof(word, &end);
+  return end != word && *end == '\0';
+}
+
+// Splits and checks one command line. Prints why and returns false if it cannot run.
+bool parseCommand(char *line, ParsedCommand &pc) {
+  char *cursor = line;
+  char *name = nextWord(&cursor);
+  pc.cmd = findCommand(name);
+  if (pc.cmd == NULL) {
+    Serial.print(F("Unknown command: "));
+    Serial.print(name);
+    Serial.print(F("\r\n"));
+    return false;
+  }
+
+  if (pc.cmd->args == ARGS_LINE) {
+    while (*cursor == ' ' || *cursor == '\t') cursor++;
+    pc.argc = 1;
+    pc.argv[0] = cursor;
+    return true;
+  }
+
+  pc.argc = 0;
+  char *word;
+  while ((word = nextWord(&cursor)) != NULL) {
+    if (pc.argc == MAX_COMMAND_ARGS) {
+      pc.argc++;  // too many
+      break;
+    }
+    pc.argv[pc.argc++] = word;
+  }
+
+  bool ok = false;
+  switch (pc.cmd->args) {
+    case ARGS_NONE:
+      ok = (pc.argc == 0);
+      break;
+    case ARGS_INT:
+      ok = (pc.argc == 1) && parseInt(pc.argv[0], pc.ints[0]);
+      break;
+    case ARGS_INT_INT:
+      ok = (pc.argc == 2) && parseInt(pc.argv[0], pc.ints[0]) && parseInt(pc.argv[1], pc.ints[1]);
+      break;
+    case ARGS_FLOAT:
+      ok = (pc.argc == 1) && parseFloat(pc.argv[0], pc.floats[0]);
+      break;
+    case ARGS_FLOAT_FLOAT:
+      ok = (pc.argc == 2) && parseFloat(pc.argv[0], pc.floats[0]) && parseFloat(pc.argv[1], pc.floats[1]);
+      break;
+    case ARGS_TEXT:
+      ok = (pc.argc == 1);
+      break;
+    case ARGS_RAW:
+      ok = (pc.argc <= MAX_COMMAND_ARGS);
+      break;
+    case ARGS_LINE:
+      break;
+  }
+  if (!ok) {
+    Serial.print(F("Wrong parameters.\r\n"));
+  }
+  return ok;
+}
+
+void runCommand(ParsedCommand &pc) {
+  switch (pc.cmd->args) {
+    case ARGS_NONE:
+      ((void (*)())pc.cmd->fn)();
+      break;
+    case ARGS_INT:
+      ((void (*)(int))pc.cmd->fn)(pc.ints[0]);
+      break;
+    case ARGS_INT_INT:
+      ((void (*)(int, int))pc.cmd->fn)(pc.ints[0], pc.ints[1]);
+      break;
+    case ARGS_FLOAT:
+      ((void (*)(float))pc.cmd->fn)(pc.floats[0]);
+      break;
+    case ARGS_FLOAT_FLOAT:
+      ((void (*)(float, float))pc.cmd->fn)(pc.floats[0], pc.floats[1]);
+      break;
+    case ARGS_TEXT:
+      ((void (*)(const char *))pc.cmd->fn)(pc.argv[0]);
+      break;
+    case ARGS_RAW:
+      ((void (*)(int, char **))pc.cmd->fn)(pc.argc, pc.argv);
+      break;
+    case ARGS_LINE:
+      ((void (*)(char *))pc.cmd->fn)(pc.argv[0]);
+      break;
+  }
+}
+
+// Runs one command line from the serial port, typed or from a command frame
+void executeCommandLine(char *line) {
+  char *cursor = line;
+  while (*cursor == ' ' || *cursor == '\t') cursor++;
+  if (*cursor == '\0') {
+    return;
+  }
+
+  ParsedCommand pc;
+  if (parseCommand(cursor, pc)) {
+    runCommand(pc);
+  }
+}
+
+// The image a CC1 setter edits instead of the chip, NULL outside a batch. Captured
+// from the chip on the first edit after an apply.
+RadioProfile *cc1Staged() {
+  if (!cc1batch.active) {
+    return NULL;
+  }
+  if (!cc1batch.dirty) {
+    profileCapture(radio1, cc1batch.image);
+    cc1batch.dirty = true;
+  }
+  cc1batch.edits++;
+  return &cc1batch.image;
+}
+
+// Writes the edited image to CC1. profileApply() leaves it in IDLE, a mode that was
+// listening on it gets it back.
+void cc1BatchApply() {
+  if (!cc1batch.dirty) {
+    return;
+  }
+  cc1batch.dirty = false;
+  cc1batch.applies++;
+  if (!profileApply(radio1, cc1batch.image)) {
+    cc1batch.failed = true;
+  }
+  if (wormode == 1) {
+    worArm(radio1);
+  } else if (radioListening(0)) {
+    radio1.SetRx();
+  }
+}
+
+// batch <cmd>; <cmd>; ... runs up to MAX_BATCH_COMMANDS commands as one transaction.
+// Every command is checked first and nothing runs if one of them is wrong. They then
+// run under one radio lock. CC2 collects its register writes and sends them as burst
+// writes at the end. The CC1 setters edit a register image, which is applied once at
+// the end, or before any other command that could use CC1.
+void runBatch(char *line) {
+  ParsedCommand batch[MAX_BATCH_COMMANDS];
+  int count = 0;
+
+  char *cursor = line;
+  while (*cursor != '\0') {
+    char *item = cursor;
+    while (*cursor != '\0' && *cursor != ';') cursor++;
+    if (*cursor == ';') *cursor++ = '\0';
+
+    while (*item == ' ' || *item == '\t') item++;
+    if (*item == '\0') continue;  // empty item, "a;;b" or a trailing ";"
+
+    if (count == MAX_BATCH_COMMANDS) {
+      Serial.print(F("Batch rejected, max "));
+      Serial.print(MAX_BATCH_COMMANDS);
+      Serial.print(F(" commands.\r\n"));
+      return;
+    }
+    if (!parseCommand(item, batch[count])) {
+      Serial.print(F("Batch rejected at command "));
+      Serial.print(count + 1);
+      Serial.print(F(", nothing was run.\r\n"));
+      return;
+    }
+    if (batch[count].cmd->args == ARGS_LINE) {
+      Serial.print(F("Batch rejected, batches do not nest.\r\n"));
+      return;
+    }
+    count++;
+  }
+  if (count == 0) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return;
+  }
+
+  int writes, transfers;
+  {
+    RadioLock lock;
+    memset(&cc1batch, 0, sizeof(cc1batch));
+    cc1batch.active = true;
+    CC2.beginBatch();
+    for (int i = 0; i < count; i++) {
+      if (!batch[i].cmd->staged) {
+        cc1BatchApply();
+      }
+      runCommand(batch[i]);
+    }
+    cc1BatchApply();
+    cc1batch.active = false;
+    CC2.endBatch();
+    CC2.getBatchStats(&writes, &transfers);
+  }
+  char report[112];
+  snprintf(report, sizeof(report), "\r\nBatch done: %d commands, CC1 %d settings in %d image writes, CC2 %d register writes in %d transfers\r\n",
+           count, cc1batch.edits, cc1batch.applies, writes, transfers);
+  Serial.print(report);
+  if (cc1batch.failed) {
+    Serial.print(F("CC1 did not take all of the settings.\r\n"));
+  }
+}
+
+// profile <save|load|list|del> <radio 1|2> [name]
+void profileCommand(int argc, char **argv) {
+  int radio;
+  if (argc < 2 || !parseInt(argv[1], radio) || radio < 1 || radio > NUM_RADIOS) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return;
+  }
+  radio--;
+  if (argc == 3 && strcmp(argv[0], "save") == 0) {
+    saveProfile(radio, argv[2]);
+  } else if (argc == 3 && strcmp(argv[0], "load") == 0) {
+    loadProfile(radio, argv[2]);
+  } else if (argc == 3 && strcmp(argv[0], "del") == 0) {
+    deleteProfile(radio, argv[2]);
+  } else if (argc == 2 && strcmp(argv[0], "list") == 0) {
+    listProfiles(radio);
+  } else {
+    Serial.print(F("Wrong parameters.\r\n"));
+  }
+}
+
+// proto <text|bin>
+void protoCommand(const char *mode) {
+  if (strcmp(mode, "text") == 0) {
+    setProtocol(PROTO_TEXT);
+  } else if (strcmp(mode, "bin") == 0) {
+    setProtocol(PROTO_BIN);
+  } else {
+    Serial.print(F("Wrong parameters.\r\n"));
+  }
+}
+
 // ------- GENERAL CONFIGURATION ------------
 
 void initDisplay() {
-  if (!display.begin(SSD1306_SWITCHCAPVCC, 0x3C)) {  // Address 0x3C for 128x64
+  if (!display.begin(SSD1306_SWITCHCAPVCC, SSD1306_I2C_ADDRESS)) {  // Address 0x3C for 128x64
     Serial.println(F("SSD1306 allocation failed"));
     for (;;)
       ;
   }
-  display.display();
-  delay(2000);
+  oledInvalidate(oledflush);
+  if (!fastboot) {
+    showDisplay();  // library splash
+    delay(2000);
+  }
   display.clearDisplay();
 }
 
+// Pushes the drawing buffer to the panel, only the pages that changed
+void showDisplay() {
+  oledFlush(oledflush, display, Wire, SSD1306_I2C_ADDRESS);
+}
+
 void drawBorder() {
   display.drawRect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, SSD1306_WHITE);
 }
-void displayInfo(String title, String info1 = "", String info2 = "", String info3 = "") {
+void displayInfo(const char *title, const char *info1 = "", const char *info2 = "", const char *info3 = "") {
   display.clearDisplay();
   drawBorder();
   display.setTextSize(1);
@@ -1425,7 +2961,7 @@ void displayInfo(String title, String info1 = "", String info2 = "", String info
   display.println(info2);
   display.setCursor(4, 38);
   display.println(info3);
-  display.display();
+  showDisplay();
 }
 
 void updateDisplay(const char *message) {
@@ -1434,26 +2970,13 @@ void updateDisplay(const char *message) {
   display.setTextColor(WHITE);
   display.setCursor(0, 0);
   display.print(message);
-  display.display();
-}
-
-bool isButtonPressed(uint8_t pin) {
-  if (digitalRead(pin) == LOW) {
-    //return true;
-    delay(100);  // Debounce delay
-    if (digitalRead(pin) == LOW) {
-      //digitalWrite(LED_PIN, HIGH);  // Turn on LED
-      return true;
-    }
-
-  }
-  return false;
+  showDisplay();
 }
-void handleMenuSelection() {
-  static bool buttonPressed = false;
 
-  if (!buttonPressed) {
-    if (UP_BUTTON.isPressed()) {
+// Menu navigation, one debounced press at a time
+void handleMenuSelection(ButtonId button) {
+  switch (button) {
+    case BUTTON_UP:
       // Wrap around if at the top
       selectedMenuItem = static_cast<MenuItem>((selectedMenuItem == 0) ? (NUM_MENU_ITEMS - 1) : (selectedMenuItem - 1));
 
@@ -1466,8 +2989,8 @@ void handleMenuSelection() {
 
       Serial.println("UP button pressed");
       drawMenu();
-      buttonPressed = true;
-    } else if (DOWN_BUTTON.isPressed()) {
+      break;
+    case BUTTON_DOWN:
       // Wrap around if at the bottom
       selectedMenuItem = static_cast<MenuItem>((selectedMenuItem + 1) % NUM_MENU_ITEMS);
 
@@ -1480,28 +3003,14 @@ void handleMenuSelection() {
 
       Serial.println("DOWN button pressed");
       drawMenu();
-      buttonPressed = true;
-    } else if (SELECT_BUTTON.isPressed()) {
+      break;
+    case BUTTON_SELECT:
       Serial.println("SELECT button pressed");
       executeSelectedMenuItem();
-      buttonPressed = true;
-    } /*else if (isButtonPressed(HOME_BUTTON_PIN)) {
-      selectedMenuItem = static_cast<MenuItem>(0);
-      firstVisibleMenuItem = 0;
-      Serial.println("HOME button pressed");
-      drawMenu();
-      buttonPressed = true;
-    }*/
-
-  } 
-  else {
-    // If no button is pressed, reset the buttonPressed flag
-    //if (!isButtonPressed(UP_BUTTON_PIN) && !isButtonPressed(DOWN_BUTTON_PIN) && !isButtonPressed(SELECT_BUTTON_PIN)) {
-      buttonPressed = false;
-      //digitalWrite(LED_PIN, LOW);  // Turn off LED
-    //}
+      break;
+    default:
+      break;
   }
-  //buttonPressed = false;
 }
 
 static const unsigned char PROGMEM image_EviSmile1_bits[] = { 0x30, 0x03, 0x00, 0x60, 0x01, 0x80, 0xe0, 0x01, 0xc0, 0xf3, 0xf3, 0xc0, 0xff, 0xff, 0xc0, 0xff, 0xff, 0xc0, 0x7f, 0xff, 0x80, 0x7f, 0xff, 0x80, 0x7f, 0xff, 0x80, 0xef, 0xfd, 0xc0, 0xe7, 0xf9, 0xc0, 0xe3, 0xf1, 0xc0, 0xe1, 0xe1, 0xc0, 0xf1, 0xe3, 0xc0, 0xff, 0xff, 0xc0, 0x7f, 0xff, 0x80, 0x7b, 0xf7, 0x80, 0x3d, 0x2f, 0x00, 0x1e, 0x1e, 0x00, 0x0f, 0xfc, 0x00, 0x03, 0xf0, 0x00 };
@@ -1538,7 +3047,7 @@ void demonSHIT() {
   display.drawBitmap(92, 33, image_microphone_muted_bits, 15, 16, 1);
   display.drawBitmap(1, 23, image_mute_text_bits, 19, 5, 1);
   display.drawBitmap(32, 49, image_cross_contour_bits, 11, 16, 1);
-  display.display();
+  showDisplay();
 }
 void displayTitleScreen() {
   display.clearDisplay();
@@ -1547,7 +3056,7 @@ void displayTitleScreen() {
   u8g2_for_adafruit_gfx.print("CYPHER BOX");
   // u8g2_for_adafruit_gfx.setCursor(centerX, 25); // Centered vertically
   // u8g2_for_adafruit_gfx.print("NETWORK PET");
-  display.display();
+  showDisplay();
 }
 void displayInfoScreen() {
   display.clearDisplay();
@@ -1567,229 +3076,265 @@ void displayInfoScreen() {
   u8g2_for_adafruit_gfx.setCursor(0, 54);
   u8g2_for_adafruit_gfx.print("Have fun & be safe ~_~;");
 
-  display.display();
+  showDisplay();
 }
 
 // Menu Functions
 void executeSelectedMenuItem() {
   switch (selectedMenuItem) {
     case TEST_CC1101:
-      currentState = STATE_TEST_CC1101;
+      postAppEvent(STATE_TEST_CC1101);
       Serial.println("TEST_CC1101 button pressed");
-      displayInfo("CC1101 TEST", "Activating Radios", "Starting....");
-      initializeCC1101();
-      nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      // displayInfo("TESTING CC1101s", "RADIOS ACTIVE", "Running....");
       break;
     case CC_JAM:
-      currentState = STATE_CC_JAM;
+      postAppEvent(STATE_CC_JAM);
       Serial.println("CC1 JAM button pressed");
-      displayInfo("433hz JAMMER", "Activating Radio", "Starting....");
+      displayInfo("CC1101 JAMMER", "RADIOS ACTIVE", "Running....");
       //toggleJammingMode();
       // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-        displayInfo("CC1101 JAMMER", "RADIOS ACTIVE", "Running....");
-      }
       break;
     case CC1_SINGLE:
-      currentState = STATE_CC1_SINGLE;
+      postAppEvent(STATE_CC1_SINGLE);
       Serial.println("CC1 SINGLE button pressed");
-      displayInfo("433hz CC#1 JAMMER", "Activating Radio", "Starting....");
+      displayInfo("CC1101 JAMMER", "CC#1 RADIO ACTIVE", "Running....");
       //toggleJammingMode();
       // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-        displayInfo("CC1101 JAMMER", "CC#1 RADIO ACTIVE", "Running....");
-      }
       break;
     case CC2_SINGLE:
-      currentState = STATE_CC2_SINGLE;
+      postAppEvent(STATE_CC2_SINGLE);
       Serial.println("CC2 SINGLE button pressed");
-      displayInfo("433hz CC#2 JAMMER", "Activating Radio", "Starting....");
+      displayInfo("CC1101 JAMMER", "CC#2 RADIO ACTIVE", "Running....");
       //toggleJammingMode();
       // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-        displayInfo("CC1101 JAMMER", "CC#2 RADIO ACTIVE", "Running....");
-      }
       break;
     case REC_RAW:
-      currentState = STATE_REC_RAW;
+      postAppEvent(STATE_REC_RAW);
       Serial.println("REC_RAW button pressed");
-      displayInfo("REC_RAW", "recording raw data", "Recording....");
-      recordRawData(100);
-      // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
       break;
     case CC_SCAN:
-      currentState = STATE_CC_SCAN;
       Serial.println("CC_SCAN button pressed");
       displayInfo("CC_SCAN", "Scanning raw data", "Scanning....");
       scan(433.60, 434.20);
       // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      //while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-      //displayInfo("CC_SCAN", "Scanning raw data", "Scanning....");
-      //}
       break;
     case PLAY_RAW:
-      currentState = STATE_PLAY_RAW;
+      postAppEvent(STATE_PLAY_RAW);
       Serial.println("PLAY_RAW button pressed");
-      displayInfo("PLAY_RAW", "Playing raw data", "Playing....");
-      playRawData(100);
-      // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
       break;
     case SHOW_RAW:
-      currentState = STATE_SHOW_RAW;
+      postAppEvent(STATE_SHOW_RAW);
       Serial.println("SHOW_RAW button pressed");
-      displayInfo("SHOW_RAW", "Showing raw data", "Raw data....");
-      showRawData();
-      // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
       break;
     case SHOW_BUFF:
-      currentState = STATE_SHOW_BUFF;
+      postAppEvent(STATE_SHOW_BUFF);
       Serial.println("SHOW_BUFF button pressed");
       displayInfo("SHOW_BUFF", "Showing buffer data", "Raw buffer....");
       showBitData();
       // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
       break;
     case FLUSH_BUFF:
-      currentState = STATE_FLUSH_BUFF;
+      postAppEvent(STATE_FLUSH_BUFF);
       Serial.println("FLUSH_BUFF button pressed");
       displayInfo("FLUSH_BUFF", "Clearing buffer data", "Clearing buffer....");
       flushRecordingBuffer();
       // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-        displayInfo("FLUSH_BUFF", "Clearing buffer data", "Clearing buffer....");
-      }
       break;
     case GET_RSSI:
-      currentState = STATE_GET_RSSI;
+      postAppEvent(STATE_GET_RSSI);
       Serial.println("GET_RSSI button pressed");
-      displayInfo("GET_RSSI", "Showing buffer data", "GETTING RSSI....");
       getRssi();
-
-      // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
+      break;
     case STOP_ALL:
-      currentState = STATE_STOP_ALL;
+      postAppEvent(STATE_STOP_ALL);
       Serial.println("STOP_ALL button pressed");
       displayInfo("STOP_ALL", "Stopping all actions", "Stopping....");
       stopAllModes();
       // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-        displayInfo("STOP_ALL", "Stopping all actions", "Stopping....");
-      }
       break;
     case RESET_CC:
-      currentState = STATE_SHOW_BUFF;
-      Serial.println("SHOW_BUFF button pressed");
-      displayInfo("SHOW_BUFF", "Showing buffer data", "Raw buffer....");
-      cc1101initialize();
-      cc1101initialize_2();
-      // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-        displayInfo("SHOW_BUFF", "Showing buffer data", "Raw buffer....");
-      }
+      postAppEvent(STATE_RESET_CC);
+      Serial.println("RESET_CC button pressed");
       break;
     case SET_43400:
-      currentState = STATE_SET_43400;
+      postAppEvent(STATE_SET_43400);
       Serial.println("SET_43400 button pressed");
       displayInfo("SET_43400", "FREQ SET", "434.00MHz....");
       setMhz(434.00);
       // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-        displayInfo("SET_43400", "FREQ SET", "434.00MHz....");
-      }
       break;
     case SET_43430:
-      currentState = STATE_SET_43430;
+      postAppEvent(STATE_SET_43430);
       Serial.println("SET_43430 button pressed");
       displayInfo("SET_43430", "FREQ SET", "434.30MHz....");
       setMhz(434.30);
       // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-        displayInfo("SET_43430", "FREQ SET", "434.30MHz....");
-      }
       break;
     case SET_43440:
-      currentState = STATE_SET_43440;
+      postAppEvent(STATE_SET_43440);
       Serial.println("SET_43440 button pressed");
       displayInfo("SET_43440", "FREQ SET", "434.40MHz....");
       setMhz(434.40);
       // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-        displayInfo("SET_43440", "FREQ SET", "434.40MHz....");
-      }
+      break;
+    case RX_STATS:
+      postAppEvent(STATE_RX_STATS);
+      Serial.println("RX_STATS button pressed");
+      break;
+    case WAVE_VIEW:
+      postAppEvent(STATE_WAVE_VIEW);
+      Serial.println("WAVE_VIEW button pressed");
       break;
     case SET_43390:
-      currentState = STATE_SET_43390;
+      postAppEvent(STATE_SET_43390);
       Serial.println("SET_43390 button pressed");
       displayInfo("SET_43390", "FREQ SET", "433.90MHz....");
       setMhz(433.90);
       // nonBlockingDelay(2000);  // Debounce nonBlockingDelay
-      while (!isButtonPressed(SELECT_BUTTON_PIN)) {
-        displayInfo("SET_43390", "FREQ SET", "433.90MHz....");
-      }
       break;
       
   }
 }
 
-void setup() {
-  Serial.begin(115200);
-  delay(2000);
-  // Initialize I2C as specified
-  Wire.begin(21, 22);
-  Wire.setClock(100000);
-  delay(3000);
+// ------- BOOT ------------
 
-  initDisplay();
-  pinMode(UP_BUTTON_PIN, INPUT_PULLUP);
-  pinMode(DOWN_BUTTON_PIN, INPUT_PULLUP);
-  pinMode(SELECT_BUTTON_PIN, INPUT_PULLUP);
-  //pinMode(LED_PIN, OUTPUT);
-  Serial.println("buttons init'd");
-  // Initialize U8g2_for_Adafruit_GFX
-  u8g2_for_adafruit_gfx.begin(display);
-  Serial.println(F("CC1101 terminal tool connected, use 'help' for list of commands...\n\r"));
-  // Display splash screens
-  demonSHIT();
-  delay(5000);  // Show title screen for 3 seconds
-                // displayInfoScreen();
-                // delay(5000);  // Show info screen for 5 seconds
+// Closes the current boot phase
+void bootMark(BootPhase phase) {
+  uint32_t now = micros();
+  bootphaseus[phase] = now - bootmarkus;
+  bootmarkus = now;
+}
+
+// Boot: the radios (SPI) come up on the radio core while setup() does the display (I2C)
+void radioInitTask(void *param) {
+  uint32_t start = micros();
   cc1101initialize();
   cc1101initialize_2();
+  radioinitus = micros() - start;
+  xSemaphoreGive((SemaphoreHandle_t)param);
+  vTaskDelete(NULL);
+}
 
-  display.clearDisplay();
-  u8g2_for_adafruit_gfx.setFont(u8g2_font_baby_tf);
+const char *resetReasonName(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON: return "power on";
+    case ESP_RST_EXT: return "reset pin";
+    case ESP_RST_SW: return "software";
+    case ESP_RST_PANIC: return "panic";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT: return "watchdog";
+    case ESP_RST_DEEPSLEEP: return "deep sleep";
+    case ESP_RST_BROWNOUT: return "brown-out";
+    default: return "unknown";
+  }
+}
 
-  if (CC1.getCC1101()) {  // Check the CC1101 Spi connection.
-    Serial.println(F("cc1101 #1 initialized. Connection OK\n\r"));
-    u8g2_for_adafruit_gfx.setCursor(0, 30);
-    u8g2_for_adafruit_gfx.print("cc1101 initialized. Connection OK");
-    display.display();
-    delay(3000);
-  } else {
-    Serial.println(F("cc1101 #1 connection error! check the wiring.\n\r"));
-    u8g2_for_adafruit_gfx.setCursor(0, 30);
-    u8g2_for_adafruit_gfx.print("cc1101 connection ERROR!. Connection OK");
-    u8g2_for_adafruit_gfx.setCursor(0, 40);
-    u8g2_for_adafruit_gfx.print("CHECK WIRING!");
+// A reset nobody asked for: get back to work as fast as possible
+bool resetByFault(esp_reset_reason_t reason) {
+  return reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT || reason == ESP_RST_BROWNOUT;
+}
 
-    display.display();
-    delay(3000);
-  };
-  if (CC2.getCC1101()) {  // Check the CC1101 Spi connection.
-    Serial.println(F("cc1101 #2 initialized. Connection OK\n\r"));
-    u8g2_for_adafruit_gfx.setCursor(0, 40);
-    u8g2_for_adafruit_gfx.print("cc1101 initialized. Connection OK");
-    display.display();
-    delay(3000);
-  } else {
-    Serial.println(F("cc1101 #2 connection error! check the wiring.\n\r"));
-    u8g2_for_adafruit_gfx.setCursor(0, 45);
-    u8g2_for_adafruit_gfx.print("cc1101 connection ERROR!. Connection OK");
-    u8g2_for_adafruit_gfx.setCursor(0, 55);
-    u8g2_for_adafruit_gfx.print("CHECK WIRING!");
-    display.display();
+// Called from the CLI task on every pass, a few stores into RTC memory
+void saveResumeState() {
+  uint8_t modes = (receivingmode == 1 ? RESUME_RX : 0) | (recordingmode == 1 ? RESUME_RECORD : 0) | (diversitymode == 1 ? RESUME_DIVERSITY : 0) | (dualrxmode == 1 ? RESUME_DUALRX : 0) | (wormode == 1 ? RESUME_WOR : 0);
+  resumestate.modes = modes;
+  resumestate.worinterval = worinterval;
+  resumestate.worrxtime = worrxtime;
+  resumestate.check = ~modes;
+  resumestate.magic = RESUME_MAGIC;
+}
+
+// After a fault reset: turn the receive mode that was running back on
+void resumeModes() {
+  if (resumestate.magic != RESUME_MAGIC || resumestate.check != (uint8_t)~resumestate.modes) {
+    return;
+  }
+  uint8_t modes = resumestate.modes;
+  if (modes & RESUME_WOR) {
+    bool valid = resumestate.worinterval >= 1 && resumestate.worinterval <= WOR_MAX_INTERVAL_MS && resumestate.worrxtime <= WOR_MAX_RX_TIME;
+    worStart(valid ? resumestate.worinterval : WOR_DEFAULT_INTERVAL_MS, valid ? resumestate.worrxtime : WOR_DEFAULT_RX_TIME);
+  } else if (modes & RESUME_RX) {
+    toggleRxMode();
+  } else if (modes & RESUME_RECORD) {
+    toggleRecordingMode();
+  } else if (modes & RESUME_DIVERSITY) {
+    toggleDiversityMode();
+  } else if (modes & RESUME_DUALRX) {
+    dualRxCommand(0, NULL);
+  }
+}
+
+void printBootTimes() {
+  uint32_t total = 0;
+  Serial.print(F("\r\nBoot ("));
+  Serial.print(resetReasonName(resetreason));
+  Serial.print(fastboot ? F(" reset, fast):") : F(" reset, slow):"));
+  for (int p = 0; p < NUM_BOOT_PHASES; p++) {
+    total += bootphaseus[p];
+    Serial.print(' ');
+    Serial.print(bootPhaseNames[p]);
+    Serial.print(' ');
+    Serial.print(bootphaseus[p] / 1000);
+    Serial.print(p < NUM_BOOT_PHASES - 1 ? F(" ms,") : F(" ms"));
+  }
+  Serial.print(F("; radios "));
+  Serial.print(radioinitus / 1000);
+  Serial.print(F(" ms in parallel; total "));
+  Serial.print(total / 1000);
+  Serial.print(F(" ms\r\n"));
+}
+
+void setup() {
+  bootmarkus = micros();
+  Serial.begin(115200);
+  resetreason = esp_reset_reason();
+  settingsstore.begin(SETTINGS_NAMESPACE, false);
+  fastboot = settingsstore.getBool("fastboot", FAST_BOOT_DEFAULT) || resetByFault(resetreason);
+  powersave = settingsstore.getBool("powersave", POWER_SAVE_DEFAULT);
+  loadFreqCorrections();
+  if (!fastboot) {
+    delay(2000);
+  }
+  // Radio profiles have to be readable before the radios are initialized
+  profilestore.begin(PROFILE_NAMESPACE, false);
+  radioLockInit();
+  bootMark(BOOT_SERIAL);
+
+  SemaphoreHandle_t radiosready = xSemaphoreCreateBinary();
+  xTaskCreatePinnedToCore(radioInitTask, "radioinit", RADIO_TASK_STACK, radiosready, RADIO_TASK_PRIO, NULL, RADIO_CORE);
+
+  // Initialize I2C as specified
+  Wire.begin(21, 22);
+  Wire.setClock(OLED_I2C_HZ);
+  if (!fastboot) {
     delay(3000);
-  };
+  }
+
+  initDisplay();
+  pinMode(UP_BUTTON_PIN, INPUT_PULLUP);
+  pinMode(DOWN_BUTTON_PIN, INPUT_PULLUP);
+  pinMode(SELECT_BUTTON_PIN, INPUT_PULLUP);
+  //pinMode(LED_PIN, OUTPUT);
+  Serial.println("buttons init'd");
+  // Initialize U8g2_for_Adafruit_GFX
+  u8g2_for_adafruit_gfx.begin(display);
+  Serial.println(F("CC1101 terminal tool connected, use 'help' for list of commands...\n\r"));
+  bootMark(BOOT_DISPLAY);
+
+  // Display splash screens, only drawn while the radios come up on a fast boot
+  demonSHIT();
+  if (!fastboot) {
+    delay(SPLASH_MS);
+    // displayInfoScreen();
+    // delay(5000);  // Show info screen for 5 seconds
+  }
+  bootMark(BOOT_SPLASH);
+
+  xSemaphoreTake(radiosready, portMAX_DELAY);
+  vSemaphoreDelete(radiosready);
+  bootMark(BOOT_RADIOS);
+
+  showRadioStatus(fastboot ? 0 : STATUS_HOLD_MS);
 
   drawMenu();
 
@@ -1797,6 +3342,10 @@ void setup() {
   EEPROM.begin(EPROMSIZE);
   // setup variables
   bigrecordingbufferpos = 0;
+  checkCommandTable();
+  checkUiStates();
+  filterClear(rxfilter);
+  chatInit(chatlink, chatSendFrame, chatDeliver, chatDone, NULL, (uint16_t)esp_random());
   Serial.println(currentState);
   currentState = STATE_MENU;
   Serial.println(currentState);
@@ -1805,269 +3354,1475 @@ void setup() {
   SELECT_BUTTON.setDebounceTime(Debounce_Time);
   UP_BUTTON.setDebounceTime(Debounce_Time);
   DOWN_BUTTON.setDebounceTime(Debounce_Time);
+
+  if (resetByFault(resetreason)) {
+    resumeModes();
+  }
+  startTasks();
+  bootMark(BOOT_SETUP);
+  printBootTimes();
+}
+
+// ------- TASKS ------------
+
+void taskLoadBegin(TaskId id) {
+  taskloads[id].busysince = micros() | 1;  // never 0, that means waiting
+}
+
+void taskLoadEnd(TaskId id) {
+  taskloads[id].busyus += micros() - taskloads[id].busysince;
+  taskloads[id].busysince = 0;
+}
+
+// Prints busy time of every task since the last call. Slices still running are
+// counted up to now, so a task stuck in a long loop shows up as busy.
+void printTaskLoad() {
+  uint32_t now = micros();
+  uint32_t window = now - taskloadwindow;
+  char line[64];
+
+  Serial.print(F("\r\nTask    Core  Load  Stack free\r\n"));
+  for (int t = 0; t < NUM_TASKS; t++) {
+    TaskLoad &load = taskloads[t];
+    uint32_t busy = load.busyus;
+    if (load.busysince) {
+      busy += now - load.busysince;
+      load.busysince = now | 1;
+    }
+    load.busyus = 0;
+    snprintf(line, sizeof(line), "%-7s %4d %4lu%% %6u\r\n", load.name, (t <= TASK_RADIO2) ? RADIO_CORE : APP_CORE,
+             window ? (unsigned long)((uint64_t)busy * 100 / window) : 0UL, (unsigned)uxTaskGetStackHighWaterMark(load.handle));
+    Serial.print(line);
+  }
+  Serial.print(F("\r\nRadio TX done  TX timeouts\r\n"));
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    snprintf(line, sizeof(line), "%-5s %7lu %12lu\r\n", radios[r]->name, (unsigned long)txdone[r], (unsigned long)txtimeouts[r]);
+    Serial.print(line);
+  }
+  int spitimeouts, spiretries;
+  unsigned int readyhist[8];
+  CC2.getSpiStats(&spitimeouts, &spiretries, readyhist);
+  snprintf(line, sizeof(line), "\r\nCC2 SPI timeouts %d, retries %d%s\r\n", spitimeouts, spiretries, CC2.isDegraded() ? ", DEGRADED" : "");
+  Serial.print(line);
+  Serial.print(F("Ready wait 0 <4 <16 <64 <256 <1k <4k >4k us:"));
+  for (int i = 0; i < 8; i++) {
+    Serial.print(' ');
+    Serial.print(readyhist[i]);
+  }
+  Serial.print(F("\r\n"));
+  snprintf(line, sizeof(line), "Buttons %lu presses, latency avg %lu max %lu ms\r\n", (unsigned long)buttonpresses,
+           buttonpresses ? (unsigned long)(buttonlatencysum / buttonpresses / 1000) : 0UL, (unsigned long)(buttonlatencymax / 1000));
+  Serial.print(line);
+  snprintf(line, sizeof(line), "Heap free %u, lowest %u, largest block %u\r\n", (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+           (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT), (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+  Serial.print(line);
+  snprintf(line, sizeof(line), "OLED flushes %lu, pages %lu, bytes %lu\r\n", (unsigned long)oledflush.flushes,
+           (unsigned long)oledflush.pages, (unsigned long)oledflush.bytes);
+  Serial.print(line);
+  if (wormode == 1) {
+    printWorStats();
+  }
+  printBootTimes();
+  Serial.print(F("\r\nRadio Consumer Queued Dropped\r\n"));
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    for (int c = 0; c < NUM_RX_CONSUMERS; c++) {
+      snprintf(line, sizeof(line), "%-5s %-8s %6lu %7lu\r\n", radios[r]->name, rxConsumerNames[c],
+               (unsigned long)ringCount(rxrings[r][c]), (unsigned long)rxrings[r][c].drops);
+      Serial.print(line);
+    }
+  }
+  taskloadwindow = now;
+}
+
+// Ask the UI task to switch state
+void postAppEvent(AppState state) {
+  AppEvent event = { state };
+  xQueueSend(appeventqueue, &event, 0);
+  if (taskloads[TASK_UI].handle) {
+    xTaskNotifyGive(taskloads[TASK_UI].handle);
+  }
+}
+
+// Applies queued state changes, running the leave / enter hooks of uistates[]
+void applyAppEvents() {
+  AppEvent event;
+  while (xQueueReceive(appeventqueue, &event, 0) == pdTRUE) {
+    if (event.state != currentState && uistates[currentState].leave) {
+      uistates[currentState].leave();
+    }
+    currentState = event.state;
+    if (uistates[currentState].enter) {
+      uistates[currentState].enter();
+    }
+  }
+}
+
+// Queue a command for a radio task and wake it, false if the queue stayed full
+bool sendRadioCommand(int radio, const RadioCommand &cmd) {
+  if (xQueueSend(radiocmdqueue[radio], &cmd, pdMS_TO_TICKS(100)) != pdTRUE) {
+    return false;
+  }
+  xTaskNotifyGive(taskloads[TASK_RADIO1 + radio].handle);
+  return true;
+}
+
+// CLI receive, record and chat modes all listen on CC1101 #1, diversity and dual receive on both
+bool radioListening(int radio) {
+  return (radio == 0 && (receivingmode == 1 || recordingmode == 1 || chatmode == 1)) || diversitymode == 1 || dualrxmode == 1;
+}
+
+// Receive and record mode only get what passes rxfilter
+bool rxConsumerFiltered(int consumer) {
+  return consumer == RX_PRINTER || consumer == RX_RECORDER;
+}
+
+bool rxConsumerActive(int consumer) {
+  switch (consumer) {
+    case RX_PRINTER:
+      return receivingmode == 1 && recordingmode == 0;
+    case RX_RECORDER:
+      return recordingmode == 1 && receivingmode == 0;
+    case RX_DECODER:
+      return chatmode == 1;
+    case RX_DIVERSITY:
+      return diversitymode == 1;
+    case RX_MERGER:
+      return dualrxmode == 1;
+  }
+  return false;
+}
+
+// GDO0 (IOCFG0 = 0x06) falls at the end of a packet, wake the radio task
+void IRAM_ATTR radioGdo0Isr(void *arg) {
+  gdo0falls[(intptr_t)arg]++;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(taskloads[TASK_RADIO1 + (intptr_t)arg].handle, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+// Puts the CCA mode and carrier sense threshold of "lbt" into the radio, if a profile
+// load or init has changed them since
+void lbtConfigure(RadioPort &cc) {
+  byte mcsm1 = cc.SpiReadReg(CC1101_MCSM1);
+  if (((mcsm1 >> 4) & 0x03) != lbtmode) {
+    cc.SpiWriteReg(CC1101_MCSM1, (mcsm1 & ~0x30) | (lbtmode << 4));
+  }
+  byte agcctrl1 = cc.SpiReadReg(CC1101_AGCCTRL1);
+  if ((agcctrl1 & 0x0F) != (lbtthreshold & 0x0F)) {
+    cc.SpiWriteReg(CC1101_AGCCTRL1, (agcctrl1 & 0xF0) | (lbtthreshold & 0x0F));
+  }
+}
+
+// End of an asynchronous transmission, called by txPoll() in the radio task
+void radioTxDone(RadioPort &cc, TxState state, void *arg) {
+  int radio = (intptr_t)arg;
+  if (state == TX_DONE) {
+    txdone[radio]++;
+  } else if (state == TX_TIMEOUT) {
+    txtimeouts[radio]++;  // GDO0 / wiring fault or a dead module, shown by "tasks"
+  }
+}
+
+void runRadioCommand(int radio, RadioCommand &cmd) {
+  switch (cmd.type) {
+    case RADIO_CMD_SEND:
+      if (lbtmode) {
+        lbtConfigure(*radios[radio]);
+      }
+      radios[radio]->sendAsync(cmd.data, cmd.len, TX_TIMEOUT_MS, lbtmode ? LBT_MAX_WAIT_MS : 0);
+      break;
+  }
+}
+
+// Statistics entry for the frequency the radio is on now. Called with the radio lock held.
+RxStats &currentRxStats(int radio) {
+  byte regs[6];  // CHANNR, FSCTRL1, FSCTRL0, FREQ2, FREQ1, FREQ0
+  radios[radio]->SpiReadBurstReg(CC1101_CHANNR, regs, sizeof(regs));
+  return rxStatsFor(rxstats[radio], rxStatsKey(regs[3], regs[4], regs[5], regs[0]));
+}
+
+// Moves a finished packet from the RX FIFO to the packet queue, and keeps the radio
+// in RX. Called with the radio lock held.
+void serviceRadioRx(int radio) {
+  RadioPort &cc = *radios[radio];
+  byte rxbytes = cc.SpiReadStatus(CC1101_RXBYTES);
+
+  if (rxbytes & 0x80) {
+    // RX FIFO overflow, drop whatever is in there
+    currentRxStats(radio).overflows++;
+    cc.SpiStrobe(CC1101_SFRX);
+    cc.SetRx();
+    return;
+  }
+  if ((rxbytes & 0x7F) == 0) {
+    // Nothing received. Go back to RX if the radio dropped to IDLE (after a TX, ...)
+    if ((cc.SpiReadStatus(CC1101_MARCSTATE) & 0x1F) == 0x01) {
+      cc.SetRx();
+    }
+    return;
+  }
+  if (fastRead(cc.gdo0)) {
+    return;  // still receiving, the falling edge wakes us again
+  }
+
+  RxPacket pkt;
+  pkt.radio = radio;
+  pkt.rssi = cc.getRssi();
+  pkt.lqi = cc.getLqi() & 0x7F;
+  // CRC Check. If "setCrc(false)" crc returns always OK!
+  RxStats &stats = currentRxStats(radio);
+  if (!cc.CheckCRC()) {
+    stats.crcfails++;
+    return;  // CheckCRC() flushed the FIFO and restarted RX
+  }
+  // the length byte comes from the air and ReceiveData() copies that many bytes
+  byte rxbuffer[256];
+  byte len = cc.ReceiveData(rxbuffer);
+  if (len >= CCBUFFERSIZE) {
+    return;
+  }
+  pkt.len = len;
+  pkt.timestamp = micros();
+  memcpy(pkt.data, rxbuffer, len);
+  rxStatsPacket(stats, pkt);
+  int filtered = -1;  // evaluated once, and only if a filtered consumer is active
+  for (int c = 0; c < NUM_RX_CONSUMERS; c++) {
+    if (rxConsumerActive(c)) {
+      if (rxConsumerFiltered(c)) {
+        if (filtered < 0) filtered = filterPacket(rxfilter, pkt);
+        if (!filtered) continue;
+      }
+      ringPush(rxrings[radio][c], pkt);  // a full ring counts a drop
+    }
+  }
+  xTaskNotifyGive(taskloads[TASK_CLI].handle);
+}
+
+// WOR receive on CC1: the chip is only touched after GDO0 fell, any SPI access would take
+// it out of SLEEP. Takes the packet out of the FIFO and sends the chip back to WOR.
+// worseen moves on only afterwards, the CLI task does not light sleep before.
+// Called with the radio lock held.
+void serviceRadioWor() {
+  uint32_t falls = gdo0falls[0];
+  if (falls == worseen) {
+    return;
+  }
+  // GDO0 high: the next packet is already coming in, its falling edge wakes us again
+  if (!fastRead(radio1.gdo0)) {
+    worstats.packets++;
+    serviceRadioRx(0);
+    worArm(radio1);
+  }
+  worseen = falls;
+}
+
+void radioTask(void *param) {
+  int radio = (intptr_t)param;
+  TaskId id = (TaskId)(TASK_RADIO1 + radio);
+  RadioPort &cc = *radios[radio];
+  bool armed = false;
+  RadioCommand cmd;
+
+  cc.onTxDone(radioTxDone, param);
+  for (;;) {
+    // woken by GDO0, by a queued command, by a wake-up from SPWD or by the poll timeout,
+    // which is one tick while a packet waits for a clear channel
+    TickType_t poll = pdMS_TO_TICKS(radiopower[radio].asleep ? RADIO_SLEEP_POLL_MS : RADIO_POLL_MS);
+    ulTaskNotifyTake(pdTRUE, cc.txCcaWaiting() ? 1 : poll);
+    taskLoadBegin(id);
+
+    if (cc.txBusy()) {
+      RadioLock lock;
+      cc.txPoll();
+    }
+    // the next command waits until the packet in flight is out
+    while (!cc.txBusy() && xQueueReceive(radiocmdqueue[radio], &cmd, 0) == pdTRUE) {
+      RadioLock lock;
+      runRadioCommand(radio, cmd);
+      radiopower[radio].usedat = millis();
+    }
+
+    // a degraded module answers nothing, leave it alone until init
+    bool listening = radioListening(radio) && !cc.isDegraded();
+    bool arm = listening || cc.txBusy();
+    if (arm != armed) {
+      armed = arm;
+      if (armed) {
+        attachInterruptArg(cc.gdo0, radioGdo0Isr, (void *)(intptr_t)radio, FALLING);
+      } else {
+        detachInterrupt(cc.gdo0);
+      }
+    }
+    if (listening && !cc.txBusy()) {
+      RadioLock lock;
+      if (radio == 0 && wormode == 1) {
+        serviceRadioWor();
+      } else {
+        serviceRadioRx(radio);
+      }
+      radiopower[radio].usedat = millis();
+    } else if (powersave && !armed && !radiopower[radio].asleep && !cc.isDegraded() && millis() - radiopower[radio].usedat >= RADIO_IDLE_SLEEP_MS) {
+      RadioLock lock;
+      // another task may have used it while we waited for the lock
+      if (!radioListening(radio) && millis() - radiopower[radio].usedat >= RADIO_IDLE_SLEEP_MS) {
+        radioPowerDown(cc, radiopower[radio]);
+      }
+    }
+
+    taskLoadEnd(id);
+  }
+}
+
+// Chat link: hands a frame to the CC1101 #1 task, it sends them between two RX checks
+bool chatSendFrame(void *ctx, const uint8_t *frame, uint8_t len) {
+  RadioCommand cmd;
+  cmd.type = RADIO_CMD_SEND;
+  cmd.len = len;
+  memcpy(cmd.data, frame, len);
+  return sendRadioCommand(0, cmd);
+}
+
+// Chat link: a complete message from the other side
+void chatDeliver(void *ctx, const uint8_t *msg, size_t len) {
+  Serial.write(msg, len);
+  Serial.print(F("\r\n"));
+}
+
+// Chat link: our message was acknowledged completely, or given up
+void chatDone(void *ctx, bool ok, size_t len, uint32_t ms) {
+  char line[64];
+  if (ok) {
+    snprintf(line, sizeof(line), "[%u bytes delivered in %lu ms, %lu B/s]\r\n", (unsigned)len, (unsigned long)ms,
+             ms ? (unsigned long)((uint64_t)len * 1000 / ms) : 0UL);
+  } else {
+    snprintf(line, sizeof(line), "[%u bytes NOT delivered, no ack after %d retries]\r\n", (unsigned)len, CHAT_MAX_RETRIES);
+  }
+  Serial.print(line);
+}
+
+// Chat mode: one character typed on the serial port. Enter sends the line as one
+// message, "/quit" leaves chat mode.
+void chatInput(int data) {
+  if (data == '\b' || data == '\177') {  // BS and DEL
+    if (chatlinelen) {
+      chatlinelen--;
+      Serial.write("\b \b");
+    }
+    return;
+  }
+  if (data != '\r' && data != '\n') {
+    if (chatlinelen < CHAT_MAX_MESSAGE) {
+      chatline[chatlinelen++] = data;
+      Serial.write(data);
+    }
+    return;
+  }
+  if (chatlinelen == 0) {
+    return;  // LF of a CRLF, or an empty line
+  }
+  Serial.print(F("\r\n"));
+
+  if (chatlinelen == 5 && memcmp(chatline, "/quit", 5) == 0) {
+    char line[80];
+    chatmode = 0;
+    chatAbort(chatlink);
+    snprintf(line, sizeof(line), "\r\nLeaving chat mode. Sent %lu, failed %lu, received %lu, %lu frames, %lu retransmits\r\n",
+             (unsigned long)chatlink.stats.messagessent, (unsigned long)chatlink.stats.messagesfailed, (unsigned long)chatlink.stats.messagesreceived,
+             (unsigned long)chatlink.stats.framessent, (unsigned long)chatlink.stats.retransmits);
+    Serial.print(line);
+  } else if (!chatSend(chatlink, (const uint8_t *)chatline, chatlinelen, millis())) {
+    Serial.print(F("[previous message still in flight, not sent]\r\n"));
+  }
+  chatlinelen = 0;
+}
+
+// Chat mode: feed the frame to the link layer, anything else is printed as text
+void decodePacket(const RxPacket &pkt) {
+  if (chatReceive(chatlink, pkt.data, pkt.len, millis())) {
+    return;
+  }
+  memcpy(ccreceivingbuffer, pkt.data, pkt.len);
+  // put NULL at the end of char buffer
+  ccreceivingbuffer[pkt.len] = '\0';
+  // Print received in char format.
+  Serial.print((char *)ccreceivingbuffer);
+}
+
+// Receive mode: print the packet as hex, or send it as a packet frame
+void printPacket(const RxPacket &pkt) {
+  if (serialproto == PROTO_BIN) {
+    sendPacketFrame(pkt);
+    return;
+  }
+  // Print received packet as set of hex values directly
+  //  not to loose any data in buffer
+  size_t n = hexEncode(pkt.data, pkt.len, (char *)textbuffer, sizeof(textbuffer));
+  Serial.write(textbuffer, n);
+}
+
+// Recording mode: append the frame to the big recording buffer
+void recordPacket(const RxPacket &pkt) {
+  int len = pkt.len;
+
+  // copy the frame from receiving buffer for replay - only if it fits
+  if ((bigrecordingbufferpos + len + 1) < RECORDINGBUFFERSIZE) {  // put info about number of bytes
+    bigrecordingbuffer[bigrecordingbufferpos] = len;
+    bigrecordingbufferpos++;
+    // next - copy current frame and increase
+    memcpy(&bigrecordingbuffer[bigrecordingbufferpos], pkt.data, len);
+    // increase position in big recording buffer for next frame
+    bigrecordingbufferpos = bigrecordingbufferpos + len;
+    // increase counter of frames stored
+    framesinbigrecordingbuffer++;
+    Serial.print("\r\nAdded frame number ");
+    Serial.print(framesinbigrecordingbuffer);
+    Serial.print("\r\n");
+  } else {
+    Serial.print(F("Recording buffer full! Stopping..\r\nFrames stored: "));
+    Serial.print(framesinbigrecordingbuffer);
+    Serial.print(F("\r\n"));
+    bigrecordingbufferpos = 0;
+    recordingmode = 0;
+  };
+}
+
+// Diversity and dual receive: one line per packet, tagged with the radio, its frequency
+// and channel. Binary hosts get the same from the meta frames sent when the mode starts.
+void printTaggedPacket(const RxPacket &pkt) {
+  if (serialproto == PROTO_BIN) {
+    sendPacketFrame(pkt);
+    return;
+  }
+  char line[48];
+  snprintf(line, sizeof(line), "%s %3lu.%03lu ch%-3u %4d dBm %3u: ", radios[pkt.radio]->name, (unsigned long)(rxtaghz[pkt.radio] / 1000000),
+           (unsigned long)(rxtaghz[pkt.radio] / 1000 % 1000), rxtagchannel[pkt.radio], pkt.rssi, pkt.lqi);
+  Serial.print(line);
+  size_t n = hexEncode(pkt.data, pkt.len, (char *)textbuffer, sizeof(textbuffer));
+  Serial.write(textbuffer, n);
+  Serial.print(F("\r\n"));
+}
+
+// Per radio: copies heard, share of all packets heard (hit rate) and copies kept
+void printDiversityStats() {
+  RxPacket pkt;
+  char line[48];
+
+  while (diversityTake(diversitywindow, micros(), true, pkt)) {
+    printTaggedPacket(pkt);
+  }
+  const DiversityStats &stats = diversitywindow.stats;
+  Serial.print(F("\r\nRadio  Heard  Hit rate  Kept\r\n"));
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    snprintf(line, sizeof(line), "%-5s %6lu %8lu%% %5lu\r\n", radios[r]->name, (unsigned long)stats.heard[r],
+             stats.packets ? (unsigned long)((uint64_t)stats.heard[r] * 100 / stats.packets) : 0UL, (unsigned long)stats.best[r]);
+    Serial.print(line);
+  }
+  Serial.print(F("Packets "));
+  Serial.print(stats.packets);
+  Serial.print(F("\r\n"));
+}
+
+// Dual receive: hands out the packets of both radios in timestamp order. The oldest
+// packet waits up to MERGE_HOLD_US while the other ring is empty, in case the other
+// radio task has read an older packet but not pushed it yet.
+void drainMergedRings() {
+  for (;;) {
+    const RxPacket *oldest = NULL;
+    int from = 0;
+    bool otherempty = false;
+    for (int r = 0; r < NUM_RADIOS; r++) {
+      const RxPacket *pkt = ringFront(rxrings[r][RX_MERGER]);
+      if (pkt == NULL) {
+        otherempty = true;
+      } else if (oldest == NULL || (int32_t)(pkt->timestamp - oldest->timestamp) < 0) {
+        oldest = pkt;
+        from = r;
+      }
+    }
+    if (oldest == NULL || (otherempty && (uint32_t)(micros() - oldest->timestamp) < MERGE_HOLD_US)) {
+      return;  // the CLI task polls every CLI_POLL_MS, held packets go out next time
+    }
+    printTaggedPacket(*oldest);
+    ringRelease(rxrings[from][RX_MERGER]);
+  }
+}
+
+// One histogram row, under the header line printed by the caller
+static void printStatsRow(const uint16_t *bins, int n) {
+  char field[8];
+  Serial.print(F("         "));
+  for (int i = 0; i < n; i++) {
+    snprintf(field, sizeof(field), "%6u", bins[i]);
+    Serial.print(field);
+  }
+  Serial.print(F("\r\n"));
+}
+
+// Function to handle STATS command: stats [reset]
+void statsCommand(int argc, char **argv) {
+  if (argc == 1 && strcmp(argv[0], "reset") == 0) {
+    RadioLock lock;
+    for (int r = 0; r < NUM_RADIOS; r++) {
+      rxStatsReset(rxstats[r]);
+    }
+    Serial.print(F("\r\nStatistics cleared.\r\n"));
+    return;
+  }
+  if (argc != 0) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return;
+  }
+
+  char line[80];
+  RadioLock lock;  // radio tasks update the tables with the lock held
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    for (int f = 0; f < RX_STATS_FREQS; f++) {
+      const RxStats &s = rxstats[r].freqs[f];
+      if (s.key == 0) continue;
+      uint32_t hz = rxStatsHz(s);
+      snprintf(line, sizeof(line), "\r\n%s %3lu.%03lu MHz ch %u: %lu packets, %lu CRC fails, %lu overflows\r\n", radios[r]->name,
+               (unsigned long)(hz / 1000000), (unsigned long)(hz / 1000 % 1000), rxStatsChannel(s), (unsigned long)s.packets,
+               (unsigned long)s.crcfails, (unsigned long)s.overflows);
+      Serial.print(line);
+      if (s.packets == 0) continue;
+      snprintf(line, sizeof(line), "  RSSI mean %ld min %d max %d dBm\r\n", (long)(s.rssisum / (int32_t)s.packets), s.rssimin, s.rssimax);
+      Serial.print(line);
+      Serial.print(F("  RSSI >=  -110  -100   -90   -80   -70   -60   -50   -40\r\n"));
+      printStatsRow(s.rssihist, RX_RSSI_BINS);
+      Serial.print(F("  LQI  >=     0    16    32    48    64    80    96   112\r\n"));
+      printStatsRow(s.lqihist, RX_LQI_BINS);
+      Serial.print(F("  Gap  <    1ms   4ms  16ms  64ms 256ms    1s    4s  more\r\n"));
+      printStatsRow(s.gaphist, RX_GAP_BINS);
+    }
+  }
+}
+
+static void printFilter() {
+  char line[64];
+  Serial.print(F("\r\nFilter rules: "));
+  Serial.print(rxfilter.numrules);
+  Serial.print(F("\r\n"));
+  for (int r = 0; r < rxfilter.numrules; r++) {
+    const FilterRule &rule = rxfilter.rules[r];
+    switch (rule.type) {
+      case FILTER_BYTES: {
+        char value[2 * FILTER_MAX_MATCH + 1], mask[2 * FILTER_MAX_MATCH + 1];
+        hexEncode(rule.value, rule.count, value, sizeof(value));
+        hexEncode(rule.mask, rule.count, mask, sizeof(mask));
+        snprintf(line, sizeof(line), " %d: byte %u %s mask %s\r\n", r + 1, rule.offset, value, mask);
+        break;
+      }
+      case FILTER_LENGTH:
+        snprintf(line, sizeof(line), " %d: len %u..%u\r\n", r + 1, rule.minlen, rule.maxlen);
+        break;
+      case FILTER_RSSI:
+        snprintf(line, sizeof(line), " %d: rssi >= %d dBm\r\n", r + 1, rule.floor);
+        break;
+      default:
+        line[0] = '\0';
+        break;
+    }
+    Serial.print(line);
+  }
+  snprintf(line, sizeof(line), "Dedup %lu ms, passed %lu, dropped %lu\r\n", (unsigned long)(rxfilter.dedupus / 1000),
+           (unsigned long)rxfilter.passed, (unsigned long)rxfilter.dropped);
+  Serial.print(line);
+}
+
+// Function to handle FILTER command
+//   filter                              list rules and counters
+//   filter clear                        remove all rules, everything passes
+//   filter byte <offset> <hex> [<mask>] payload bytes at offset must match (under mask)
+//   filter len <min> <max>              payload length range
+//   filter rssi <dBm>                   RSSI floor
+//   filter dedup <ms>                   drop repeats of a frame within ms, 0 = off
+void filterCommand(int argc, char **argv) {
+  RadioLock lock;  // the radio tasks evaluate the filter with the lock held
+  FilterRule rule;
+  memset(&rule, 0, sizeof(rule));
+  int a, b;
+  bool ok = false;
+
+  if (argc == 0) {
+    printFilter();
+    return;
+  }
+  if (argc == 1 && strcmp(argv[0], "clear") == 0) {
+    filterClear(rxfilter);
+    Serial.print(F("\r\nFilter cleared.\r\n"));
+    return;
+  }
+  if (argc == 2 && strcmp(argv[0], "dedup") == 0 && parseInt(argv[1], a) && a >= 0) {
+    filterSetDedup(rxfilter, a);
+    printFilter();
+    return;
+  }
+
+  if ((argc == 3 || argc == 4) && strcmp(argv[0], "byte") == 0 && parseInt(argv[1], a) && a >= 0 && a < FILTER_SPAN) {
+    rule.type = FILTER_BYTES;
+    rule.offset = a;
+    rule.count = hexDecode(argv[2], strlen(argv[2]), rule.value, sizeof(rule.value));
+    if (argc == 4) {
+      ok = rule.count && hexDecode(argv[3], strlen(argv[3]), rule.mask, sizeof(rule.mask)) == rule.count;
+    } else {
+      memset(rule.mask, 0xFF, sizeof(rule.mask));
+      ok = rule.count > 0;
+    }
+  } else if (argc == 3 && strcmp(argv[0], "len") == 0 && parseInt(argv[1], a) && parseInt(argv[2], b)) {
+    rule.type = FILTER_LENGTH;
+    rule.minlen = constrain(a, 0, 255);
+    rule.maxlen = constrain(b, 0, 255);
+    ok = a >= 0 && a <= b;
+  } else if (argc == 2 && strcmp(argv[0], "rssi") == 0 && parseInt(argv[1], a)) {
+    rule.type = FILTER_RSSI;
+    rule.floor = constrain(a, -128, 0);
+    ok = true;
+  }
+  if (!ok) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return;
+  }
+  if (!filterAdd(rxfilter, rule)) {
+    Serial.print(F("\r\nRule not added: table full, out of range or no packet could pass.\r\n"));
+    return;
+  }
+  printFilter();
+}
+
+// Function to handle LBT command: lbt [<cca mode> [<threshold>]]
+void lbtCommand(int argc, char **argv) {
+  int mode, threshold = lbtthreshold;
+  if (argc >= 1) {
+    if (argc > 2 || !parseInt(argv[0], mode) || mode < 0 || mode > 3 || (argc == 2 && (!parseInt(argv[1], threshold) || threshold < -8 || threshold > 7))) {
+      Serial.print(F("Wrong parameters.\r\n"));
+      return;
+    }
+    RadioLock lock;
+    lbtmode = mode;
+    lbtthreshold = threshold;
+    for (int r = 0; r < NUM_RADIOS; r++) {
+      lbtConfigure(*radios[r]);
+    }
+  }
+
+  char line[64];
+  snprintf(line, sizeof(line), "\r\nListen before talk: CCA mode %d, threshold %d dB\r\n", lbtmode, lbtthreshold);
+  Serial.print(line);
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    const CcaStats &stats = radios[r]->ccaStats();
+    snprintf(line, sizeof(line), "%s sent %lu, deferrals %lu, failures %lu\r\n", radios[r]->name, (unsigned long)stats.sent,
+             (unsigned long)stats.deferrals, (unsigned long)stats.failures);
+    Serial.print(line);
+  }
+}
+
+void worCommand(int argc, char **argv) {
+  int interval = WOR_DEFAULT_INTERVAL_MS, rxtime = WOR_DEFAULT_RX_TIME;
+  if (argc > 2 || (argc >= 1 && (!parseInt(argv[0], interval) || interval < 1 || interval > WOR_MAX_INTERVAL_MS)) ||
+      (argc == 2 && (!parseInt(argv[1], rxtime) || rxtime < 0 || rxtime > WOR_MAX_RX_TIME))) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return;
+  }
+  if (wormode == 1) {
+    worStop();
+    if (argc == 0) {
+      return;
+    }
+  }
+  worStart(interval, rxtime);
+}
+
+// Receive mode on CC1 in WOR. The configuration before is kept in worsaved.
+void worStart(uint32_t intervalms, uint8_t rxtime) {
+  if (radioListening(0) || radioListening(1)) {
+    Serial.print(F("\r\nStop the other receive modes first (x).\r\n"));
+    return;
+  }
+  {
+    RadioLock lock;
+    profileCapture(radio1, worsaved);
+    radio1.setSidle();
+    worConfigure(radio1, intervalms, rxtime);
+    worArm(radio1);
+    worinterval = intervalms;
+    worrxtime = rxtime;
+    worseen = gdo0falls[0];
+    memset(&worstats, 0, sizeof(worstats));
+    worstats.startus = esp_timer_get_time();
+    wormode = 1;
+    receivingmode = 1;
+  }
+  stayAwake(SLEEP_AWAKE_AFTER_INPUT_MS);
+
+  char line[96];
+  snprintf(line, sizeof(line), "\r\nWake-on-Radio receive on CC1 every %lu ms, RX window %lu us\r\n", (unsigned long)intervalms,
+           (unsigned long)(intervalms * worRxDutyPpm(rxtime) / 1000));
+  Serial.print(line);
+  if (serialproto == PROTO_BIN) {
+    sendMetaFrame(0);
+  }
+}
+
+// Back to the configuration from before. SLEEP has lost the PATABLE and the TEST
+// registers, the profile restores them.
+void worStop() {
+  {
+    RadioLock lock;
+    wormode = 0;
+    receivingmode = 0;
+    radio1.setSidle();  // CS low wakes it
+    profileApply(radio1, worsaved);
+  }
+  Serial.print(F("\r\nWake-on-Radio receive stopped\r\n"));
+  printWorStats();
+}
+
+// Measured MCU duty cycle, configured radio duty cycle and the supply current they add up to
+void printWorStats() {
+  int64_t total = esp_timer_get_time() - worstats.startus;
+  uint32_t awakeppm = total > 0 ? (uint32_t)((total - worstats.sleepus) * 1000000 / total) : 1000000;
+  uint32_t rxppm = worRxDutyPpm(worrxtime);
+  uint32_t ua = worCurrentUa(rxppm, awakeppm);
+  char line[112];
+  snprintf(line, sizeof(line), "WOR %lu s: MCU awake %lu.%02lu %%, %lu sleeps, %lu radio wakes, %lu packets\r\n",
+           (unsigned long)(total / 1000000), (unsigned long)(awakeppm / 10000), (unsigned long)(awakeppm / 100 % 100),
+           (unsigned long)worstats.sleeps, (unsigned long)worstats.radiowakes, (unsigned long)worstats.packets);
+  Serial.print(line);
+  snprintf(line, sizeof(line), "Radio RX %lu.%02lu %% of %lu ms, estimated %lu.%02lu mA (CC1 and ESP32)\r\n",
+           (unsigned long)(rxppm / 10000), (unsigned long)(rxppm / 100 % 100), (unsigned long)worinterval,
+           (unsigned long)(ua / 1000), (unsigned long)(ua / 10 % 100));
+  Serial.print(line);
+}
+
+void powerCommand(int argc, char **argv) {
+  int mode;
+  if (argc > 1 || (argc == 1 && (!parseInt(argv[0], mode) || (mode != 0 && mode != 1)))) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return;
+  }
+  if (argc == 1) {
+    powersave = mode;
+    settingsstore.putBool("powersave", powersave);
+    if (!powersave) {
+      RadioLock lock;  // wakes both
+    }
+  }
+
+  char line[96];
+  Serial.print(F("\r\nPower save: "));
+  Serial.print(powersave ? F("Enabled") : F("Disabled"));
+  Serial.print(F("\r\n"));
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    const RadioPower &p = radiopower[r];
+    uint16_t asleep = radioPowerAsleepPermille(p);
+    uint32_t wakes = p.sleeps - (p.asleep ? 1 : 0);
+    snprintf(line, sizeof(line), "%s %s, %lu sleeps, asleep %u.%u %%, wake-up avg %lu us, max %lu us\r\n", radios[r]->name,
+             p.asleep ? "asleep" : "awake", (unsigned long)p.sleeps, asleep / 10, asleep % 10,
+             wakes ? (unsigned long)(p.wakeussum / wakes) : 0UL, (unsigned long)p.wakeusmax);
+    Serial.print(line);
+  }
+  int64_t total = esp_timer_get_time();
+  uint32_t asleep = total > 0 ? (uint32_t)(sleepstats.sleepus * 1000 / total) : 0;
+  snprintf(line, sizeof(line), "ESP32 light sleep %lu.%lu %%, %lu sleeps, wake-up late avg %lu us, max %lu us\r\n",
+           (unsigned long)(asleep / 10), (unsigned long)(asleep % 10), (unsigned long)sleepstats.sleeps,
+           sleepstats.timerwakes ? (unsigned long)(sleepstats.timerlateus / sleepstats.timerwakes) : 0UL,
+           (unsigned long)sleepstats.timerlatemax);
+  Serial.print(line);
+}
+
+// Radio lock hook: radios in SPWD are woken before the new holder talks to them. A radio
+// task only ever uses its own radio, every other task may use both.
+void radioLockHook() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  int own = -1;
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    if (self == taskloads[TASK_RADIO1 + r].handle) {
+      own = r;
+    }
+  }
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    if (own >= 0 && r != own) {
+      continue;
+    }
+    if (own < 0) {
+      radiopower[r].usedat = millis();
+    }
+    if (radiopower[r].asleep) {
+      radioPowerUp(*radios[r], radiopower[r]);
+      xTaskNotifyGive(taskloads[TASK_RADIO1 + r].handle);  // back to the short poll
+    }
+  }
+}
+
+void stayAwake(uint32_t ms) {
+  awakeat = millis();
+  awakems = ms;
+}
+
+// Light sleep only with nothing to do: no serial input, no packet in a ring, no button held,
+// no UI page that ticks. And either CC1 in WOR with no packet coming in (GDO0 high) or
+// waiting for the radio task, or power save with both radios down and nothing for them.
+bool canLightSleep() {
+  if (wormode == 1) {
+    if (fastRead(gdo0_1) || gdo0falls[0] != worseen) {
+      return false;
+    }
+  } else {
+    if (!powersave) {
+      return false;
+    }
+    for (int r = 0; r < NUM_RADIOS; r++) {
+      if ((!radiopower[r].asleep && !radios[r]->isDegraded()) || radioListening(r) || uxQueueMessagesWaiting(radiocmdqueue[r])) {
+        return false;
+      }
+    }
+  }
+  if (millis() - awakeat < awakems || Serial.available() || uistates[currentState].tick != NULL) {
+    return false;
+  }
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    for (int c = 0; c < NUM_RX_CONSUMERS; c++) {
+      if (ringCount(rxrings[r][c])) {
+        return false;
+      }
+    }
+  }
+  for (int b = 0; b < NUM_BUTTONS; b++) {
+    if (digitalRead(buttonpins[b]) == LOW) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Light sleep until a button is pressed, serial input, SLEEP_MAX_MS or (WOR) GDO0 rises.
+// The wakeup levels replace the interrupt types of the pins, so the edge interrupts are
+// off while asleep and put back afterwards.
+void lightSleep() {
+  bool radiowake = wormode == 1;
+  Serial.flush();
+  if (radiowake) {
+    gpio_intr_disable((gpio_num_t)gdo0_1);
+    gpio_wakeup_enable((gpio_num_t)gdo0_1, GPIO_INTR_HIGH_LEVEL);
+  }
+  for (int b = 0; b < NUM_BUTTONS; b++) {
+    gpio_intr_disable((gpio_num_t)buttonpins[b]);
+    gpio_wakeup_enable((gpio_num_t)buttonpins[b], GPIO_INTR_LOW_LEVEL);
+  }
+  esp_sleep_enable_gpio_wakeup();
+  uart_set_wakeup_threshold(UART_NUM_0, SLEEP_UART_WAKE_EDGES);
+  esp_sleep_enable_uart_wakeup(UART_NUM_0);
+  esp_sleep_enable_timer_wakeup((uint64_t)SLEEP_MAX_MS * 1000);
+
+  int64_t start = esp_timer_get_time();
+  esp_light_sleep_start();
+  int64_t slept = esp_timer_get_time() - start;
+  sleepstats.sleepus += slept;
+  sleepstats.sleeps++;
+
+  if (radiowake) {
+    worstats.sleepus += slept;
+    worstats.sleeps++;
+    gpio_wakeup_disable((gpio_num_t)gdo0_1);
+    gpio_set_intr_type((gpio_num_t)gdo0_1, GPIO_INTR_NEGEDGE);
+    gpio_intr_enable((gpio_num_t)gdo0_1);
+  }
+  bool pressed = false;
+  for (int b = 0; b < NUM_BUTTONS; b++) {
+    gpio_wakeup_disable((gpio_num_t)buttonpins[b]);
+    gpio_set_intr_type((gpio_num_t)buttonpins[b], GPIO_INTR_ANYEDGE);
+    gpio_intr_enable((gpio_num_t)buttonpins[b]);
+    pressed |= digitalRead(buttonpins[b]) == LOW;
+  }
+
+  switch (esp_sleep_get_wakeup_cause()) {
+    case ESP_SLEEP_WAKEUP_UART:
+      stayAwake(SLEEP_AWAKE_AFTER_INPUT_MS);
+      break;
+    case ESP_SLEEP_WAKEUP_TIMER:
+      if (slept > (int64_t)SLEEP_MAX_MS * 1000) {
+        uint32_t late = slept - (int64_t)SLEEP_MAX_MS * 1000;
+        sleepstats.timerwakes++;
+        sleepstats.timerlateus += late;
+        if (late > sleepstats.timerlatemax) {
+          sleepstats.timerlatemax = late;
+        }
+      }
+      break;
+    case ESP_SLEEP_WAKEUP_GPIO:
+      if (pressed) {
+        // the press edge came while the interrupt was off, let the debouncer see it
+        stayAwake(SLEEP_AWAKE_AFTER_BUTTON_MS);
+        xTaskNotifyGive(taskloads[TASK_UI].handle);
+      } else if (radiowake) {
+        worstats.radiowakes++;
+        if (!fastRead(gdo0_1)) {
+          gdo0falls[0]++;  // a short packet ended before the interrupt was back
+          xTaskNotifyGive(taskloads[TASK_RADIO1].handle);
+        }
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// RX STATS menu page: packets, CRC fails and RSSI of the current frequency of each radio
+void drawStatsPage() {
+  char lines[NUM_RADIOS + 1][32];
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    const RxStats *s = rxStatsCurrent(rxstats[r]);
+    if (s == NULL) {
+      snprintf(lines[r], sizeof(lines[r]), "%s no packets", radios[r]->name);
+    } else {
+      snprintf(lines[r], sizeof(lines[r]), "%s %lu pk %lu crc %ld", radios[r]->name, (unsigned long)s->packets,
+               (unsigned long)s->crcfails, s->packets ? (long)(s->rssisum / (int32_t)s->packets) : 0L);
+    }
+  }
+  snprintf(lines[NUM_RADIOS], sizeof(lines[NUM_RADIOS]), "pk / crc fails / dBm");
+  displayInfo("RX STATS", lines[0], lines[1], lines[2]);
+}
+
+// Bar / sparkline pixel for a dBm value
+int meterScale(int dbm, int span) {
+  return (constrain(dbm, METER_MIN_DBM, METER_MAX_DBM) - METER_MIN_DBM) * span / (METER_MAX_DBM - METER_MIN_DBM);
+}
+
+// Radios not used by a receive mode are put into RX for the meter and back to IDLE after
+void meterEnter() {
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    RssiMeter &m = meters[r];
+    m.peak = m.slowmax = m.last = METER_MIN_DBM;
+    m.peakat = 0;
+    memset(m.history, METER_MIN_DBM, sizeof(m.history));
+    m.head = 0;
+  }
+  meterslow = 0;
+  {
+    RadioLock lock;
+    for (int r = 0; r < NUM_RADIOS; r++) {
+      if (!radioListening(r)) {
+        radios[r]->SetRx();
+      }
+    }
+  }
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setTextColor(SSD1306_WHITE);
+}
+
+void meterLeave() {
+  RadioLock lock;
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    if (!radioListening(r)) {
+      radios[r]->setSidle();
+    }
+  }
 }
 
-void loop() {
-  SELECT_BUTTON.loop();
-  UP_BUTTON.loop();
-  DOWN_BUTTON.loop();
-  //handleMenuSelection();
-  switch (currentState) {
-    case STATE_MENU:
-      handleMenuSelection();
-      break;
-    case STATE_CC_JAM:
-      Serial.println(F("Jamming Mode Activated"));
-
-      jammingmode = 1;    // Ensure jamming mode is set
-      receivingmode = 0;  // Disable receiving mode
-
-      while (jammingmode) {  // Stay in this loop until the button is pressed again
-        if (isButtonPressed(SELECT_BUTTON_PIN)) {
-          Serial.println(F("Exiting Jamming Mode"));
-          jammingmode = 0;
-          currentState = STATE_MENU;
-          drawMenu();
-          nonBlockingDelay(500);  // Debounce
-          return;
-        }
+void drawMeterText(int r, int y) {
+  const RssiMeter &m = meters[r];
+  char line[24];
+  snprintf(line, sizeof(line), "%s %4d pk%4d dBm", radios[r]->name, m.last, m.peak);
+  display.fillRect(0, y, SCREEN_WIDTH, 8, SSD1306_BLACK);
+  display.setCursor(0, y);
+  display.print(line);
+}
 
-        // Send random RF data continuously
-        randomSeed(analogRead(0));
-        for (int i = 0; i < 60; i++) {
-          ccsendingbuffer[i] = (byte)random(255);
-        }
-        CC1.SendData(ccsendingbuffer, 60);
-        CC2.SendData(ccsendingbuffer, 60);
+void drawMeterBar(int r, int y) {
+  const RssiMeter &m = meters[r];
+  display.fillRect(0, y, SCREEN_WIDTH, 8, SSD1306_BLACK);
+  display.fillRect(0, y + 1, meterScale(m.last, SCREEN_WIDTH), 6, SSD1306_WHITE);
+  display.drawFastVLine(constrain(meterScale(m.peak, SCREEN_WIDTH), 0, SCREEN_WIDTH - 1), y, 8, SSD1306_WHITE);
+}
 
-        nonBlockingDelay(10);  // Adjust transmission speed
-      }
+void drawMeterSparkline(int r, int y) {
+  const RssiMeter &m = meters[r];
+  display.fillRect(0, y, SCREEN_WIDTH, 16, SSD1306_BLACK);
+  for (int i = 0; i < METER_HISTORY; i++) {
+    int h = meterScale(m.history[(m.head + i) % METER_HISTORY], 16);
+    if (h > 0) {
+      display.drawFastVLine(i, y + 16 - h, h, SSD1306_WHITE);
+    }
+  }
+}
 
-      break;
-    case STATE_CC1_SINGLE:
-      Serial.println(F("Jamming Mode Activated"));
-
-      jammingmode = 1;    // Ensure jamming mode is set
-      receivingmode = 0;  // Disable receiving mode
-
-      while (jammingmode) {  // Stay in this loop until the button is pressed again
-        if (isButtonPressed(SELECT_BUTTON_PIN)) {
-          Serial.println(F("Exiting Jamming Mode"));
-          jammingmode = 0;
-          currentState = STATE_MENU;
-          drawMenu();
-          nonBlockingDelay(500);  // Debounce
-          return;
-        }
+// One meter sample of both radios
+void meterTick() {
+  int rssi[NUM_RADIOS];
+  {
+    RadioLock lock;
+    for (int r = 0; r < NUM_RADIOS; r++) {
+      rssi[r] = radios[r]->getRssi();
+    }
+  }
+  bool slow = ++meterslow >= METER_SLOW_EVERY;
+  if (slow) {
+    meterslow = 0;
+  }
+  uint32_t now = millis();
+
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    RssiMeter &m = meters[r];
+    int y = r * 32;
+    m.last = rssi[r];
+    if (rssi[r] >= m.peak || now - m.peakat > METER_PEAK_HOLD_MS) {
+      m.peak = rssi[r];
+      m.peakat = now;
+    }
+    if (rssi[r] > m.slowmax) {
+      m.slowmax = rssi[r];
+    }
+    drawMeterBar(r, y + 8);
+    if (slow) {
+      m.history[m.head] = constrain(m.slowmax, METER_MIN_DBM, METER_MAX_DBM);
+      m.head = (m.head + 1) % METER_HISTORY;
+      m.slowmax = METER_MIN_DBM;
+      drawMeterText(r, y);
+      drawMeterSparkline(r, y + 16);
+    }
+  }
+  showDisplay();
+}
 
-        // Send random RF data continuously
-        randomSeed(analogRead(0));
-        for (int i = 0; i < 60; i++) {
-          ccsendingbuffer[i] = (byte)random(255);
-        }
-        CC1.SendData(ccsendingbuffer, 60);
+// Puts the cursor on a sample and scrolls the screen to it at the given zoom
+void waveMove(int32_t cursor, uint8_t zoom) {
+  int32_t samples = waveSamples(wave);
+  int32_t width = (int32_t)SCREEN_WIDTH << zoom;
+  wavecursor = constrain(cursor, 0, samples - 1);
+  int32_t pos = constrain((int32_t)wavecursor - (WAVE_CURSOR_X << zoom), 0, max(samples - width, (int32_t)0));
+  wavezoom = zoom;
+  wavepos = (uint32_t)pos >> zoom << zoom;
+}
 
-        nonBlockingDelay(10);  // Adjust transmission speed
-      }
+void drawWave() {
+  char line[32];
+  display.clearDisplay();
+  display.setCursor(0, 0);
+  snprintf(line, sizeof(line), "1:%lu @%lu %s", 1UL << wavezoom, (unsigned long)wavecursor, wavezooming ? "ZOOM" : "PAN");
+  display.print(line);
+
+  // One column per 1 << wavezoom samples: a dot on the high or low line, a vertical
+  // line where the column holds an edge or starts with one
+  uint8_t prev = 0;
+  for (int x = 0; x < SCREEN_WIDTH; x++) {
+    uint8_t flags = waveSpan(wave, wavepos + ((uint32_t)x << wavezoom), wavezoom);
+    if (flags == (WAVE_HIGH | WAVE_LOW) || (flags && prev && flags != prev)) {
+      display.drawFastVLine(x, WAVE_HIGH_Y, WAVE_LOW_Y - WAVE_HIGH_Y + 1, SSD1306_WHITE);
+    } else if (flags == WAVE_HIGH) {
+      display.drawPixel(x, WAVE_HIGH_Y, SSD1306_WHITE);
+    } else if (flags == WAVE_LOW) {
+      display.drawPixel(x, WAVE_LOW_Y, SSD1306_WHITE);
+    }
+    prev = flags;
+  }
+  int cx = (wavecursor - wavepos) >> wavezoom;
+  for (int y = WAVE_HIGH_Y - 4; y <= WAVE_LOW_Y + 4; y += 2) {
+    display.drawPixel(cx, y, SSD1306_INVERSE);
+  }
 
-      break;
-    case STATE_CC2_SINGLE:
-      Serial.println(F("Jamming Mode Activated"));
-
-      jammingmode = 1;    // Ensure jamming mode is set
-      receivingmode = 0;  // Disable receiving mode
-
-      while (jammingmode) {  // Stay in this loop until the button is pressed again
-        if (isButtonPressed(SELECT_BUTTON_PIN)) {
-          Serial.println(F("Exiting Jamming Mode"));
-          jammingmode = 0;
-          currentState = STATE_MENU;
-          drawMenu();
-          nonBlockingDelay(500);  // Debounce
-          return;
-        }
+  // Pulse under the cursor and the one after it
+  uint32_t start, next;
+  uint32_t width = waveRun(wave, wavecursor, &start);
+  uint32_t after = waveRun(wave, start + width, &next);
+  char level = waveSample(wave, wavecursor) ? 'H' : 'L';
+  char other = level == 'H' ? 'L' : 'H';
+  if (rawinterval > 0) {
+    snprintf(line, sizeof(line), "%c %luus %c %luus", level, (unsigned long)width * rawinterval, other, (unsigned long)after * rawinterval);
+  } else {
+    snprintf(line, sizeof(line), "%c %lu %c %lu samples", level, (unsigned long)width, other, (unsigned long)after);
+  }
+  display.setCursor(0, 56);
+  display.print(line);
+  showDisplay();
+}
 
-        // Send random RF data continuously
-        randomSeed(analogRead(0));
-        for (int i = 0; i < 60; i++) {
-          ccsendingbuffer[i] = (byte)random(255);
-        }
-        CC2.SendData(ccsendingbuffer, 60);
+// Summaries of the current capture, opened on the whole of it
+void waveEnter() {
+  waveBuild(wave, bigrecordingbuffer, RECORDINGBUFFERSIZE, wavestore, sizeof(wavestore));
+  wavemaxzoom = 0;
+  while (((uint32_t)SCREEN_WIDTH << wavemaxzoom) < waveSamples(wave)) {
+    wavemaxzoom++;
+  }
+  wavezooming = false;
+  waveselectat = 0;
+  waveMove(0, wavemaxzoom);
+  display.setTextSize(1);
+  display.setTextColor(SSD1306_WHITE);
+  drawWave();
+}
 
-        nonBlockingDelay(10);  // Adjust transmission speed
+void waveButton(ButtonId button) {
+  int32_t step = (int32_t)WAVE_PAN_COLUMNS << wavezoom;
+  switch (button) {
+    case BUTTON_UP:
+      if (!wavezooming) {
+        waveMove((int32_t)wavecursor - step, wavezoom);
+      } else if (wavezoom > 0) {
+        waveMove(wavecursor, wavezoom - 1);
       }
-
       break;
-    case STATE_REC_RAW:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Record RAW Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
+    case BUTTON_DOWN:
+      if (!wavezooming) {
+        waveMove((int32_t)wavecursor + step, wavezoom);
+      } else if (wavezoom < wavemaxzoom) {
+        waveMove(wavecursor, wavezoom + 1);
       }
       break;
-
-    case STATE_PLAY_RAW:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Play RAW Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
-      }
+    case BUTTON_SELECT:
+      wavezooming = !wavezooming;
+      waveselectat = millis() | 1;
       break;
-
-    case STATE_SHOW_RAW:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Show RAW Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
-      }
+    default:
       break;
+  }
+  drawWave();
+}
 
-    case STATE_SHOW_BUFF:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Show Buffer Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
-      }
-      break;
+// Only watches for SELECT being held, the screen is redrawn by waveButton()
+void waveTick() {
+  if (waveselectat && buttons[BUTTON_SELECT]->getState() == LOW) {
+    if (millis() - waveselectat >= WAVE_EXIT_HOLD_MS) {
+      waveselectat = 0;
+      exitToMenu();
+    }
+  } else {
+    waveselectat = 0;
+  }
+}
 
-    case STATE_FLUSH_BUFF:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Flush Buffer Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
-      }
-      break;
+// Function to handle WAVE command
+void showWaveform() {
+  postAppEvent(STATE_WAVE_VIEW);
+  Serial.print(F("\r\nWaveform on the display. UP / DOWN: move, SELECT: move / zoom, hold SELECT to leave.\r\n\r\n"));
+}
 
-    case STATE_GET_RSSI:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Get RSSI Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
-      }
-      break;
+// Loopback test point as "433.920 MHz  38.4 kBd"
+void loopbackPointName(const LoopbackPoint &point, char *out, size_t size) {
+  snprintf(out, size, "%lu.%03lu MHz %3lu.%lu kBd", (unsigned long)(point.hz / 1000000), (unsigned long)(point.hz / 1000 % 1000),
+           (unsigned long)(point.baud / 1000), (unsigned long)(point.baud % 1000 / 100));
+}
 
-    case STATE_STOP_ALL:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Stop All Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
-      }
-      break;
+void loopbackProgress() {
+  char name[24], count[24];
+  loopbackPointName(loopback.points[loopback.point], name, sizeof(name));
+  snprintf(count, sizeof(count), "%u / %u received", loopback.result.received, loopback.result.sent);
+  displayInfo(loopback.calibrate < 0 ? "SELF-TEST" : "CALIBRATE", loopback.tx == 0 ? "CC1 -> CC2" : "CC2 -> CC1", name, count);
+}
 
-    case STATE_RESET_CC:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Reset CC Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
-      }
-      break;
+// Both radios on the settings of the current test point, the receiver in RX.
+// Called with the radio lock held.
+void loopbackStartPoint() {
+  RadioProfile image = loopback.saved[0];
+  loopbackImage(image, loopback.points[loopback.point]);
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    if (!profileApply(*radios[r], image)) {
+      Serial.print(radios[r]->name);
+      Serial.print(F(" did not take the test settings\r\n"));
+    }
+  }
+  radios[1 - loopback.tx]->SetRx();
+  memset(&loopback.result, 0, sizeof(loopback.result));
+  loopback.seq = 0;
+  loopback.inflight = false;
+  loopback.startat = micros();
+  loopbackProgress();
+}
 
-    case STATE_SET_43390:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Set 433.92 Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
-      }
-      break;
+void loopbackReport() {
+  const LoopbackResult &res = loopback.result;
+  uint16_t per = loopbackPer(res);
+  int32_t offset = loopbackOffsetHz(res);
+  char name[24], line[160];
+  loopbackPointName(loopback.points[loopback.point], name, sizeof(name));
+  snprintf(line, sizeof(line), "%s > %s %s: %u/%u, PER %u.%u%%, crc %u, RSSI %ld dBm, LQI %lu, offset %c%ld.%ld kHz, %lu B/s, TX timeouts %u\r\n",
+           radios[loopback.tx]->name, radios[1 - loopback.tx]->name, name, res.received, res.sent, per / 10, per % 10, res.crcfails,
+           res.received ? (long)(res.rssisum / res.received) : 0L, res.received ? (unsigned long)(res.lqisum / res.received) : 0UL,
+           offset < 0 ? '-' : '+', (long)(abs(offset) / 1000), (long)(abs(offset) % 1000 / 100), (unsigned long)loopbackThroughput(res),
+           res.txtimeouts);
+  Serial.print(line);
+  // a sender that does not get its packets out fails the test point, whatever arrived
+  if (res.txtimeouts == 0 && per < LOOPBACK_MAX_PER) {
+    loopback.passed++;
+  }
+}
 
-    case STATE_SET_43400:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Set 434.00 Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
-      }
-      break;
+// Puts the radios back as they were. Called with the radio lock held.
+void loopbackRestore() {
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    profileApply(*radios[r], loopback.saved[r]);
+  }
+  loopback.active = false;
+}
 
-    case STATE_SET_43440:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Set 434.40 Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
-      }
-      break;
+void loopbackEnter() {
+  if (loopback.active) {
+    return;  // "selftest" while it runs
+  }
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    if (radioListening(r)) {
+      Serial.print(F("\r\nThe self-test needs both radios, stop receiving first (x).\r\n"));
+      postAppEvent(STATE_MENU);
+      return;
+    }
+  }
+  loopback.calibrate = calibrateradio;
+  calibrateradio = -1;
+  char line[96];
+  if (loopback.calibrate < 0) {
+    loopback.points = loopbackpoints;
+    loopback.numpoints = NUM_LOOPBACK_POINTS;
+    loopback.tx = 0;
+    snprintf(line, sizeof(line), "\r\nLoopback self-test: %u packets per test point, -30 dBm, SELECT stops\r\n", LOOPBACK_PACKETS);
+  } else {
+    loopback.points = &calibrationpoint;
+    loopback.numpoints = 1;
+    loopback.tx = 1 - loopback.calibrate;
+    snprintf(line, sizeof(line), "\r\nCalibrating %s against %s, SELECT stops\r\n", radios[loopback.calibrate]->name, radios[loopback.tx]->name);
+  }
+  Serial.print(line);
 
-    case STATE_SET_43430:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Set 434.30 Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
-      }
-      break;
+  RadioLock lock;
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    profileCapture(*radios[r], loopback.saved[r]);
+  }
+  loopback.active = true;
+  loopback.point = 0;
+  loopback.passed = 0;
+  loopbackStartPoint();
+}
 
-    case STATE_TEST_CC1101:
-      if (isButtonPressed(SELECT_BUTTON_PIN)) {
-        Serial.println(F("Exiting Test CC1101 Mode"));
-        currentState = STATE_MENU;
-        drawMenu();
-        nonBlockingDelay(500);  // Debounce
-        return;
+void loopbackLeave() {
+  if (loopback.active) {
+    RadioLock lock;
+    loopbackRestore();
+    Serial.print(loopback.calibrate < 0 ? F("Self-test stopped.\r\n") : F("Calibration stopped, nothing changed.\r\n"));
+  }
+}
+
+void loopbackTick() {
+  if (!loopback.active) {
+    return;
+  }
+  const LoopbackPoint &point = loopback.points[loopback.point];
+  RadioPort &tx = *radios[loopback.tx];
+  RadioPort &rx = *radios[1 - loopback.tx];
+  RadioLock lock;
+
+  if (!loopback.inflight) {
+    byte payload[LOOPBACK_PAYLOAD];
+    loopbackPayload(payload, loopback.point, loopback.seq);
+    // the same TX path as every other packet, no listen before talk on the test link
+    if (tx.sendAsync(payload, LOOPBACK_PAYLOAD, TX_TIMEOUT_MS)) {
+      loopback.sentat = micros();
+      loopback.inflight = true;
+    }
+    return;
+  }
+
+  // The sender first. The radio task polls it too (on GDO0), whoever sees the end
+  // leaves it in txResult().
+  if (tx.txBusy() && tx.txPoll() == TX_BUSY) {
+    return;
+  }
+  if (tx.txResult() != TX_DONE) {
+    // never on air, not a packet the receiver lost
+    loopback.result.txtimeouts++;
+  } else {
+    // The receiver drops to IDLE after a packet (MCSM1), otherwise give up on it
+    // after twice the airtime
+    bool rxidle = (rx.SpiReadStatus(CC1101_MARCSTATE) & 0x1F) == 0x01;
+    if (!rxidle && micros() - loopback.sentat < 2 * loopbackAirtimeUs(point) + LOOPBACK_SLACK_US) {
+      return;
+    }
+    byte buf[64];
+    byte status[2] = { 0, 0 };
+    byte len = 0;
+    byte rxbytes = rx.SpiReadStatus(CC1101_RXBYTES);
+    if (rxidle && !(rxbytes & 0x80) && (rxbytes & 0x7F) > 0) {
+      len = rx.SpiReadReg(CC1101_RXFIFO);
+      if (len <= sizeof(buf) && len + 3 == (rxbytes & 0x7F)) {  // length byte, payload, RSSI, LQI
+        rx.SpiReadBurstReg(CC1101_RXFIFO, buf, len);
+        rx.SpiReadBurstReg(CC1101_RXFIFO, status, 2);
+      } else {
+        len = 0;
       }
-      break;
+    }
+    int8_t freqest = (int8_t)rx.SpiReadStatus(CC1101_FREQEST);
+    loopbackAccount(loopback.result, loopback.point, loopback.seq, buf, len, status, freqest);
+  }
+  rx.setSidle();
+  rx.SpiStrobe(CC1101_SFRX);
+  rx.SetRx();
+  loopback.inflight = false;
+
+  if (++loopback.seq < LOOPBACK_PACKETS) {
+    if (loopback.seq % 5 == 0) {
+      loopbackProgress();
+    }
+    return;
+  }
+  loopback.result.us = micros() - loopback.startat;
+  if (loopback.calibrate >= 0) {
+    calibrateFinish();
+    return;
+  }
+  loopbackReport();
+  if (++loopback.point == loopback.numpoints) {
+    loopback.point = 0;
+    loopback.tx++;
+  }
+  if (loopback.tx < NUM_RADIOS) {
+    loopbackStartPoint();
+    return;
   }
 
-  // index for serial port characters
-  int i = 0;
+  loopbackRestore();
+  char line[64];
+  snprintf(line, sizeof(line), "Self-test done: %u of %u test points passed.\r\n", loopback.passed, (unsigned)(NUM_LOOPBACK_POINTS * NUM_RADIOS));
+  Serial.print(line);
+  snprintf(line, sizeof(line), "%u / %u passed", loopback.passed, (unsigned)(NUM_LOOPBACK_POINTS * NUM_RADIOS));
+  displayInfo("SELF-TEST", "Done", line, "SELECT: menu");
+}
 
-  /* Process incoming commands. */
-  while (Serial.available()) {
-    static char buffer[BUF_LENGTH];
-    static int length = 0;
+// End of "calibrate": the receiver's new crystal error from what it measured.
+// Called with the radio lock held.
+void calibrateFinish() {
+  int r = loopback.calibrate;
+  RadioPort &cc = *radios[r];
+  const LoopbackResult &res = loopback.result;
+  char line[128];
+  if (res.received < CALIBRATION_MIN_PACKETS) {
+    loopbackRestore();
+    snprintf(line, sizeof(line), "Calibration failed: %s received %u of %u packets (%u TX timeouts), nothing changed.\r\n", cc.name, res.received,
+             res.sent, res.txtimeouts);
+    Serial.print(line);
+    displayInfo("CALIBRATE", cc.name, "Failed", "SELECT: menu");
+    return;
+  }
+  // FREQOFF in effect during the test plus the mean FREQEST, both in fxosc / 2^14 steps
+  int8_t freqoff = (int8_t)cc.SpiReadReg(CC1101_FSCTRL0);
+  int64_t offsethz = ((int64_t)freqoff * res.received + res.freqestsum) * 26000000 / 16384 / res.received;
+  int32_t ppb = offsethz * 1000000000 / (int64_t)calibrationpoint.hz;
+  cc.setFreqCorrection(ppb);
+  settingsstore.putInt(freqcorrkeys[r], ppb);
+  loopbackRestore();  // re-tunes with the new correction
+
+  snprintf(line, sizeof(line), "%s calibrated against %s: %+ld Hz at 433.92 MHz (%+ld ppb), stored.\r\n", cc.name, radios[loopback.tx]->name,
+           (long)offsethz, (long)ppb);
+  Serial.print(line);
+  snprintf(line, sizeof(line), "%+ld Hz", (long)offsethz);
+  displayInfo("CALIBRATE", cc.name, line, "SELECT: menu");
+}
 
-    // handling CHAT MODE
-    if (chatmode == 1) {
+// Loads the stored crystal errors into the radio ports, before the radios are tuned
+void loadFreqCorrections() {
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    int32_t ppb = settingsstore.getInt(freqcorrkeys[r], FREQ_CORR_NONE);
+    if (ppb != FREQ_CORR_NONE) {
+      radios[r]->setFreqCorrection(ppb);
+    }
+  }
+}
 
-      // clear serial port buffer index
-      i = 0;
+// Function to handle CALIBRATE command
+void calibrateCommand(int argc, char **argv) {
+  if (argc == 0) {
+    char line[64];
+    for (int r = 0; r < NUM_RADIOS; r++) {
+      if (radios[r]->hasFreqCorrection()) {
+        snprintf(line, sizeof(line), "%s crystal correction %+ld ppb\r\n", radios[r]->name, (long)radios[r]->freqCorrection());
+      } else {
+        snprintf(line, sizeof(line), "%s not calibrated, driver defaults\r\n", radios[r]->name);
+      }
+      Serial.print(line);
+    }
+    return;
+  }
+  int radio;
+  if (argc > 2 || !parseInt(argv[0], radio) || radio < 1 || radio > NUM_RADIOS || (argc == 2 && strcmp(argv[1], "clear") != 0)) {
+    Serial.print(F("Wrong parameters.\r\n"));
+    return;
+  }
+  radio--;
+  if (loopback.active) {
+    Serial.print(F("Self-test running.\r\n"));
+    return;
+  }
+  if (argc == 2) {
+    radios[radio]->clearFreqCorrection();
+    settingsstore.remove(freqcorrkeys[radio]);
+    Serial.print(F("Correction cleared, the driver defaults apply from the next frequency change.\r\n"));
+    return;
+  }
+  calibrateradio = radio;
+  postAppEvent(STATE_TEST_CC1101);
+}
 
-      // something was received over serial port put it into radio sending buffer
-      while (Serial.available() and (i < (CCBUFFERSIZE - 1))) {
-        // read single character from Serial port
-        ccsendingbuffer[i] = Serial.read();
+// Function to handle SELFTEST command
+void selfTest() {
+  postAppEvent(STATE_TEST_CC1101);
+}
 
-        // also put it as ECHO back to serial port
-        Serial.write(ccsendingbuffer[i]);
+// Empties every ring. Packets queued before their mode was switched off are dropped.
+void drainRxRings() {
+  const RxPacket *pkt;
+  RxPacket best;
 
-        // if CR was received add also LF character and display it on Serial port
-        if (ccsendingbuffer[i] == 0x0d) {
-          Serial.write(0x0a);
-          i++;
-          ccsendingbuffer[i] = 0x0a;
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    for (int c = 0; c < NUM_RX_CONSUMERS; c++) {
+      if (c == RX_MERGER && rxConsumerActive(c)) {
+        continue;  // drained in order across radios below
+      }
+      while ((pkt = ringFront(rxrings[r][c])) != NULL) {
+        if (rxConsumerActive(c)) {
+          switch (c) {
+            case RX_PRINTER:
+              printPacket(*pkt);
+              break;
+            case RX_RECORDER:
+              recordPacket(*pkt);
+              break;
+            case RX_DECODER:
+              decodePacket(*pkt);
+              break;
+            case RX_DIVERSITY:
+              if (diversityOffer(diversitywindow, *pkt, best)) {
+                printTaggedPacket(best);
+              }
+              break;
+          }
         }
-        //
-
-        // increase CC1101 TX buffer position
-        i++;
-      };
+        ringRelease(rxrings[r][c]);
+      }
+    }
+  }
+  // the CLI task wakes every CLI_POLL_MS, which closes the windows in time
+  if (diversitymode == 1) {
+    while (diversityTake(diversitywindow, micros(), false, best)) {
+      printTaggedPacket(best);
+    }
+  }
+  if (dualrxmode == 1) {
+    drainMergedRings();
+  }
+}
 
-      // put NULL at the end of CC transmission buffer
-      ccsendingbuffer[i] = '\0';
+void processSerialInput() {
+  /* Process incoming commands. */
+  while (Serial.available()) {
+    static char buffer[BUF_LENGTH];
+    static int length = 0;
 
-      // send these data to radio over CC1101
-      CC1.SendData((char *)ccsendingbuffer);
+    // handling CHAT MODE
+    if (chatmode == 1) {
+      chatInput(Serial.read());
+    }
+    // binary protocol, only command frames are accepted
+    else if (serialproto == PROTO_BIN) {
+      readFrameByte(Serial.read());
     }
     // handling CLI commands processing
     else {
@@ -2082,6 +4837,8 @@ void loop() {
         if (do_echo)
           Serial.write("\r\n");  // output CRLF
         buffer[length] = '\0';
+        length = 0;
+        executeCommandLine(buffer);
       } else if (length < BUF_LENGTH - 1) {
         buffer[length++] = data;
         if (do_echo)
@@ -2090,74 +4847,309 @@ void loop() {
     };
     // end of handling CLI processing
   };
+}
 
-  /* Process RF received packets */
-
-  // Checks whether something has been received.
-  if (CC1.CheckReceiveFlag() && (receivingmode == 1 || recordingmode == 1 || chatmode == 1)) {
-
-    // CRC Check. If "setCrc(false)" crc returns always OK!
-    if (CC1.CheckCRC()) {
-      // Get received Data and calculate length
-      int len = CC1.ReceiveData(ccreceivingbuffer);
-
-      // Actions for CHAT MODE
-      if ((chatmode == 1) && (len < CCBUFFERSIZE)) {
-        // put NULL at the end of char buffer
-        ccreceivingbuffer[len] = '\0';
-        // Print received in char format.
-        Serial.print((char *)ccreceivingbuffer);
-      };  // end of handling Chat mode
-
-      // Actions for RECEIVNG MODE
-      if (((receivingmode == 1) && (recordingmode == 0)) && (len < CCBUFFERSIZE)) {
-        // put NULL at the end of char buffer
-        ccreceivingbuffer[len] = '\0';
-        // flush textbuffer
-        for (int i = 0; i < BUF_LENGTH; i++) {
-          textbuffer[i] = 0;
-        };
-
-        // Print received packet as set of hex values directly
-        //  not to loose any data in buffer
-        //  asciitohex((byte *)ccreceivingbuffer, (byte *)textbuffer,  len);
-        asciitohex(ccreceivingbuffer, textbuffer, len);
-        Serial.print((char *)textbuffer);
-        // set RX  mode again
-        CC1.SetRx();
-      };  // end of handling receiving mode
-
-      // Actions for RECORDING MODE
-      if (((recordingmode == 1) && (receivingmode == 0)) && (len < CCBUFFERSIZE)) {
-        // copy the frame from receiving buffer for replay - only if it fits
-        if ((bigrecordingbufferpos + len + 1) < RECORDINGBUFFERSIZE) {  // put info about number of bytes
-          bigrecordingbuffer[bigrecordingbufferpos] = len;
-          bigrecordingbufferpos++;
-          // next - copy current frame and increase
-          memcpy(&bigrecordingbuffer[bigrecordingbufferpos], ccreceivingbuffer, len);
-          // increase position in big recording buffer for next frame
-          bigrecordingbufferpos = bigrecordingbufferpos + len;
-          // increase counter of frames stored
-          framesinbigrecordingbuffer++;
-          // set RX  mode again
-          CC1.SetRx();
-          Serial.print("\r\nAdded frame number ");
-          Serial.print(framesinbigrecordingbuffer);
-          Serial.print("\r\n");
-        } else {
-          Serial.print(F("Recording buffer full! Stopping..\r\nFrames stored: "));
-          Serial.print(framesinbigrecordingbuffer);
-          Serial.print(F("\r\n"));
-          bigrecordingbufferpos = 0;
-          recordingmode = 0;
-        };
-
-      };  // end of handling frame recording mode
-
-    };  // end of CRC check IF
-
-  };  // end of Check receive flag if
-
-  // if jamming mode activate continously send something over RF...
-
-}  // end of main LOOP
+void cliTask(void *param) {
+  for (;;) {
+    // woken by a radio task after a push, or by the timeout to poll the serial port
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CLI_POLL_MS));
+    taskLoadBegin(TASK_CLI);
+    drainRxRings();
+    if (Serial.available()) {
+      stayAwake(SLEEP_AWAKE_AFTER_INPUT_MS);
+    }
+    processSerialInput();
+    saveResumeState();
+    if (chatmode == 1) {
+      chatPoll(chatlink, millis());
+    }
+    taskLoadEnd(TASK_CLI);
+    // Modes that take CC1 over stop WOR themselves, this catches the rest (jamming, ...)
+    if (wormode == 1 && receivingmode == 0) {
+      worStop();
+    }
+    if (canLightSleep()) {
+      lightSleep();  // not CLI load
+    }
+  }
+}
+
+// Jamming states send one burst per tick, until SELECT or "x"
+void jamEnter() {
+  Serial.println(F("Jamming Mode Activated"));
+  jammingmode = 1;    // Ensure jamming mode is set
+  receivingmode = 0;  // Disable receiving mode
+}
+
+void jamLeave() {
+  jammingmode = 0;
+}
+
+void jamBurst(bool cc1, bool cc2) {
+  if (!jammingmode) {
+    postAppEvent(STATE_MENU);  // stopped from the CLI
+    return;
+  }
+  // Send random RF data continuously, through the radio tasks like any other packet.
+  // A burst is only queued once the last one is out, so nothing backs up.
+  RadioCommand cmd;
+  cmd.type = RADIO_CMD_SEND;
+  cmd.len = 60;
+  randomSeed(analogRead(0));
+  for (int i = 0; i < 60; i++) {
+    cmd.data[i] = (byte)random(255);
+  }
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    if ((r == 0 ? cc1 : cc2) && uxQueueMessagesWaiting(radiocmdqueue[r]) == 0 && !radios[r]->txBusy()) {
+      sendRadioCommand(r, cmd);
+    }
+  }
+}
+
+void jamTick() {
+  jamBurst(true, true);
+}
+
+void jamCc1Tick() {
+  jamBurst(true, false);
+}
+
+void jamCc2Tick() {
+  jamBurst(false, true);
+}
+
+// Raw record / replay from the menu, one slice per tick, then the result stays on screen
+void rawRecEnter() {
+  if (!rawBegin(RAW_RECORD, RAW_MENU_INTERVAL_US)) {
+    postAppEvent(STATE_RESULT);
+  }
+}
+
+void rawPlayEnter() {
+  if (!rawBegin(RAW_PLAY, RAW_MENU_INTERVAL_US)) {
+    postAppEvent(STATE_RESULT);
+  }
+}
+
+void rawTick() {
+  if (rawjob.active && !rawStep(RAW_SLICE_BYTES)) {
+    rawEnd();
+    postAppEvent(STATE_RESULT);
+  }
+}
+
+void rawLeave() {
+  if (rawjob.active) {
+    rawjob.active = false;
+    Serial.println(rawjob.mode == RAW_PLAY ? F("Replay stopped.") : F("Recording stopped."));
+  }
+}
+
+// The capture goes to serial one row per tick, the screen shows the start of it
+void rawShowEnter() {
+  if (serialproto == PROTO_TEXT) {
+    Serial.print(F("\r\nRecorded RAW data:\r\n"));
+  }
+  showRawScreen();
+  rawshowpos = 0;
+}
+
+void rawShowTick() {
+  rawshowpos += sendRawRow(rawshowpos);
+  if (rawshowpos >= RECORDINGBUFFERSIZE) {
+    if (serialproto == PROTO_TEXT) {
+      Serial.print(F("\r\n\r\n"));
+    }
+    postAppEvent(STATE_RESULT);
+  }
+}
+
+// Re-initializes one radio per tick, so the UI and the other radio's lock holders get
+// in between, then shows the SPI check of both
+void resetEnter() {
+  displayInfo("RESET_CC", "Resetting radios", "Resetting....");
+  resetstep = 0;
+}
+
+void resetTick() {
+  switch (resetstep++) {
+    case 0:
+      cc1101initialize();
+      break;
+    case 1:
+      cc1101initialize_2();
+      break;
+    default: {
+      bool ok1, ok2;
+      {
+        RadioLock lock;
+        ok1 = CC1.getCC1101();
+        ok2 = CC2.getCC1101();
+      }
+      Serial.print(F("CC1101 initialized, CC1 "));
+      Serial.print(ok1 ? F("OK") : F("ERROR"));
+      Serial.print(F(", CC2 "));
+      Serial.print(ok2 ? F("OK") : F("ERROR"));
+      Serial.print(F("\r\n"));
+      displayInfo("RESET_CC", ok1 ? "CC1 connection OK" : "CC1 ERROR, check wiring", ok2 ? "CC2 connection OK" : "CC2 ERROR, check wiring",
+                  "SELECT: menu");
+      postAppEvent(STATE_RESULT);
+      break;
+    }
+  }
+}
+
+// Indexed by AppState, checked at boot by checkUiStates()
+const UiState uistates[NUM_APP_STATES] = {
+  { STATE_MENU, "Menu", drawMenu, NULL, 0, NULL, NULL },
+  { STATE_CC_JAM, "Jamming", jamEnter, jamTick, 10, jamLeave, NULL },
+  { STATE_CC_SCAN, "Scan", NULL, scanTick, 10, NULL, NULL },
+  { STATE_CC1_SINGLE, "Jamming", jamEnter, jamCc1Tick, 10, jamLeave, NULL },
+  { STATE_CC2_SINGLE, "Jamming", jamEnter, jamCc2Tick, 10, jamLeave, NULL },
+  { STATE_REC_RAW, "Record RAW", rawRecEnter, rawTick, 0, rawLeave, NULL },
+  { STATE_PLAY_RAW, "Play RAW", rawPlayEnter, rawTick, 0, rawLeave, NULL },
+  { STATE_SHOW_RAW, "Show RAW", rawShowEnter, rawShowTick, RAW_SHOW_TICK_MS, NULL, NULL },
+  { STATE_SHOW_BUFF, "Show Buffer", NULL, NULL, 0, NULL, NULL },
+  { STATE_FLUSH_BUFF, "Flush Buffer", NULL, NULL, 0, NULL, NULL },
+  { STATE_GET_RSSI, "Get RSSI", meterEnter, meterTick, METER_TICK_MS, meterLeave, NULL },
+  { STATE_STOP_ALL, "Stop All", NULL, NULL, 0, NULL, NULL },
+  { STATE_RESET_CC, "Reset CC", resetEnter, resetTick, RESET_TICK_MS, NULL, NULL },
+  { STATE_SET_43440, "Set 434.40", NULL, NULL, 0, NULL, NULL },
+  { STATE_SET_43430, "Set 434.30", NULL, NULL, 0, NULL, NULL },
+  { STATE_SET_43400, "Set 434.00", NULL, NULL, 0, NULL, NULL },
+  { STATE_SET_43390, "Set 433.90", NULL, NULL, 0, NULL, NULL },
+  { STATE_TEST_CC1101, "Test CC1101", loopbackEnter, loopbackTick, LOOPBACK_TICK_MS, loopbackLeave, NULL },
+  { STATE_RX_STATS, "RX Stats", drawStatsPage, drawStatsPage, STATS_PAGE_MS, NULL, NULL },
+  { STATE_WAVE_VIEW, "Waveform", waveEnter, waveTick, WAVE_TICK_MS, NULL, waveButton },
+  { STATE_RESULT, "Result", NULL, NULL, 0, NULL, NULL },
+};
+
+void checkUiStates() {
+  for (int i = 0; i < NUM_APP_STATES; i++) {
+    if (uistates[i].state != i) {
+      Serial.print(F("UI state table out of order at "));
+      Serial.println(i);
+    }
+  }
+}
+
+// Any edge on a button pin: note when the press started and wake the UI task
+void IRAM_ATTR buttonIsr(void *arg) {
+  int b = (intptr_t)arg;
+  if (!buttonedgeus[b]) {
+    buttonedgeus[b] = micros() | 1;
+  }
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(taskloads[TASK_UI].handle, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+// Runs the debouncers and queues a ButtonEvent for every press.
+// Returns true while a button is still bouncing.
+bool pollButtons() {
+  bool moving = false;
+  for (int b = 0; b < NUM_BUTTONS; b++) {
+    ezButton &button = *buttons[b];
+    button.loop();
+    if (button.isPressed()) {
+      ButtonEvent event = { (ButtonId)b, buttonedgeus[b] ? buttonedgeus[b] : (uint32_t)(micros() | 1) };
+      xQueueSend(buttonqueue, &event, 0);
+      buttonedgeus[b] = 0;
+    }
+    if (button.getStateRaw() != button.getState()) {
+      moving = true;
+    } else if (button.getState() == HIGH) {
+      buttonedgeus[b] = 0;  // settled released, forget the release bounces
+    }
+  }
+  return moving;
+}
+
+void exitToMenu() {
+  Serial.print(F("Exiting "));
+  Serial.print(uistates[currentState].name);
+  Serial.println(F(" Mode"));
+  postAppEvent(STATE_MENU);
+}
+
+// Menu navigation in the menu, SELECT leaves every other state
+void handleButton(const ButtonEvent &event) {
+  uint32_t latency = micros() - event.edgeus;
+  buttonpresses++;
+  buttonlatencysum += latency;
+  if (latency > buttonlatencymax) {
+    buttonlatencymax = latency;
+  }
+
+  if (currentState == STATE_MENU) {
+    handleMenuSelection(event.button);
+  } else if (uistates[currentState].button) {
+    uistates[currentState].button(event.button);
+  } else if (event.button == BUTTON_SELECT) {
+    exitToMenu();
+  }
+}
+
+// One pass of the menu / screen state machine. Returns how long the UI task
+// may sleep before the next pass.
+uint32_t uiStep() {
+  static uint32_t lasttick = 0;
+  applyAppEvents();
+  bool moving = pollButtons();
+  ButtonEvent event;
+  while (xQueueReceive(buttonqueue, &event, 0) == pdTRUE) {
+    handleButton(event);
+  }
+
+  uint32_t wait = moving ? UI_POLL_MS : UI_IDLE_MS;
+  const UiState &ui = uistates[currentState];
+  if (ui.tick) {
+    if (millis() - lasttick >= ui.tickms) {
+      lasttick = millis();
+      ui.tick();
+    }
+    uint32_t elapsed = millis() - lasttick;
+    uint32_t left = (elapsed >= ui.tickms) ? 0 : ui.tickms - elapsed;
+    if (left < wait) {
+      wait = left;
+    }
+  }
+  return wait;
+}
+
+void uiTask(void *param) {
+  for (;;) {
+    taskLoadBegin(TASK_UI);
+    uint32_t wait = uiStep();
+    taskLoadEnd(TASK_UI);
+    // a button edge or a posted state change wakes us earlier
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait));
+  }
+}
+
+void startTasks() {
+  radioLockInit();
+  appeventqueue = xQueueCreate(APP_EVENT_QUEUE_LEN, sizeof(AppEvent));
+  buttonqueue = xQueueCreate(BUTTON_QUEUE_LEN, sizeof(ButtonEvent));
+  taskloadwindow = micros();
+
+  for (int r = 0; r < NUM_RADIOS; r++) {
+    radiocmdqueue[r] = xQueueCreate(RADIO_CMD_QUEUE_LEN, sizeof(RadioCommand));
+    xTaskCreatePinnedToCore(radioTask, taskloads[TASK_RADIO1 + r].name, RADIO_TASK_STACK, (void *)(intptr_t)r, RADIO_TASK_PRIO, &taskloads[TASK_RADIO1 + r].handle, RADIO_CORE);
+  }
+  xTaskCreatePinnedToCore(uiTask, taskloads[TASK_UI].name, UI_TASK_STACK, NULL, UI_TASK_PRIO, &taskloads[TASK_UI].handle, APP_CORE);
+  for (int b = 0; b < NUM_BUTTONS; b++) {
+    attachInterruptArg(buttonpins[b], buttonIsr, (void *)(intptr_t)b, CHANGE);
+  }
+  xTaskCreatePinnedToCore(cliTask, taskloads[TASK_CLI].name, CLI_TASK_STACK, NULL, CLI_TASK_PRIO, &taskloads[TASK_CLI].handle, APP_CORE);
+  radioLockSetHook(radioLockHook);
+}
+
+// ------- END OF TASKS ------------
+
+void loop() {
+  // Everything runs in the tasks started from setup()
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,202 @@
+#include "chat_link.h"
+#include <string.h>
+
+static inline bool bitGet(const uint8_t *map, int i) {
+  return map[i >> 3] & (1 << (i & 7));
+}
+
+static inline void bitSet(uint8_t *map, int i) {
+  map[i >> 3] |= 1 << (i & 7);
+}
+
+static bool bitAll(const uint8_t *map, int count) {
+  for (int i = 0; i < count; i++) {
+    if (!bitGet(map, i)) return false;
+  }
+  return true;
+}
+
+static inline uint16_t getSession(const uint8_t *frame) {
+  return frame[1] | (frame[2] << 8);
+}
+
+static inline void putSession(uint8_t *frame, uint16_t session) {
+  frame[1] = session & 0xFF;
+  frame[2] = session >> 8;
+}
+
+static void sendAck(ChatLink &link) {
+  uint8_t frame[CHAT_ACK_HEADER + CHAT_BITMAP_BYTES];
+  int bytes = (link.rxcount + 7) / 8;
+  frame[0] = CHAT_KIND_ACK;
+  putSession(frame, link.rxsession);
+  frame[3] = link.rxid;
+  frame[4] = link.rxcount;
+  memcpy(&frame[CHAT_ACK_HEADER], link.rxhave, bytes);
+  if (link.send(link.ctx, frame, CHAT_ACK_HEADER + bytes)) {
+    link.stats.framessent++;
+  }
+}
+
+// Sends up to CHAT_WINDOW fragments that are not acknowledged yet, the last one asks for an ack
+static void sendBurst(ChatLink &link, uint32_t now) {
+  int pending[CHAT_WINDOW];
+  int n = 0;
+  for (int i = 0; i < link.txcount && n < CHAT_WINDOW; i++) {
+    if (!bitGet(link.txacked, i)) pending[n++] = i;
+  }
+  for (int k = 0; k < n; k++) {
+    int i = pending[k];
+    uint8_t frame[CHAT_FRAME_MAX];
+    int offset = i * CHAT_FRAG_PAYLOAD;
+    int len = link.txlen - offset;
+    if (len > CHAT_FRAG_PAYLOAD) len = CHAT_FRAG_PAYLOAD;
+    frame[0] = (k == n - 1) ? CHAT_KIND_DATA_ACKREQ : CHAT_KIND_DATA;
+    putSession(frame, link.txsession);
+    frame[3] = link.txid;
+    frame[4] = i;
+    frame[5] = link.txcount;
+    memcpy(&frame[CHAT_DATA_HEADER], &link.txbuf[offset], len);
+    if (!link.send(link.ctx, frame, CHAT_DATA_HEADER + len)) {
+      break;  // radio queue full, the timeout sends the rest again
+    }
+    link.stats.framessent++;
+    if (bitGet(link.txsent, i)) link.stats.retransmits++;
+    bitSet(link.txsent, i);
+  }
+  link.txwaiting = true;
+  link.txdeadline = now + ((uint32_t)CHAT_RTO_MS << link.txretries);
+}
+
+static void finishTx(ChatLink &link, bool ok, uint32_t now) {
+  link.txbusy = false;
+  link.txwaiting = false;
+  if (ok) {
+    link.stats.messagessent++;
+  } else {
+    link.stats.messagesfailed++;
+  }
+  if (link.done) {
+    link.done(link.ctx, ok, link.txlen, now - link.txstart);
+  }
+}
+
+void chatInit(ChatLink &link, ChatSendFn send, ChatDeliverFn deliver, ChatDoneFn done, void *ctx, uint16_t session) {
+  memset(&link, 0, sizeof(link));
+  link.txsession = session;
+  link.send = send;
+  link.deliver = deliver;
+  link.done = done;
+  link.ctx = ctx;
+}
+
+bool chatSend(ChatLink &link, const uint8_t *msg, size_t len, uint32_t now) {
+  if (link.txbusy || len == 0 || len > CHAT_MAX_MESSAGE) {
+    return false;
+  }
+  memcpy(link.txbuf, msg, len);
+  link.txlen = len;
+  link.txcount = (len + CHAT_FRAG_PAYLOAD - 1) / CHAT_FRAG_PAYLOAD;
+  link.txid++;
+  memset(link.txacked, 0, sizeof(link.txacked));
+  memset(link.txsent, 0, sizeof(link.txsent));
+  link.txretries = 0;
+  link.txstart = now;
+  link.txbusy = true;
+  sendBurst(link, now);
+  return true;
+}
+
+static void receiveAck(ChatLink &link, const uint8_t *frame, uint8_t len, uint32_t now) {
+  int count = frame[4];
+  if (!link.txbusy || getSession(frame) != link.txsession || frame[3] != link.txid || count != link.txcount ||
+      len < CHAT_ACK_HEADER + (count + 7) / 8) {
+    return;  // stale ack of an earlier message or an earlier boot
+  }
+  link.stats.acksreceived++;
+  for (int i = 0; i < count; i++) {
+    if (bitGet(&frame[CHAT_ACK_HEADER], i)) bitSet(link.txacked, i);
+  }
+  if (bitAll(link.txacked, link.txcount)) {
+    finishTx(link, true, now);
+    return;
+  }
+  // progress resets the backoff, the next burst carries what is still missing
+  link.txretries = 0;
+  sendBurst(link, now);
+}
+
+static void receiveData(ChatLink &link, const uint8_t *frame, uint8_t len) {
+  uint16_t session = getSession(frame);
+  uint8_t id = frame[3];
+  int index = frame[4];
+  int count = frame[5];
+  int payload = len - CHAT_DATA_HEADER;
+  if (count == 0 || count > CHAT_MAX_FRAGS || index >= count || payload <= 0 || payload > CHAT_FRAG_PAYLOAD) {
+    return;
+  }
+  // every fragment but the last is full, that is how the sender cuts them
+  if (index < count - 1 && payload != CHAT_FRAG_PAYLOAD) {
+    return;
+  }
+  // and none reaches past CHAT_MAX_MESSAGE, the last of CHAT_MAX_FRAGS is short
+  if (index * CHAT_FRAG_PAYLOAD + payload > CHAT_MAX_MESSAGE) {
+    return;
+  }
+
+  if (!link.rxactive || session != link.rxsession || id != link.rxid || count != link.rxcount) {
+    // a new message, a partial earlier one is dropped
+    link.rxactive = true;
+    link.rxdelivered = false;
+    link.rxsession = session;
+    link.rxid = id;
+    link.rxcount = count;
+    link.rxlen = 0;
+    memset(link.rxhave, 0, sizeof(link.rxhave));
+  }
+  if (!link.rxdelivered && !bitGet(link.rxhave, index)) {
+    memcpy(&link.rxbuf[index * CHAT_FRAG_PAYLOAD], &frame[CHAT_DATA_HEADER], payload);
+    bitSet(link.rxhave, index);
+    if (index == count - 1) {
+      link.rxlen = index * CHAT_FRAG_PAYLOAD + payload;
+    }
+    if (bitAll(link.rxhave, count)) {
+      link.rxdelivered = true;
+      link.stats.messagesreceived++;
+      link.deliver(link.ctx, link.rxbuf, link.rxlen);
+    }
+  }
+  if (frame[0] == CHAT_KIND_DATA_ACKREQ || (link.rxdelivered && index == count - 1)) {
+    sendAck(link);
+  }
+}
+
+bool chatReceive(ChatLink &link, const uint8_t *frame, uint8_t len, uint32_t now) {
+  if (len >= CHAT_DATA_HEADER + 1 && (frame[0] == CHAT_KIND_DATA || frame[0] == CHAT_KIND_DATA_ACKREQ)) {
+    receiveData(link, frame, len);
+    return true;
+  }
+  if (len >= CHAT_ACK_HEADER && frame[0] == CHAT_KIND_ACK) {
+    receiveAck(link, frame, len, now);
+    return true;
+  }
+  return false;
+}
+
+void chatPoll(ChatLink &link, uint32_t now) {
+  if (!link.txbusy || !link.txwaiting || (int32_t)(now - link.txdeadline) < 0) {
+    return;
+  }
+  if (link.txretries >= CHAT_MAX_RETRIES) {
+    finishTx(link, false, now);
+    return;
+  }
+  link.txretries++;
+  sendBurst(link, now);
+}
+
+void chatAbort(ChatLink &link) {
+  link.txbusy = false;
+  link.txwaiting = false;
+  link.rxactive = false;
+}
@@ -0,0 +1,108 @@
+// Chat link layer - messages of several KB over 60 byte radio frames
+//
+// A message is cut into numbered fragments and sent in bursts of CHAT_WINDOW.
+// The last fragment of a burst asks for an acknowledgement, which carries a
+// bitmap of every fragment the receiver holds, so only the missing ones are
+// sent again. Unanswered bursts are repeated with an exponential backoff until
+// CHAT_MAX_RETRIES. One message is in flight per direction.
+//
+// Message ids restart at every boot, so each frame also carries a session number
+// the sender picks at random in chatInit(). Without it the first message after a
+// reboot of the sender looks like the one the receiver already delivered, and is
+// acknowledged and dropped.
+//
+// The link knows nothing about the radio: frames go out through a callback and
+// come in through chatReceive(), time and the session are passed in, so two links
+// can be wired to each other (with loss) on a host.
+//
+// Frames (session is little endian):
+//   DATA  kind | session(2) | msgid | index | count | payload (up to CHAT_FRAG_PAYLOAD)
+//   ACK   kind | session(2) | msgid | count | bitmap (one bit per fragment, LSB first)
+//
+#ifndef CHAT_LINK_H
+#define CHAT_LINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CHAT_FRAME_MAX 60      // fits the CC1101 FIFO with the length and status bytes
+#define CHAT_DATA_HEADER 6
+#define CHAT_ACK_HEADER 5
+#define CHAT_FRAG_PAYLOAD (CHAT_FRAME_MAX - CHAT_DATA_HEADER)
+#define CHAT_MAX_MESSAGE 4096
+#define CHAT_MAX_FRAGS ((CHAT_MAX_MESSAGE + CHAT_FRAG_PAYLOAD - 1) / CHAT_FRAG_PAYLOAD)
+#define CHAT_BITMAP_BYTES ((CHAT_MAX_FRAGS + 7) / 8)
+#define CHAT_WINDOW 8          // fragments per burst
+#define CHAT_RTO_MS 250        // first retransmit timeout, doubled on every retry
+#define CHAT_MAX_RETRIES 6
+
+#define CHAT_KIND_DATA 0xD0
+#define CHAT_KIND_DATA_ACKREQ 0xD1
+#define CHAT_KIND_ACK 0xA0
+
+// Hands a frame to the radio, false if it could not be queued
+typedef bool (*ChatSendFn)(void *ctx, const uint8_t *frame, uint8_t len);
+// A complete message arrived
+typedef void (*ChatDeliverFn)(void *ctx, const uint8_t *msg, size_t len);
+// The message passed to chatSend() was acknowledged (ok) or given up
+typedef void (*ChatDoneFn)(void *ctx, bool ok, size_t len, uint32_t ms);
+
+struct ChatStats {
+  uint32_t messagessent;
+  uint32_t messagesfailed;
+  uint32_t messagesreceived;
+  uint32_t framessent;
+  uint32_t retransmits;  // fragments sent more than once
+  uint32_t acksreceived;
+};
+
+struct ChatLink {
+  ChatSendFn send;
+  ChatDeliverFn deliver;
+  ChatDoneFn done;
+  void *ctx;
+
+  // sender
+  bool txbusy;
+  uint16_t txsession;
+  uint8_t txid;
+  uint8_t txcount;      // fragments in the message
+  uint16_t txlen;
+  uint8_t txacked[CHAT_BITMAP_BYTES];
+  uint8_t txsent[CHAT_BITMAP_BYTES];  // sent at least once, for counting retransmits
+  uint8_t txretries;
+  bool txwaiting;       // burst out, waiting for the ack
+  uint32_t txstart;     // ms
+  uint32_t txdeadline;  // ms, ack timeout of the current burst
+  uint8_t txbuf[CHAT_MAX_MESSAGE];
+
+  // receiver, one message at a time
+  bool rxactive;
+  bool rxdelivered;     // keep acking a delivered message, the sender may have missed the ack
+  uint16_t rxsession;
+  uint8_t rxid;
+  uint8_t rxcount;
+  uint16_t rxlen;
+  uint8_t rxhave[CHAT_BITMAP_BYTES];
+  uint8_t rxbuf[CHAT_MAX_MESSAGE];
+
+  ChatStats stats;
+};
+
+// session should differ from boot to boot, a random number
+void chatInit(ChatLink &link, ChatSendFn send, ChatDeliverFn deliver, ChatDoneFn done, void *ctx, uint16_t session);
+
+// Starts sending msg. False if a message is still in flight or len is 0 / too long.
+bool chatSend(ChatLink &link, const uint8_t *msg, size_t len, uint32_t now);
+
+// Feeds one received frame. Returns false if it is not a link frame (plain text from an
+// older peer, ...), so the caller can handle it another way.
+bool chatReceive(ChatLink &link, const uint8_t *frame, uint8_t len, uint32_t now);
+
+// Runs the retransmit timer, call at least every few 10 ms
+void chatPoll(ChatLink &link, uint32_t now);
+
+// Drops the message in flight and any partial reassembly
+void chatAbort(ChatLink &link);
+
+#endif
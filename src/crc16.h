@@ -0,0 +1,18 @@
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), table driven.
+// Used to validate anything we persist or put on the wire.
+//
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRC16_INIT 0xFFFF
+
+uint16_t crc16Update(uint16_t crc, const uint8_t *data, size_t len);
+
+static inline uint16_t crc16(const uint8_t *data, size_t len) {
+  return crc16Update(CRC16_INIT, data, len);
+}
+
+#endif
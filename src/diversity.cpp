@@ -0,0 +1,80 @@
+#include "diversity.h"
+#include "crc16.h"
+
+// Higher RSSI wins, on a tie the lower LQI (the CC1101 counts errors, lower is better)
+static bool betterCopy(const RxPacket &a, const RxPacket &b) {
+  if (a.rssi != b.rssi) {
+    return a.rssi > b.rssi;
+  }
+  return a.lqi < b.lqi;
+}
+
+static void takeSlot(DiversityWindow &window, DiversitySlot &slot, RxPacket &out) {
+  out = slot.best;
+  window.stats.packets++;
+  window.stats.best[slot.best.radio]++;
+  slot.used = false;
+}
+
+void diversityReset(DiversityWindow &window) {
+  memset(&window, 0, sizeof(window));
+}
+
+bool diversityOffer(DiversityWindow &window, const RxPacket &pkt, RxPacket &out) {
+  uint16_t hash = crc16(pkt.data, pkt.len);
+  uint8_t bit = 1 << pkt.radio;
+  DiversitySlot *free = NULL;
+  DiversitySlot *oldest = NULL;
+  bool taken = false;
+
+  window.stats.heard[pkt.radio]++;
+  for (int i = 0; i < DIVERSITY_SLOTS; i++) {
+    DiversitySlot &slot = window.slots[i];
+    if (!slot.used) {
+      if (free == NULL) free = &slot;
+      continue;
+    }
+    // The same radio hearing the same payload again is a repeat from the sender, not a copy
+    if (slot.hash == hash && !(slot.heard & bit) && slot.best.len == pkt.len
+        && (uint32_t)(pkt.timestamp - slot.first) < DIVERSITY_WINDOW_US
+        && memcmp(slot.best.data, pkt.data, pkt.len) == 0) {
+      slot.heard |= bit;
+      if (betterCopy(pkt, slot.best)) {
+        slot.best = pkt;
+      }
+      return false;
+    }
+    if (oldest == NULL || (int32_t)(slot.first - oldest->first) < 0) {
+      oldest = &slot;
+    }
+  }
+
+  if (free == NULL) {
+    takeSlot(window, *oldest, out);
+    free = oldest;
+    taken = true;
+  }
+  free->used = true;
+  free->heard = bit;
+  free->hash = hash;
+  free->first = pkt.timestamp;
+  free->best = pkt;
+  return taken;
+}
+
+bool diversityTake(DiversityWindow &window, uint32_t now, bool flush, RxPacket &out) {
+  DiversitySlot *oldest = NULL;
+
+  for (int i = 0; i < DIVERSITY_SLOTS; i++) {
+    DiversitySlot &slot = window.slots[i];
+    if (slot.used && (flush || (uint32_t)(now - slot.first) >= DIVERSITY_WINDOW_US)
+        && (oldest == NULL || (int32_t)(slot.first - oldest->first) < 0)) {
+      oldest = &slot;
+    }
+  }
+  if (oldest == NULL) {
+    return false;
+  }
+  takeSlot(window, *oldest, out);
+  return true;
+}
@@ -0,0 +1,49 @@
+// Diversity receive - both radios on the same channel, one packet out
+//
+// Every copy a radio hears is offered to a small window. Copies with the same
+// payload from the other radio that arrive within DIVERSITY_WINDOW_US are folded
+// into one slot which keeps the better copy. A slot is handed out once its window
+// has closed, so the consumer sees each packet once, with the radio / RSSI / LQI
+// of the copy that won.
+//
+#ifndef DIVERSITY_H
+#define DIVERSITY_H
+
+#include <Arduino.h>
+#include "radio_port.h"
+#include "rx_packet.h"
+
+#define DIVERSITY_SLOTS 8
+#define DIVERSITY_WINDOW_US 20000  // both copies end at the same time, this only covers task latency
+
+struct DiversitySlot {
+  bool used;
+  uint8_t heard;   // bit per radio
+  uint16_t hash;   // CRC-16 of the payload, checked before the memcmp
+  uint32_t first;  // timestamp of the first copy, the window starts here
+  RxPacket best;
+};
+
+struct DiversityStats {
+  uint32_t packets;             // after dedup
+  uint32_t heard[NUM_RADIOS];   // copies received per radio
+  uint32_t best[NUM_RADIOS];    // times the copy of this radio was kept
+};
+
+struct DiversityWindow {
+  DiversitySlot slots[DIVERSITY_SLOTS];
+  DiversityStats stats;
+};
+
+// Empties the window and clears the counters
+void diversityReset(DiversityWindow &window);
+
+// Adds one received copy. If every slot is busy the oldest one is handed out
+// early: it is copied to out and true is returned.
+bool diversityOffer(DiversityWindow &window, const RxPacket &pkt, RxPacket &out);
+
+// Hands out one packet whose window has closed at now (micros()), or any packet
+// when flush is set. Returns false when there is none.
+bool diversityTake(DiversityWindow &window, uint32_t now, bool flush, RxPacket &out);
+
+#endif
@@ -0,0 +1,92 @@
+// Fast GPIO - direct register access for the hot paths
+//
+// digitalRead()/digitalWrite() look the pin up on every call, which shows as
+// jitter in the raw sampling loops and as overhead in every SPI ready wait.
+// FastPin<N> takes the pin as a template argument and compiles to a single
+// load or store of the ESP32 GPIO registers. fastRead()/fastWrite() are the
+// same for pins only known at run time (RadioPort::gdo0, ...).
+//
+// The pin must already be configured with pinMode(), none of this touches the
+// IO MUX. Other Arduino targets fall back to digitalRead()/digitalWrite(). A
+// host build (no ARDUINO) gets a plain array of levels, fastGpioSet() and
+// fastGpioLevel() drive and inspect it from a test.
+//
+#ifndef FAST_GPIO_H
+#define FAST_GPIO_H
+
+#include <stdint.h>
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+#endif
+
+#if defined(CONFIG_IDF_TARGET_ESP32)
+#include <soc/gpio_struct.h>
+
+static inline bool fastRead(uint8_t pin) {
+  return pin < 32 ? (GPIO.in >> pin) & 1 : (GPIO.in1.data >> (pin - 32)) & 1;
+}
+
+static inline void fastWrite(uint8_t pin, bool level) {
+  if (pin < 32) {
+    if (level) {
+      GPIO.out_w1ts = 1UL << pin;
+    } else {
+      GPIO.out_w1tc = 1UL << pin;
+    }
+  } else {
+    if (level) {
+      GPIO.out1_w1ts.data = 1UL << (pin - 32);
+    } else {
+      GPIO.out1_w1tc.data = 1UL << (pin - 32);
+    }
+  }
+}
+
+#elif defined(ARDUINO)
+
+static inline bool fastRead(uint8_t pin) {
+  return digitalRead(pin) == HIGH;
+}
+
+static inline void fastWrite(uint8_t pin, bool level) {
+  digitalWrite(pin, level ? HIGH : LOW);
+}
+
+#else
+
+#define FAST_GPIO_HOST_PINS 64
+
+// One array for the whole program (inline function, not static)
+inline uint8_t *fastGpioLevels() {
+  static uint8_t levels[FAST_GPIO_HOST_PINS];
+  return levels;
+}
+
+static inline void fastGpioSet(uint8_t pin, bool level) {
+  fastGpioLevels()[pin % FAST_GPIO_HOST_PINS] = level;
+}
+
+static inline bool fastGpioLevel(uint8_t pin) {
+  return fastGpioLevels()[pin % FAST_GPIO_HOST_PINS];
+}
+
+static inline bool fastRead(uint8_t pin) {
+  return fastGpioLevel(pin);
+}
+
+static inline void fastWrite(uint8_t pin, bool level) {
+  fastGpioSet(pin, level);
+}
+
+#endif
+
+template <uint8_t Pin>
+struct FastPin {
+  static inline bool read() { return fastRead(Pin); }
+  static inline void write(bool level) { fastWrite(Pin, level); }
+  static inline void high() { fastWrite(Pin, true); }
+  static inline void low() { fastWrite(Pin, false); }
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "frame_proto.h"
+#include "crc16.h"
+#include <string.h>
+
+size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t write = 1;
+  size_t codepos = 0;
+  uint8_t code = 1;
+
+  for (size_t read = 0; read < len; read++) {
+    if (in[read] == 0) {
+      out[codepos] = code;
+      codepos = write++;
+      code = 1;
+    } else {
+      out[write++] = in[read];
+      if (++code == 0xFF) {
+        out[codepos] = code;
+        codepos = write++;
+        code = 1;
+      }
+    }
+  }
+  out[codepos] = code;
+  return write;
+}
+
+size_t cobsDecode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t read = 0;
+  size_t write = 0;
+
+  while (read < len) {
+    uint8_t code = in[read++];
+    if (code == 0 || read + code - 1 > len) {
+      return 0;
+    }
+    for (uint8_t i = 1; i < code; i++) {
+      if (in[read] == 0) {
+        return 0;
+      }
+      out[write++] = in[read++];
+    }
+    if (code != 0xFF && read < len) {
+      out[write++] = 0;
+    }
+  }
+  return write;
+}
+
+size_t frameEncode(uint8_t type, uint8_t seq, const uint8_t *payload, size_t len, uint8_t *out) {
+  uint8_t raw[FRAME_MAX_RAW];
+
+  if (len > FRAME_MAX_PAYLOAD) {
+    return 0;
+  }
+  raw[0] = type;
+  raw[1] = seq;
+  raw[2] = len;
+  memcpy(&raw[FRAME_HEADER_SIZE], payload, len);
+  framePut16(&raw[FRAME_HEADER_SIZE + len], crc16(raw, FRAME_HEADER_SIZE + len));
+
+  size_t n = cobsEncode(raw, FRAME_HEADER_SIZE + len + FRAME_CRC_SIZE, out);
+  out[n++] = 0x00;
+  return n;
+}
+
+bool frameDecode(uint8_t *buf, size_t len, uint8_t *type, uint8_t *seq, uint8_t *plen) {
+  size_t n = cobsDecode(buf, len, buf);
+  if (n < FRAME_HEADER_SIZE + FRAME_CRC_SIZE || n != (size_t)FRAME_HEADER_SIZE + buf[2] + FRAME_CRC_SIZE) {
+    return false;
+  }
+  uint16_t crc = buf[n - 2] | (buf[n - 1] << 8);
+  if (crc != crc16(buf, n - FRAME_CRC_SIZE)) {
+    return false;
+  }
+  *type = buf[0];
+  *seq = buf[1];
+  *plen = buf[2];
+  return true;
+}
@@ -0,0 +1,57 @@
+// Binary serial protocol
+//
+// Every message is one frame: type, sequence number, payload length, payload and a
+// CRC-16 (crc16.h) over everything before it, COBS encoded and terminated by a 0x00.
+// The delimiter never appears inside a frame, so a host can always resync on it and
+// text printed in between just shows up as frames with a bad CRC.
+// Multi-byte fields are little endian. tools/frame_decode.py decodes the stream.
+//
+#ifndef FRAME_PROTO_H
+#define FRAME_PROTO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Device -> host
+#define MSG_PACKET 0x01   // radio, rssi (int8), lqi, timestamp us (u32), packet data
+#define MSG_META 0x02     // radio, frequency Hz (u32), modulation, rx bandwidth kHz (u16), pa dBm (int8), channel
+#define MSG_SWEEP 0x03    // frequency kHz (u32), rssi (int8), one scan step
+#define MSG_CAPTURE 0x04  // offset (u16), total size (u16), chunk of the raw capture buffer
+// Host -> device
+#define MSG_COMMAND 0x10  // one CLI command line, same syntax as in text mode
+
+#define FRAME_HEADER_SIZE 3  // type, seq, len
+#define FRAME_CRC_SIZE 2
+#define FRAME_MAX_PAYLOAD 128
+#define FRAME_MAX_RAW (FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD + FRAME_CRC_SIZE)
+// COBS adds one byte per 254 plus the leading code byte, then the 0x00 delimiter
+#define FRAME_MAX_ENCODED (FRAME_MAX_RAW + FRAME_MAX_RAW / 254 + 2)
+
+// COBS encode len bytes, returns the encoded size (no delimiter)
+size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out);
+
+// COBS decode len bytes (delimiter stripped), out may be in. Returns the decoded
+// size, 0 if the input is malformed.
+size_t cobsDecode(const uint8_t *in, size_t len, uint8_t *out);
+
+// Builds a complete frame including the trailing 0x00 into out (FRAME_MAX_ENCODED bytes).
+// Returns the number of bytes to send, 0 if the payload is too big.
+size_t frameEncode(uint8_t type, uint8_t seq, const uint8_t *payload, size_t len, uint8_t *out);
+
+// Decodes one received frame (delimiter stripped) in place and checks its CRC.
+// On success the payload starts at buf + FRAME_HEADER_SIZE.
+bool frameDecode(uint8_t *buf, size_t len, uint8_t *type, uint8_t *seq, uint8_t *plen);
+
+static inline void framePut16(uint8_t *p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static inline void framePut32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+#endif
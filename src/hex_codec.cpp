@@ -0,0 +1,70 @@
+#include "hex_codec.h"
+
+// "000102...FEFF", byte b is at hexpairs[2 * b]
+static const char hexpairs[513] =
+  "000102030405060708090A0B0C0D0E0F"
+  "101112131415161718191A1B1C1D1E1F"
+  "202122232425262728292A2B2C2D2E2F"
+  "303132333435363738393A3B3C3D3E3F"
+  "404142434445464748494A4B4C4D4E4F"
+  "505152535455565758595A5B5C5D5E5F"
+  "606162636465666768696A6B6C6D6E6F"
+  "707172737475767778797A7B7C7D7E7F"
+  "808182838485868788898A8B8C8D8E8F"
+  "909192939495969798999A9B9C9D9E9F"
+  "A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+  "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+  "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+  "D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+  "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+  "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+// hex digit value of an ASCII char, XX = not a hex digit
+#define XX 0xFF
+static const uint8_t hexvalues[256] = {
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, XX, XX, XX, XX, XX, XX,
+  XX, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+  XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+#undef XX
+
+size_t hexEncode(const uint8_t *in, size_t len, char *out, size_t outsize) {
+  if (outsize < 2 * len + 1) {
+    return 0;
+  }
+  for (size_t i = 0; i < len; i++) {
+    const char *pair = &hexpairs[2 * in[i]];
+    out[2 * i] = pair[0];
+    out[2 * i + 1] = pair[1];
+  }
+  out[2 * len] = '\0';
+  return 2 * len;
+}
+
+size_t hexDecode(const char *in, size_t len, uint8_t *out, size_t outsize) {
+  if ((len & 1) || outsize < len / 2) {
+    return 0;
+  }
+  for (size_t i = 0; i < len / 2; i++) {
+    uint8_t hi = hexvalues[(uint8_t)in[2 * i]];
+    uint8_t lo = hexvalues[(uint8_t)in[2 * i + 1]];
+    if ((hi | lo) & 0xF0) {
+      return 0;
+    }
+    out[i] = (hi << 4) | lo;
+  }
+  return len / 2;
+}
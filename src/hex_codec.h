@@ -0,0 +1,20 @@
+// Hex codec for the serial port - table driven and bounds checked
+//
+// Both functions take the capacity of the output buffer and return the number of
+// bytes / chars written, 0 when the input is invalid or does not fit.
+//
+#ifndef HEX_CODEC_H
+#define HEX_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// len bytes to 2 * len uppercase hex chars plus a terminating NUL.
+// outsize must be at least 2 * len + 1. Returns the number of chars (without the NUL).
+size_t hexEncode(const uint8_t *in, size_t len, char *out, size_t outsize);
+
+// len hex chars (upper or lower case, even count) to len / 2 bytes. Returns the
+// number of bytes, 0 on an odd length, a non hex char or a too small out.
+size_t hexDecode(const char *in, size_t len, uint8_t *out, size_t outsize);
+
+#endif
@@ -0,0 +1,124 @@
+#include "loopback.h"
+
+#define FXOSC 26000000ULL
+
+// Lowest PATABLE entry of the driver's tables for the band, -30 dBm
+static uint8_t minPower(uint32_t hz) {
+  return hz >= 779000000 ? 0x03 : 0x12;
+}
+
+// DRATE_E / DRATE_M: baud = (256 + M) * 2^E * fxosc / 2^28
+static void dataRate(uint32_t baud, uint8_t &e, uint8_t &m) {
+  for (e = 0; e < 15; e++) {
+    uint64_t mant = (((uint64_t)baud << 28) + (FXOSC << e) / 2) / (FXOSC << e);
+    if (mant >= 256 && mant < 512) {
+      m = mant - 256;
+      return;
+    }
+  }
+  m = 255;
+}
+
+// DEVIATION_E / DEVIATION_M: dev = fxosc / 2^17 * (8 + M) * 2^E
+static uint8_t deviation(uint32_t dev) {
+  for (uint8_t e = 0; e < 8; e++) {
+    uint64_t mant = (((uint64_t)dev << 17) + (FXOSC << e) / 2) / (FXOSC << e);
+    if (mant < 16) {
+      return (e << 4) | (mant > 8 ? mant - 8 : 0);
+    }
+  }
+  return 0x77;
+}
+
+// CHANBW_E / CHANBW_M of the narrowest filter of at least bw: fxosc / (8 * (4 + M) * 2^E)
+static uint8_t channelBw(uint32_t bw) {
+  for (int e = 3; e >= 0; e--) {
+    for (int m = 3; m >= 0; m--) {
+      if (FXOSC / (8 * (4 + m) << e) >= bw) {
+        return (e << 6) | (m << 4);
+      }
+    }
+  }
+  return 0x00;
+}
+
+void loopbackImage(RadioProfile &image, const LoopbackPoint &point) {
+  uint8_t *r = image.regs;
+  uint32_t freq = ((uint64_t)point.hz << 16) / FXOSC;
+  r[CC1101_FREQ2] = freq >> 16;
+  r[CC1101_FREQ1] = freq >> 8;
+  r[CC1101_FREQ0] = freq;
+  r[CC1101_CHANNR] = 0;
+
+  // GFSK with modulation index ~1 (at least 5 kHz deviation), the filter wide
+  // enough for the signal plus +-20 ppm on both crystals
+  uint32_t dev = max(point.baud / 2, (uint32_t)5000);
+  uint32_t margin = (uint32_t)((uint64_t)point.hz * 80 / 1000000);
+  uint8_t drate_e, drate_m;
+  dataRate(point.baud, drate_e, drate_m);
+  r[CC1101_MDMCFG4] = channelBw(point.baud + 2 * dev + margin) | drate_e;
+  r[CC1101_MDMCFG3] = drate_m;
+  r[CC1101_DEVIATN] = deviation(dev);
+  r[CC1101_FSCTRL1] = point.baud > 100000 ? 0x0C : 0x06;  // IF 304 / 152 kHz
+  r[CC1101_MDMCFG2] = (r[CC1101_MDMCFG2] & 0x80) | 0x10 | 0x02;  // GFSK, 16/16 sync
+  r[CC1101_MDMCFG1] = 0x20 | (r[CC1101_MDMCFG1] & 0x03);         // no FEC, 4 preamble bytes
+
+  r[CC1101_PKTCTRL1] = 0x04;  // append status, no address check
+  r[CC1101_PKTCTRL0] = 0x05;  // no whitening, FIFOs, CRC, variable length
+  r[CC1101_PKTLEN] = 61;
+  r[CC1101_IOCFG0] = 0x06;                                   // sync / end of packet
+  r[CC1101_MCSM1] = 0x00;                                    // no CCA, IDLE after RX and TX
+  r[CC1101_MCSM0] = (r[CC1101_MCSM0] & ~0x30) | 0x10;        // calibrate from IDLE
+  r[CC1101_FREND0] &= ~0x07;                                 // PATABLE[0]
+  image.patable[0] = minPower(point.hz);
+  profileSeal(image);
+}
+
+uint32_t loopbackAirtimeUs(const LoopbackPoint &point) {
+  uint32_t bits = (LOOPBACK_PREAMBLE + 2 + 1 + LOOPBACK_PAYLOAD + 2) * 8;
+  return (uint32_t)((uint64_t)bits * 1000000 / point.baud);
+}
+
+void loopbackPayload(uint8_t *buf, uint8_t pointno, uint16_t seq) {
+  buf[0] = seq >> 8;
+  buf[1] = seq;
+  buf[2] = pointno;
+  for (int i = 3; i < LOOPBACK_PAYLOAD; i++) {
+    buf[i] = (uint8_t)(0x55 ^ (i * 37) ^ seq);
+  }
+}
+
+void loopbackAccount(LoopbackResult &result, uint8_t pointno, uint16_t seq, const uint8_t *buf, uint8_t len,
+                     const uint8_t *status, int8_t freqest) {
+  result.sent++;
+  if (len == 0) {
+    return;
+  }
+  if (!(status[1] & 0x80)) {
+    result.crcfails++;
+    return;
+  }
+  uint8_t expect[LOOPBACK_PAYLOAD];
+  loopbackPayload(expect, pointno, seq);
+  if (len != LOOPBACK_PAYLOAD || memcmp(buf, expect, LOOPBACK_PAYLOAD) != 0) {
+    result.wrong++;
+    return;
+  }
+  result.received++;
+  result.rssisum += (status[0] >= 128 ? ((int)status[0] - 256) / 2 : status[0] / 2) - 74;
+  result.lqisum += status[1] & 0x7F;
+  result.freqestsum += freqest;
+}
+
+uint16_t loopbackPer(const LoopbackResult &result) {
+  return result.sent ? (uint32_t)(result.sent - result.received) * 1000 / result.sent : 0;
+}
+
+int32_t loopbackOffsetHz(const LoopbackResult &result) {
+  // FREQEST is in fxosc / 2^14 steps
+  return result.received ? (int32_t)((int64_t)result.freqestsum * (int64_t)FXOSC / 16384 / result.received) : 0;
+}
+
+uint32_t loopbackThroughput(const LoopbackResult &result) {
+  return result.us ? (uint32_t)((uint64_t)result.received * LOOPBACK_PAYLOAD * 1000000 / result.us) : 0;
+}
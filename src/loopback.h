@@ -0,0 +1,60 @@
+// Loopback self-test - CC1 and CC2 as a test link at minimum PA power
+//
+// For every test point (frequency, data rate) one radio sends LOOPBACK_PACKETS
+// numbered packets in packet mode while the other receives, then the roles are
+// swapped. Both radios get the same settings: GFSK, 16/16 sync, variable length
+// with CRC, RSSI / LQI appended, -30 dBm. They are made on a register image of
+// the current configuration, so a test point is applied (and the original
+// configuration restored afterwards) like any other profile.
+//
+#ifndef LOOPBACK_H
+#define LOOPBACK_H
+
+#include <Arduino.h>
+#include "radio_profile.h"
+
+#define LOOPBACK_PACKETS 25
+#define LOOPBACK_PAYLOAD 16  // sequence number, test point, pattern
+#define LOOPBACK_PREAMBLE 4  // bytes, MDMCFG1.NUM_PREAMBLE = 2
+
+struct LoopbackPoint {
+  uint32_t hz;
+  uint32_t baud;
+};
+
+struct LoopbackResult {
+  uint16_t sent;      // packets that left the sender
+  uint16_t txtimeouts;  // packets the sender did not get out (TX_TIMEOUT), not in sent
+  uint16_t received;  // CRC ok and the payload we sent
+  uint16_t crcfails;
+  uint16_t wrong;     // CRC ok, but another payload (a stale or foreign packet)
+  int32_t rssisum;    // dBm, of the received packets
+  uint32_t lqisum;
+  int32_t freqestsum; // FREQEST of the received packets, see loopbackOffsetHz()
+  uint32_t us;        // from the first packet sent to the last one checked
+};
+
+// Changes image to the settings of point (and reseals it)
+void loopbackImage(RadioProfile &image, const LoopbackPoint &point);
+
+// Time on air of one test packet: preamble, sync, length, payload, CRC
+uint32_t loopbackAirtimeUs(const LoopbackPoint &point);
+
+// Test packet seq of test point pointno, LOOPBACK_PAYLOAD bytes
+void loopbackPayload(uint8_t *buf, uint8_t pointno, uint16_t seq);
+
+// Accounts one packet (or none, len 0) in result. status are the two bytes the
+// chip appends (RSSI, CRC_OK | LQI).
+void loopbackAccount(LoopbackResult &result, uint8_t pointno, uint16_t seq, const uint8_t *buf, uint8_t len,
+                     const uint8_t *status, int8_t freqest);
+
+// Packet error rate in 1/1000
+uint16_t loopbackPer(const LoopbackResult &result);
+
+// Mean frequency offset of the transmitter as seen by the receiver
+int32_t loopbackOffsetHz(const LoopbackResult &result);
+
+// Good payload bytes per second
+uint32_t loopbackThroughput(const LoopbackResult &result);
+
+#endif
@@ -0,0 +1,64 @@
+#include "oled_flush.h"
+
+void oledInvalidate(OledFlush &flush) {
+  flush.valid = false;
+}
+
+static void sendWindow(TwoWire &wire, uint8_t addr, uint8_t page, uint8_t first, uint8_t last) {
+  wire.beginTransmission(addr);
+  wire.write((uint8_t)0x00);  // control byte: command stream
+  wire.write((uint8_t)SSD1306_PAGEADDR);
+  wire.write(page);
+  wire.write(page);
+  wire.write((uint8_t)SSD1306_COLUMNADDR);
+  wire.write(first);
+  wire.write(last);
+  wire.endTransmission();
+}
+
+static void sendData(TwoWire &wire, uint8_t addr, const uint8_t *data, uint8_t len) {
+  while (len) {
+    uint8_t n = len > OLED_I2C_CHUNK ? OLED_I2C_CHUNK : len;
+    wire.beginTransmission(addr);
+    wire.write((uint8_t)0x40);  // control byte: data stream
+    wire.write(data, n);
+    wire.endTransmission();
+    data += n;
+    len -= n;
+  }
+}
+
+uint8_t oledFlush(OledFlush &flush, Adafruit_SSD1306 &display, TwoWire &wire, uint8_t addr) {
+  const uint8_t *buffer = display.getBuffer();
+  if (!buffer) {
+    return 0;
+  }
+  uint8_t sent = 0;
+  for (uint8_t page = 0; page < OLED_PAGES; page++) {
+    const uint8_t *src = buffer + page * OLED_WIDTH;
+    uint8_t *dst = flush.shadow + page * OLED_WIDTH;
+    int first = 0;
+    int last = OLED_WIDTH - 1;
+    if (flush.valid) {
+      while (first < OLED_WIDTH && src[first] == dst[first]) {
+        first++;
+      }
+      if (first == OLED_WIDTH) {
+        continue;  // page unchanged
+      }
+      while (src[last] == dst[last]) {
+        last--;
+      }
+    }
+    uint8_t len = last - first + 1;
+    sendWindow(wire, addr, page, first, last);
+    sendData(wire, addr, src + first, len);
+    memcpy(dst + first, src + first, len);
+    flush.bytes += len;
+    sent++;
+  }
+  flush.valid = true;
+  flush.flushes++;
+  flush.pages += sent;
+  return sent;
+}
@@ -0,0 +1,36 @@
+// OLED flush - sends only the changed parts of the SSD1306 frame buffer
+//
+// Adafruit_SSD1306::display() pushes the full 1 KB buffer on every call. Here
+// a shadow copy of what the panel shows is kept, each 128 byte page is compared
+// against the drawing buffer and only the dirty column span of a dirty page is
+// written (page / column address window, then the data). Nothing changed, no
+// bus traffic. Needs the controller in horizontal addressing mode, which is what
+// Adafruit_SSD1306::begin() sets up.
+//
+#ifndef OLED_FLUSH_H
+#define OLED_FLUSH_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_SSD1306.h>
+
+#define OLED_WIDTH 128
+#define OLED_PAGES 8       // 64 rows, 8 rows per page
+#define OLED_I2C_CHUNK 64  // data bytes per I2C transaction, fits the Wire buffer
+
+struct OledFlush {
+  uint8_t shadow[OLED_PAGES * OLED_WIDTH];  // what the panel shows
+  bool valid;                               // false: shadow unknown, next flush sends all
+  uint32_t flushes;
+  uint32_t pages;  // pages sent
+  uint32_t bytes;  // data bytes sent
+};
+
+// Forget what the panel shows (after begin(), a reset, ...)
+void oledInvalidate(OledFlush &flush);
+
+// Sends the dirty pages of display's buffer to the panel at addr.
+// Returns the number of pages written.
+uint8_t oledFlush(OledFlush &flush, Adafruit_SSD1306 &display, TwoWire &wire, uint8_t addr);
+
+#endif
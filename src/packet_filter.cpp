@@ -0,0 +1,108 @@
+#include "packet_filter.h"
+#include "crc16.h"
+
+// Folds every rule into the length window, the RSSI floor and the byte image.
+// Returns false if two rules contradict each other.
+static bool filterCompile(PacketFilter &filter) {
+  filter.minlen = 0;
+  filter.maxlen = 255;
+  filter.floor = -128;
+  filter.first = FILTER_SPAN;
+  filter.last = 0;
+  memset(filter.mask, 0, sizeof(filter.mask));
+  memset(filter.value, 0, sizeof(filter.value));
+
+  for (int r = 0; r < filter.numrules; r++) {
+    const FilterRule &rule = filter.rules[r];
+    switch (rule.type) {
+      case FILTER_BYTES:
+        for (int i = 0; i < rule.count; i++) {
+          uint8_t at = rule.offset + i;
+          uint8_t both = filter.mask[at] & rule.mask[i];
+          if ((filter.value[at] ^ rule.value[i]) & both) {
+            return false;  // same bit, different value
+          }
+          filter.mask[at] |= rule.mask[i];
+          filter.value[at] |= rule.value[i] & rule.mask[i];
+        }
+        if (rule.offset < filter.first) filter.first = rule.offset;
+        if (rule.offset + rule.count > filter.last) filter.last = rule.offset + rule.count;
+        break;
+      case FILTER_LENGTH:
+        if (rule.minlen > filter.minlen) filter.minlen = rule.minlen;
+        if (rule.maxlen < filter.maxlen) filter.maxlen = rule.maxlen;
+        break;
+      case FILTER_RSSI:
+        if (rule.floor > filter.floor) filter.floor = rule.floor;
+        break;
+    }
+  }
+  // a byte rule needs the packet to reach that far
+  if (filter.last > filter.minlen) filter.minlen = filter.last;
+  if (filter.first > filter.last) filter.first = filter.last;
+  filter.active = filter.numrules > 0 || filter.dedupus > 0;
+  return filter.minlen <= filter.maxlen;
+}
+
+void filterClear(PacketFilter &filter) {
+  memset(&filter, 0, sizeof(filter));
+  filterCompile(filter);
+}
+
+bool filterAdd(PacketFilter &filter, const FilterRule &rule) {
+  if (filter.numrules >= FILTER_MAX_RULES) {
+    return false;
+  }
+  if (rule.type == FILTER_BYTES && (rule.count == 0 || rule.count > FILTER_MAX_MATCH || rule.offset + rule.count > FILTER_SPAN)) {
+    return false;
+  }
+  filter.rules[filter.numrules++] = rule;
+  if (!filterCompile(filter)) {
+    filter.numrules--;
+    filterCompile(filter);
+    return false;
+  }
+  return true;
+}
+
+void filterSetDedup(PacketFilter &filter, uint32_t ms) {
+  filter.dedupus = ms * 1000;
+  memset(filter.recent, 0, sizeof(filter.recent));
+  filterCompile(filter);
+}
+
+// True if the same frame went through less than dedupus ago, else remembers it
+static bool filterDuplicate(PacketFilter &filter, const RxPacket &pkt) {
+  uint16_t hash = crc16(pkt.data, pkt.len);
+  uint32_t now = pkt.timestamp | 1;  // 0 marks an empty slot
+  for (int i = 0; i < FILTER_DEDUP_SLOTS; i++) {
+    if (filter.recent[i].seen && filter.recent[i].hash == hash && filter.recent[i].len == pkt.len
+        && now - filter.recent[i].seen < filter.dedupus) {
+      return true;
+    }
+  }
+  filter.recent[filter.nextrecent].hash = hash;
+  filter.recent[filter.nextrecent].len = pkt.len;
+  filter.recent[filter.nextrecent].seen = now;
+  filter.nextrecent = (filter.nextrecent + 1) % FILTER_DEDUP_SLOTS;
+  return false;
+}
+
+bool filterPacket(PacketFilter &filter, const RxPacket &pkt) {
+  if (!filter.active) {
+    return true;
+  }
+  bool pass = pkt.len >= filter.minlen && pkt.len <= filter.maxlen && pkt.rssi >= filter.floor;
+  for (int i = filter.first; pass && i < filter.last; i++) {
+    pass = (pkt.data[i] & filter.mask[i]) == filter.value[i];
+  }
+  if (pass && filter.dedupus) {
+    pass = !filterDuplicate(filter, pkt);
+  }
+  if (pass) {
+    filter.passed++;
+  } else {
+    filter.dropped++;
+  }
+  return pass;
+}
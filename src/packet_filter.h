@@ -0,0 +1,75 @@
+// Packet filter - software filter for receive and record mode
+//
+// Rules are kept as entered (for listing) and compiled into one decision table
+// after every change: a length window, an RSSI floor and a mask / value image of
+// the payload bytes any rule looks at. A packet passes when it matches every rule,
+// which is a couple of compares plus one masked compare per covered byte.
+// Duplicates of a frame seen within the dedup window are dropped as well.
+//
+#ifndef PACKET_FILTER_H
+#define PACKET_FILTER_H
+
+#include <Arduino.h>
+#include "rx_packet.h"
+
+#define FILTER_MAX_RULES 8
+#define FILTER_MAX_MATCH 8   // bytes per byte rule
+#define FILTER_SPAN 32       // byte rules must lie within the first FILTER_SPAN bytes
+#define FILTER_DEDUP_SLOTS 8 // frames remembered for the dedup window
+
+enum FilterRuleType {
+  FILTER_BYTES,   // (data[offset + i] & mask[i]) == value[i]
+  FILTER_LENGTH,  // minlen <= len <= maxlen
+  FILTER_RSSI,    // rssi >= floor
+};
+
+struct FilterRule {
+  uint8_t type;
+  uint8_t offset;  // FILTER_BYTES
+  uint8_t count;   // FILTER_BYTES, bytes in mask / value
+  uint8_t minlen;  // FILTER_LENGTH
+  uint8_t maxlen;  // FILTER_LENGTH
+  int8_t floor;    // FILTER_RSSI
+  uint8_t mask[FILTER_MAX_MATCH];
+  uint8_t value[FILTER_MAX_MATCH];
+};
+
+struct PacketFilter {
+  FilterRule rules[FILTER_MAX_RULES];
+  uint8_t numrules;
+  uint32_t dedupus;  // 0 = no dedup
+
+  // compiled
+  bool active;
+  uint8_t minlen, maxlen;
+  int8_t floor;
+  uint8_t first, last;  // bytes [first, last) of mask / value are used
+  uint8_t mask[FILTER_SPAN];
+  uint8_t value[FILTER_SPAN];
+
+  // dedup window
+  struct {
+    uint16_t hash;
+    uint8_t len;
+    uint32_t seen;  // micros(), 0 = empty
+  } recent[FILTER_DEDUP_SLOTS];
+  uint8_t nextrecent;
+
+  uint32_t passed;
+  uint32_t dropped;
+};
+
+// Removes all rules and the dedup window, everything passes
+void filterClear(PacketFilter &filter);
+
+// Adds a rule and recompiles. Returns false if the table is full, the rule is out
+// of range or it contradicts an earlier rule (no packet could ever pass).
+bool filterAdd(PacketFilter &filter, const FilterRule &rule);
+
+// Drops frames equal to one seen less than ms ago, 0 switches dedup off
+void filterSetDedup(PacketFilter &filter, uint32_t ms);
+
+// True if pkt passes every rule and is not a duplicate. Counts passed / dropped.
+bool filterPacket(PacketFilter &filter, const RxPacket &pkt);
+
+#endif
@@ -0,0 +1,53 @@
+// Single producer / single consumer ring of received packets
+//
+// The radio task is the only writer of head, the consumer the only writer of tail,
+// so no lock is needed: the producer publishes a slot with a release store of head
+// and the consumer frees it with a release store of tail. Slots are fixed size and
+// the ring is a plain struct, so rings are preallocated as globals, no heap.
+//
+#ifndef PACKET_RING_H
+#define PACKET_RING_H
+
+#include "rx_packet.h"
+
+#define PACKET_RING_SIZE 16  // slots, must be a power of two
+
+struct PacketRing {
+  RxPacket slots[PACKET_RING_SIZE];
+  uint32_t head;   // next slot to write, producer only
+  uint32_t tail;   // next slot to read, consumer only
+  uint32_t drops;  // pushes that found the ring full, producer only
+};
+
+// Producer: copy pkt into the ring. Returns false (and counts a drop) when full.
+static inline bool ringPush(PacketRing &ring, const RxPacket &pkt) {
+  uint32_t head = ring.head;
+  if (head - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE) >= PACKET_RING_SIZE) {
+    ring.drops++;
+    return false;
+  }
+  ring.slots[head & (PACKET_RING_SIZE - 1)] = pkt;
+  __atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Consumer: oldest packet, or NULL when empty. The slot stays valid until ringRelease().
+static inline const RxPacket *ringFront(PacketRing &ring) {
+  uint32_t tail = ring.tail;
+  if (tail == __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &ring.slots[tail & (PACKET_RING_SIZE - 1)];
+}
+
+// Consumer: done with the packet returned by ringFront()
+static inline void ringRelease(PacketRing &ring) {
+  __atomic_store_n(&ring.tail, ring.tail + 1, __ATOMIC_RELEASE);
+}
+
+// Packets waiting, safe from either side
+static inline uint32_t ringCount(PacketRing &ring) {
+  return __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE);
+}
+
+#endif
@@ -0,0 +1,166 @@
+#include "radio_port.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static SemaphoreHandle_t radiolock = NULL;
+static int lockdepth = 0;  // of the holder
+static void (*lockhook)(void) = NULL;
+
+void radioLockInit(void) {
+  if (radiolock == NULL) {
+    radiolock = xSemaphoreCreateRecursiveMutex();
+  }
+}
+
+// Before radioLockInit() (single threaded setup) locking is a no-op
+void radioLock(void) {
+  if (radiolock != NULL) {
+    xSemaphoreTakeRecursive(radiolock, portMAX_DELAY);
+    if (++lockdepth == 1 && lockhook != NULL) {
+      lockhook();
+    }
+  }
+}
+
+void radioUnlock(void) {
+  if (radiolock != NULL) {
+    lockdepth--;
+    xSemaphoreGiveRecursive(radiolock);
+  }
+}
+
+void radioLockSetHook(void (*hook)(void)) {
+  lockhook = hook;
+}
+
+void RadioPort::applyFreqCorrection(void) {
+  if (!freqcorrected) {
+    return;
+  }
+  byte freq[3];
+  SpiReadBurstReg(CC1101_FREQ2, freq, sizeof(freq));
+  uint32_t hz = ((uint64_t)(((uint32_t)freq[0] << 16) | ((uint32_t)freq[1] << 8) | freq[2]) * 26000000) >> 16;
+  // FREQOFF counts fxosc / 2^14 steps
+  int64_t offset = (int64_t)freqppb * hz / 1000000000 * 16384;
+  int32_t steps = (offset + (offset < 0 ? -13000000 : 13000000)) / 26000000;
+  SpiWriteReg(CC1101_FSCTRL0, (byte)(int8_t)constrain(steps, -128, 127));
+}
+
+bool RadioPort::sendAsync(const byte *data, byte len, uint32_t timeoutms, uint32_t ccams) {
+  if (txstate == TX_BUSY || len == 0 || len > 61) {
+    return false;
+  }
+  byte buffer[61];
+  memcpy(buffer, data, len);
+  SpiWriteReg(CC1101_TXFIFO, len);
+  SpiWriteBurstReg(CC1101_TXFIFO, buffer, len);
+  txstart = millis();
+  txtimeout = timeoutms;
+  txcca = ccams > 0;
+  txlast = TX_IDLE;
+  txstate = TX_BUSY;
+
+  // From RX straight to TX, no detour through IDLE (which would also skip the CCA)
+  byte state = SpiReadStatus(CC1101_MARCSTATE) & 0x1F;
+  if (!txcca) {
+    if (state != 0x0D) {
+      setSidle();
+    }
+    SpiStrobe(CC1101_STX);
+    return true;
+  }
+  txccams = ccams;
+  txbackoff = 0;
+  if (state == 0x0D) {
+    txnextus = micros();
+    txPollCca();
+  } else {
+    txCcaRx(state);
+  }
+  return true;
+}
+
+// CCA needs RX with the RSSI settled. A packet in the RX FIFO is kept for the RX
+// service, only an overflowed FIFO is flushed.
+void RadioPort::txCcaRx(byte state) {
+  if (state == 0x11) {  // RXFIFO_OVERFLOW
+    setSidle();
+    SpiStrobe(CC1101_SFRX);
+  }
+  SetRx();
+  txnextus = micros() + LBT_RSSI_SETTLE_US;
+}
+
+// One listen before talk step: STX once the backoff is over, then check whether the
+// chip took it. Only from RX, STX from IDLE would send without looking.
+TxState RadioPort::txPollCca(void) {
+  if ((int32_t)(micros() - txnextus) < 0) {
+    return TX_BUSY;
+  }
+  byte state = SpiReadStatus(CC1101_MARCSTATE) & 0x1F;
+  if (state == 0x0D) {
+    SpiStrobe(CC1101_STX);
+    delayMicroseconds(20);  // RX -> TX takes ~10 us when the chip accepts
+    state = SpiReadStatus(CC1101_MARCSTATE) & 0x1F;
+    if (state >= 0x12 && state <= 0x15) {
+      txcca = false;  // left RX, transmitting
+      txstart = millis();
+      ccastats.sent++;
+      return TX_BUSY;
+    }
+    if (state == 0x0D) {
+      ccastats.deferrals++;
+    }
+  }
+  if (millis() - txstart >= txccams) {
+    ccastats.failures++;
+    txFinish(TX_NO_CHANNEL);
+    return TX_NO_CHANNEL;
+  }
+  if (state != 0x0D) {
+    txCcaRx(state);  // dropped out of RX meanwhile, at the end of a received packet
+    return TX_BUSY;
+  }
+  if (txbackoff < LBT_MAX_BACKOFF) txbackoff++;
+  txnextus = micros() + LBT_SLOT_US * (1 + random(1 << txbackoff));
+  return TX_BUSY;
+}
+
+void RadioPort::txFinish(TxState state) {
+  // SFTX only from IDLE. On TX_DONE the FIFO is empty and the chip may be in RX already.
+  if (state != TX_DONE) {
+    setSidle();
+    SpiStrobe(CC1101_SFTX);
+  }
+  txstate = state;
+  txlast = state;
+  if (txdone != NULL) {
+    txdone(*this, state, txdonearg);
+  }
+  txstate = TX_IDLE;
+}
+
+TxState RadioPort::txPoll(void) {
+  if (txstate != TX_BUSY) {
+    return TX_IDLE;
+  }
+  if (txcca) {
+    return txPollCca();
+  }
+  byte state = SpiReadStatus(CC1101_MARCSTATE) & 0x1F;
+  byte txbytes = SpiReadStatus(CC1101_TXBYTES);
+  if (state == 0x16) {
+    txFinish(TX_TIMEOUT);  // TXFIFO_UNDERFLOW
+    return TX_TIMEOUT;
+  }
+  // FIFO empty and out of TX (IDLE or RX, per MCSM1.TXOFF_MODE): the packet is out
+  if ((txbytes & 0x7F) == 0 && (state < 0x12 || state > 0x16)) {
+    txFinish(TX_DONE);
+    return TX_DONE;
+  }
+  if (millis() - txstart > txtimeout) {
+    txFinish(TX_TIMEOUT);
+    return TX_TIMEOUT;
+  }
+  return TX_BUSY;
+}
@@ -0,0 +1,177 @@
+// Radio port - one interface for both CC1101 modules
+//
+// CC1 runs on the stock ELECHOUSE_CC1101_SRC_DRV library and CC2 on the
+// ELECHOUSE_CC1101_SRC_DRV2 copy. Both expose the same public API but are
+// different classes, so features that work on "radio N" go through a
+// RadioPort instead of repeating every call for CC1 and CC2.
+//
+#ifndef RADIO_PORT_H
+#define RADIO_PORT_H
+
+#include <Arduino.h>
+#include <ELECHOUSE_CC1101_SRC_DRV.h>
+#include <ELECHOUSE_CC1101_SRC_DRV2.h>
+
+#define NUM_RADIOS 2
+
+// State of an asynchronous transmission, see RadioPort::sendAsync()
+enum TxState {
+  TX_IDLE,
+  TX_BUSY,
+  TX_DONE,
+  TX_TIMEOUT,  // the packet did not leave within the timeout, or the TX FIFO underflowed
+  TX_NO_CHANNEL,  // listen before talk: the channel stayed busy for the whole wait
+};
+
+// Listen before talk, see RadioPort::sendAsync(). After a busy channel the next STX
+// comes 1..2^n slots later, n grows with every try up to LBT_MAX_BACKOFF.
+#define LBT_SLOT_US 400
+#define LBT_MAX_BACKOFF 5
+#define LBT_RSSI_SETTLE_US 800  // RX to valid RSSI / CCA
+
+struct CcaStats {
+  uint32_t sent;       // went out after a clear channel assessment
+  uint32_t deferrals;  // STX ignored because the channel was busy
+  uint32_t failures;   // TX_NO_CHANNEL
+};
+
+class RadioPort;
+typedef void (*TxDoneFn)(RadioPort &radio, TxState state, void *arg);
+
+// CC1 and CC2 share the one SPI peripheral (the drivers re-begin it with their
+// own pins on every transfer), so anything talking to a radio from a task must
+// hold this lock. It is recursive, nested holders are fine.
+void radioLockInit(void);
+void radioLock(void);
+void radioUnlock(void);
+
+// Called with the lock held whenever a task takes it (not for the nested takes),
+// so the power management can wake its radios before the holder talks to them
+void radioLockSetHook(void (*hook)(void));
+
+// Holds the radio lock for the current scope
+class RadioLock {
+public:
+  RadioLock() { radioLock(); }
+  ~RadioLock() { radioUnlock(); }
+};
+
+class RadioPort {
+public:
+  RadioPort(const char *name, byte gdo0, byte gdo2)
+    : name(name), gdo0(gdo0), gdo2(gdo2), txstate(TX_IDLE), txlast(TX_IDLE), txcca(false), txdone(NULL), txdonearg(NULL), ccastats(), freqppb(0), freqcorrected(false) {}
+
+  const char *name;  // label used in serial output, "CC1" / "CC2"
+  byte gdo0;
+  byte gdo2;
+
+  virtual void SpiStrobe(byte strobe) = 0;
+  virtual void SpiWriteReg(byte addr, byte value) = 0;
+  virtual void SpiWriteBurstReg(byte addr, byte *buffer, byte num) = 0;
+  virtual byte SpiReadReg(byte addr) = 0;
+  virtual void SpiReadBurstReg(byte addr, byte *buffer, byte num) = 0;
+  virtual byte SpiReadStatus(byte addr) = 0;
+  virtual bool getCC1101(void) = 0;
+  virtual void setMHZ(float mhz) = 0;
+  virtual void setModulation(byte m) = 0;
+  virtual void setPA(int p) = 0;
+  virtual void setRxBW(float f) = 0;
+  virtual void SetRx(void) = 0;
+  virtual void SetTx(void) = 0;
+  virtual void setSidle(void) = 0;
+  virtual int getRssi(void) = 0;
+  virtual byte getLqi(void) = 0;
+  virtual bool CheckCRC(void) = 0;
+  virtual byte ReceiveData(byte *rxBuffer) = 0;
+  virtual void SendData(byte *txBuffer, byte size) = 0;
+  virtual void goSleep(void) = 0;
+  // The module stopped answering on SPI and the driver skips every transfer.
+  // Only the CC2 driver bounds its chip-ready waits, CC1 always reports false.
+  virtual bool isDegraded(void) { return false; }
+
+  // Asynchronous transmit. Built on the SPI calls above instead of the drivers'
+  // SendData(), so it works the same on both radios and never spins on GDO0.
+  // sendAsync() loads the TX FIFO, strobes STX and returns. txPoll() checks the
+  // chip (call it when GDO0 falls at the end of the packet, or periodically) and
+  // reports TX_DONE or TX_TIMEOUT once, through the return value and onTxDone().
+  // Both need the radio lock.
+  //
+  // With ccams > 0 the packet waits for a clear channel first (listen before talk,
+  // MCSM1.CCA_MODE has to be set). STX is strobed from RX, where the chip ignores it
+  // while the channel is busy. txPoll() then tries again after a random backoff,
+  // txCcaWaiting() tells the caller to poll within a millisecond meanwhile, and
+  // reports TX_NO_CHANNEL once ccams have passed.
+  bool sendAsync(const byte *data, byte len, uint32_t timeoutms, uint32_t ccams = 0);
+  TxState txPoll(void);
+  bool txBusy(void) const { return txstate == TX_BUSY; }
+  // How the last transmission ended, whoever polled it. TX_IDLE from sendAsync() on.
+  TxState txResult(void) const { return txlast; }
+  bool txCcaWaiting(void) const { return txstate == TX_BUSY && txcca; }
+  const CcaStats &ccaStats(void) const { return ccastats; }
+  void onTxDone(TxDoneFn fn, void *arg) { txdone = fn; txdonearg = arg; }
+
+  // Crystal error of the module in parts per billion, measured by "calibrate". While
+  // set, setMHZ() through the port and profileApply() write FSCTRL0.FREQOFF from it
+  // instead of the driver's per band defaults. applyFreqCorrection() needs the radio lock.
+  void setFreqCorrection(int32_t ppb) { freqppb = ppb; freqcorrected = true; }
+  void clearFreqCorrection(void) { freqcorrected = false; }
+  bool hasFreqCorrection(void) const { return freqcorrected; }
+  int32_t freqCorrection(void) const { return freqppb; }
+  void applyFreqCorrection(void);
+
+private:
+  void txFinish(TxState state);
+  TxState txPollCca(void);
+  void txCcaRx(byte state);
+
+  volatile TxState txstate;
+  volatile TxState txlast;  // see txResult()
+  uint32_t txstart;  // ms, the start of the CCA wait and then of the transmission
+  uint32_t txtimeout;
+  bool txcca;        // waiting for a clear channel
+  uint32_t txccams;
+  uint32_t txnextus;  // next STX
+  byte txbackoff;
+  TxDoneFn txdone;
+  void *txdonearg;
+  CcaStats ccastats;
+  int32_t freqppb;
+  bool freqcorrected;
+};
+
+template <class Driver>
+class RadioPortT : public RadioPort {
+public:
+  RadioPortT(Driver &drv, const char *name, byte gdo0, byte gdo2)
+    : RadioPort(name, gdo0, gdo2), drv(drv) {}
+
+  void SpiStrobe(byte strobe) { drv.SpiStrobe(strobe); }
+  void SpiWriteReg(byte addr, byte value) { drv.SpiWriteReg(addr, value); }
+  void SpiWriteBurstReg(byte addr, byte *buffer, byte num) { drv.SpiWriteBurstReg(addr, buffer, num); }
+  byte SpiReadReg(byte addr) { return drv.SpiReadReg(addr); }
+  void SpiReadBurstReg(byte addr, byte *buffer, byte num) { drv.SpiReadBurstReg(addr, buffer, num); }
+  byte SpiReadStatus(byte addr) { return drv.SpiReadStatus(addr); }
+  bool getCC1101(void) { return drv.getCC1101(); }
+  void setMHZ(float mhz) { drv.setMHZ(mhz); applyFreqCorrection(); }
+  void setModulation(byte m) { drv.setModulation(m); }
+  void setPA(int p) { drv.setPA(p); }
+  void setRxBW(float f) { drv.setRxBW(f); }
+  void SetRx(void) { drv.SetRx(); }
+  void SetTx(void) { drv.SetTx(); }
+  void setSidle(void) { drv.setSidle(); }
+  int getRssi(void) { return drv.getRssi(); }
+  byte getLqi(void) { return drv.getLqi(); }
+  bool CheckCRC(void) { return drv.CheckCRC(); }
+  byte ReceiveData(byte *rxBuffer) { return drv.ReceiveData(rxBuffer); }
+  void SendData(byte *txBuffer, byte size) { drv.SendData(txBuffer, size); }
+  void goSleep(void) { drv.goSleep(); }
+  bool isDegraded(void) { return false; }
+
+private:
+  Driver &drv;
+};
+
+template <>
+inline bool RadioPortT<ELECHOUSE_CC1101_2>::isDegraded(void) { return drv.isDegraded(); }
+
+#endif
@@ -0,0 +1,31 @@
+#include "radio_power.h"
+
+void radioPowerDown(RadioPort &radio, RadioPower &power) {
+  profileCapture(radio, power.shadow);
+  radio.goSleep();
+  power.asleep = true;
+  power.downat = millis();
+  power.sleeps++;
+}
+
+uint32_t radioPowerUp(RadioPort &radio, RadioPower &power) {
+  if (!power.asleep) {
+    return 0;
+  }
+  power.asleep = false;  // from here on it is in use
+  uint32_t start = micros();
+  profileApply(radio, power.shadow);  // its SIDLE is the wake-up
+  uint32_t us = micros() - start;
+  power.asleepms += millis() - power.downat;
+  power.wakeussum += us;
+  if (us > power.wakeusmax) {
+    power.wakeusmax = us;
+  }
+  return us;
+}
+
+uint16_t radioPowerAsleepPermille(const RadioPower &power) {
+  uint32_t now = millis();
+  uint32_t asleep = power.asleepms + (power.asleep ? now - power.downat : 0);
+  return now ? (uint64_t)asleep * 1000 / now : 0;
+}
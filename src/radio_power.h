@@ -0,0 +1,37 @@
+// Radio power-down - idle radios in SPWD, woken from a register shadow
+//
+// In SPWD (goSleep()) a CC1101 draws ~0.2 uA instead of ~1.7 mA in IDLE or
+// ~16 mA in RX. The configuration registers are retained, the PATABLE and the
+// TEST registers are not, so the complete register image is captured right
+// before and written back on wake-up. The first SPI access (CS low) brings the
+// chip back to IDLE once its crystal runs; the time that and the restore take
+// is the wake-up latency, kept per radio. Both calls need the radio lock.
+//
+#ifndef RADIO_POWER_H
+#define RADIO_POWER_H
+
+#include <Arduino.h>
+#include "radio_profile.h"
+
+struct RadioPower {
+  volatile bool asleep;
+  volatile uint32_t usedat;  // millis() of the last use, the idle timeout runs from here
+  uint32_t downat;           // millis() it went to SPWD
+  uint32_t asleepms;         // total, without the current sleep
+  uint32_t sleeps;
+  uint32_t wakeussum;
+  uint32_t wakeusmax;
+  RadioProfile shadow;
+};
+
+// Captures the register image and sends the radio to SPWD
+void radioPowerDown(RadioPort &radio, RadioPower &power);
+
+// Wakes the radio and restores the register image, returns the latency in us.
+// Nothing to do (0) if it is awake.
+uint32_t radioPowerUp(RadioPort &radio, RadioPower &power);
+
+// Share of the time since boot the radio spent in SPWD, in 1/1000
+uint16_t radioPowerAsleepPermille(const RadioPower &power);
+
+#endif
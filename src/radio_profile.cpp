@@ -0,0 +1,320 @@
+#include "radio_profile.h"
+#include "crc16.h"
+
+// Same PA tables as the SmartRC driver, used to turn a PATABLE byte back into dBm
+static const uint8_t PROGMEM pa315[8] = { 0x12, 0x0D, 0x1C, 0x34, 0x51, 0x85, 0xCB, 0xC2 };
+static const uint8_t PROGMEM pa433[8] = { 0x12, 0x0E, 0x1D, 0x34, 0x60, 0x84, 0xC8, 0xC0 };
+static const int8_t PROGMEM padbm8[8] = { -30, -20, -15, -10, 0, 5, 7, 10 };
+static const uint8_t PROGMEM pa868[10] = { 0x03, 0x17, 0x1D, 0x26, 0x37, 0x50, 0x86, 0xCD, 0xC5, 0xC0 };
+static const int8_t PROGMEM padbm868[10] = { -30, -20, -15, -10, -6, 0, 5, 7, 10, 12 };
+static const uint8_t PROGMEM pa915[10] = { 0x03, 0x0E, 0x1E, 0x27, 0x38, 0x8E, 0x84, 0xCC, 0xC3, 0xC0 };
+static const int8_t PROGMEM padbm915[10] = { -30, -20, -15, -10, -6, 0, 5, 7, 10, 11 };
+
+static uint16_t profileCrc(const RadioProfile &profile) {
+  return crc16((const uint8_t *)&profile, offsetof(RadioProfile, crc));
+}
+
+void profileCapture(RadioPort &radio, RadioProfile &profile) {
+  memset(&profile, 0, sizeof(profile));
+  profile.magic = PROFILE_MAGIC;
+  profile.version = PROFILE_VERSION;
+  radio.SpiReadBurstReg(CC1101_IOCFG2, profile.regs, PROFILE_NUM_REGS);
+  radio.SpiReadBurstReg(CC1101_PATABLE, profile.patable, PROFILE_PATABLE_SIZE);
+  profileSeal(profile);
+}
+
+void profileSeal(RadioProfile &profile) {
+  profile.crc = profileCrc(profile);
+}
+
+bool profileIsValid(const RadioProfile &profile) {
+  return profile.magic == PROFILE_MAGIC && profile.version == PROFILE_VERSION && profile.crc == profileCrc(profile);
+}
+
+bool profileApply(RadioPort &radio, const RadioProfile &profile) {
+  if (!profileIsValid(profile)) {
+    return false;
+  }
+  radio.setSidle();
+  radio.SpiStrobe(CC1101_SFRX);
+  radio.SpiStrobe(CC1101_SFTX);
+  // The driver caches band, modulation, PA level and RX bandwidth and uses them
+  // in later setPA()/setModulation()/setCCMode() calls, so bring the cache in line
+  // first. Whatever these four write is overwritten by the burst below.
+  radio.setPA(profilePa(profile));
+  radio.setMHZ(profileMhz(profile));
+  radio.setModulation(profileModulation(profile));
+  radio.setRxBW(profileRxBw(profile));
+
+  RadioProfile image = profile;
+  radio.SpiWriteBurstReg(CC1101_IOCFG2, image.regs, PROFILE_NUM_REGS);
+  radio.SpiWriteBurstReg(CC1101_PATABLE, image.patable, PROFILE_PATABLE_SIZE);
+
+  // Validate: the chip must hold exactly what we wrote
+  radio.SpiReadBurstReg(CC1101_IOCFG2, image.regs, PROFILE_NUM_REGS);
+  radio.SpiReadBurstReg(CC1101_PATABLE, image.patable, PROFILE_PATABLE_SIZE);
+  bool ok = memcmp(image.regs, profile.regs, PROFILE_NUM_REGS) == 0 && memcmp(image.patable, profile.patable, PROFILE_PATABLE_SIZE) == 0;
+  radio.applyFreqCorrection();
+  return ok;
+}
+
+uint32_t profileHz(const RadioProfile &profile) {
+  uint32_t freq = ((uint32_t)profile.regs[CC1101_FREQ2] << 16) | ((uint32_t)profile.regs[CC1101_FREQ1] << 8) | profile.regs[CC1101_FREQ0];
+  return ((uint64_t)freq * 26000000) >> 16;
+}
+
+uint32_t profileChannelHz(const RadioProfile &profile) {
+  // f_chsp = fxosc / 2^18 * (256 + CHANSPC_M) * 2^CHANSPC_E
+  uint64_t spacing = ((uint64_t)26000000 * (256 + profile.regs[CC1101_MDMCFG0]) << (profile.regs[CC1101_MDMCFG1] & 0x03)) >> 18;
+  return profileHz(profile) + (uint32_t)(spacing * profile.regs[CC1101_CHANNR]);
+}
+
+float profileMhz(const RadioProfile &profile) {
+  return profileHz(profile) / 1000000.0f;
+}
+
+byte profileModulation(const RadioProfile &profile) {
+  // MDMCFG2.MOD_FORMAT back to the driver's numbering
+  switch ((profile.regs[CC1101_MDMCFG2] >> 4) & 0x07) {
+    case 0: return 0;  // 2-FSK
+    case 1: return 1;  // GFSK
+    case 3: return 2;  // ASK/OOK
+    case 4: return 3;  // 4-FSK
+    case 7: return 4;  // MSK
+  }
+  return 2;
+}
+
+float profileRxBw(const RadioProfile &profile) {
+  byte e = profile.regs[CC1101_MDMCFG4] >> 6;
+  byte m = (profile.regs[CC1101_MDMCFG4] >> 4) & 0x03;
+  return 26000.0f / (8.0f * (4 + m) * (1 << e));
+}
+
+int profilePa(const RadioProfile &profile) {
+  // ASK uses PATABLE[1] for the "on" level, every other modulation PATABLE[0]
+  byte level = (profileModulation(profile) == 2) ? profile.patable[1] : profile.patable[0];
+  float mhz = profileMhz(profile);
+  const uint8_t *table = pa433;
+  const int8_t *dbm = padbm8;
+  int n = 8;
+  if (mhz >= 300 && mhz <= 348) {
+    table = pa315;
+  } else if (mhz >= 779 && mhz < 900) {
+    table = pa868;
+    dbm = padbm868;
+    n = 10;
+  } else if (mhz >= 900 && mhz <= 928) {
+    table = pa915;
+    dbm = padbm915;
+    n = 10;
+  }
+  for (int i = 0; i < n; i++) {
+    if (pgm_read_byte(&table[i]) == level) {
+      return (int8_t)pgm_read_byte(&dbm[i]);
+    }
+  }
+  return 10;  // not one of the driver's levels, fall back to the boot default
+}
+
+// The driver splits a register into fields by repeated subtraction, which comes
+// down to these masks (reserved bits go with the lowest field)
+static void setField(RadioProfile &profile, byte addr, byte mask, byte bits) {
+  profile.regs[addr] = (profile.regs[addr] & ~mask) | (bits & mask);
+  profileSeal(profile);
+}
+
+// PATABLE byte for dbm in the band of the image, as the driver's setPA() picks it:
+// the first level at or above dbm, the highest one above all. -1 out of the bands.
+static int paLevel(const RadioProfile &profile, int dbm) {
+  float mhz = profileMhz(profile);
+  const uint8_t *table;
+  const int8_t *levels = padbm8;
+  int n = 8;
+  if (mhz >= 300 && mhz <= 348) {
+    table = pa315;
+  } else if (mhz >= 378 && mhz <= 464) {
+    table = pa433;
+  } else if (mhz >= 779 && mhz < 900) {
+    table = pa868;
+    levels = padbm868;
+    n = 10;
+  } else if (mhz >= 900 && mhz <= 928) {
+    table = pa915;
+    levels = padbm915;
+    n = 10;
+  } else {
+    return -1;
+  }
+  int i = 0;
+  while (i < n - 1 && dbm > (int8_t)pgm_read_byte(&levels[i])) {
+    i++;
+  }
+  return pgm_read_byte(&table[i]);
+}
+
+// ASK sends PATABLE[1] for a 1 and PATABLE[0] (off) for a 0
+static void putPa(RadioProfile &profile, int level) {
+  bool ask = profileModulation(profile) == 2;
+  profile.patable[0] = ask ? 0 : level;
+  profile.patable[1] = ask ? level : 0;
+}
+
+void profileSetModulation(RadioProfile &profile, byte m) {
+  static const uint8_t modfm[5] = { 0x00, 0x10, 0x30, 0x40, 0x70 };
+  if (m > 4) m = 4;
+  int dbm = profilePa(profile);  // the driver keeps its PA level across the change
+  setField(profile, CC1101_MDMCFG2, 0x70, modfm[m]);
+  profile.regs[CC1101_FREND0] = m == 2 ? 0x11 : 0x10;
+  profileSetPA(profile, dbm);
+}
+
+void profileSetPA(RadioProfile &profile, int dbm) {
+  int level = paLevel(profile, dbm);
+  if (level >= 0) {
+    putPa(profile, level);
+  }
+  profileSeal(profile);
+}
+
+void profileSetDeviation(RadioProfile &profile, float khz) {
+  // DEVIATN steps of fxosc / 2^17 * 2^E, walked the way the driver does
+  float f = 1.586914;
+  float v = 0.19836425;
+  int c = 0;
+  if (khz > 380.859375) khz = 380.859375;
+  if (khz < 1.586914) khz = 1.586914;
+  for (int i = 0; i < 255; i++) {
+    f += v;
+    if (c == 7) {
+      v *= 2;
+      c = -1;
+      i += 8;
+    }
+    if (f >= khz) {
+      c = i;
+      i = 255;
+    }
+    c++;
+  }
+  profile.regs[CC1101_DEVIATN] = c;
+  profileSeal(profile);
+}
+
+void profileSetChannel(RadioProfile &profile, byte ch) {
+  profile.regs[CC1101_CHANNR] = ch;
+  profileSeal(profile);
+}
+
+void profileSetChsp(RadioProfile &profile, float khz) {
+  byte e = 0, m = 0;
+  if (khz > 405.456543) khz = 405.456543;
+  if (khz < 25.390625) khz = 25.390625;
+  while (khz > 50.682068) {
+    e++;
+    khz /= 2;
+  }
+  khz = (khz - 25.390625) / 0.0991825;
+  m = khz;
+  if ((khz - m) * 10 >= 5) m++;
+  setField(profile, CC1101_MDMCFG1, 0x0F, e);
+  profile.regs[CC1101_MDMCFG0] = m;
+  profileSeal(profile);
+}
+
+void profileSetRxBW(RadioProfile &profile, float khz) {
+  int e = 3, m = 3;
+  for (int i = 0; i < 3 && khz > 101.5625; i++) {
+    khz /= 2;
+    e--;
+  }
+  for (int i = 0; i < 3 && khz > 58.1; i++) {
+    khz /= 1.25;
+    m--;
+  }
+  setField(profile, CC1101_MDMCFG4, 0xF0, (e << 6) | (m << 4));
+}
+
+void profileSetDRate(RadioProfile &profile, float kbaud) {
+  byte e = 0, m = 0;
+  if (kbaud > 1621.83) kbaud = 1621.83;
+  if (kbaud < 0.0247955) kbaud = 0.0247955;
+  for (int i = 0; i < 20 && kbaud > 0.0494942; i++) {
+    e++;
+    kbaud /= 2;
+  }
+  kbaud = (kbaud - 0.0247955) / 0.00009685;
+  m = kbaud;
+  if ((kbaud - m) * 10 >= 5) m++;
+  setField(profile, CC1101_MDMCFG4, 0x0F, e);
+  profile.regs[CC1101_MDMCFG3] = m;
+  profileSeal(profile);
+}
+
+void profileSetSyncMode(RadioProfile &profile, byte v) {
+  setField(profile, CC1101_MDMCFG2, 0x07, v > 7 ? 7 : v);
+}
+
+void profileSetSyncWord(RadioProfile &profile, byte sh, byte sl) {
+  profile.regs[CC1101_SYNC1] = sh;
+  profile.regs[CC1101_SYNC0] = sl;
+  profileSeal(profile);
+}
+
+void profileSetAdrChk(RadioProfile &profile, byte v) {
+  setField(profile, CC1101_PKTCTRL1, 0x03, v > 3 ? 3 : v);
+}
+
+void profileSetAddr(RadioProfile &profile, byte v) {
+  profile.regs[CC1101_ADDR] = v;
+  profileSeal(profile);
+}
+
+void profileSetWhiteData(RadioProfile &profile, bool v) {
+  setField(profile, CC1101_PKTCTRL0, 0xC0, v ? 0x40 : 0);
+}
+
+void profileSetPktFormat(RadioProfile &profile, byte v) {
+  setField(profile, CC1101_PKTCTRL0, 0x30, (v > 3 ? 3 : v) << 4);
+}
+
+void profileSetLengthConfig(RadioProfile &profile, byte v) {
+  setField(profile, CC1101_PKTCTRL0, 0x03, v > 3 ? 3 : v);
+}
+
+void profileSetPacketLength(RadioProfile &profile, byte v) {
+  profile.regs[CC1101_PKTLEN] = v;
+  profileSeal(profile);
+}
+
+void profileSetCrc(RadioProfile &profile, bool v) {
+  setField(profile, CC1101_PKTCTRL0, 0x0C, v ? 0x04 : 0);
+}
+
+void profileSetCRC_AF(RadioProfile &profile, bool v) {
+  setField(profile, CC1101_PKTCTRL1, 0x18, v ? 0x08 : 0);
+}
+
+void profileSetDcFilterOff(RadioProfile &profile, bool v) {
+  setField(profile, CC1101_MDMCFG2, 0x80, v ? 0x80 : 0);
+}
+
+void profileSetManchester(RadioProfile &profile, bool v) {
+  setField(profile, CC1101_MDMCFG2, 0x08, v ? 0x08 : 0);
+}
+
+void profileSetFEC(RadioProfile &profile, bool v) {
+  setField(profile, CC1101_MDMCFG1, 0x80, v ? 0x80 : 0);
+}
+
+void profileSetPRE(RadioProfile &profile, byte v) {
+  setField(profile, CC1101_MDMCFG1, 0x70, (v > 7 ? 7 : v) << 4);
+}
+
+void profileSetPQT(RadioProfile &profile, byte v) {
+  setField(profile, CC1101_PKTCTRL1, 0xE0, (v > 7 ? 7 : v) << 5);
+}
+
+void profileSetAppendStatus(RadioProfile &profile, bool v) {
+  setField(profile, CC1101_PKTCTRL1, 0x04, v ? 0x04 : 0);
+}
@@ -0,0 +1,76 @@
+// Radio profiles - complete CC1101 configurations as binary register images
+//
+// A profile is the raw content of the configuration registers (IOCFG2..TEST0)
+// plus the PATABLE, so restoring one is a reset-free burst write instead of
+// replaying every setter. The CRC covers everything before it.
+//
+#ifndef RADIO_PROFILE_H
+#define RADIO_PROFILE_H
+
+#include <Arduino.h>
+#include "radio_port.h"
+
+#define PROFILE_MAGIC 0xCC11
+#define PROFILE_VERSION 1
+#define PROFILE_NUM_REGS 0x2F  // CC1101_IOCFG2 (0x00) .. CC1101_TEST0 (0x2E)
+#define PROFILE_PATABLE_SIZE 8
+
+struct RadioProfile {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t reserved;
+  uint8_t regs[PROFILE_NUM_REGS];
+  uint8_t patable[PROFILE_PATABLE_SIZE];
+  uint16_t crc;
+};
+
+// Read the current register image of a radio into profile (and seal it with a CRC)
+void profileCapture(RadioPort &radio, RadioProfile &profile);
+
+// Recomputes the CRC after the register image was changed in place
+void profileSeal(RadioProfile &profile);
+
+// Checks magic, version and CRC
+bool profileIsValid(const RadioProfile &profile);
+
+// Writes the image to the radio and reads it back. Returns false if the
+// profile is invalid or the read back does not match. Leaves the radio in IDLE,
+// with the port's frequency correction (if any) in place of the image's FSCTRL0.
+bool profileApply(RadioPort &radio, const RadioProfile &profile);
+
+// Decoded values, for printing and for keeping the driver's cached state in sync
+uint32_t profileHz(const RadioProfile &profile);
+uint32_t profileChannelHz(const RadioProfile &profile);  // base + CHANNR * channel spacing
+float profileMhz(const RadioProfile &profile);
+byte profileModulation(const RadioProfile &profile);
+float profileRxBw(const RadioProfile &profile);
+int profilePa(const RadioProfile &profile);
+
+// The driver's setters on an image instead of the chip: the same register values,
+// field masks and clamps, no SPI. Each one reseals the image. Frequency is not
+// among them, setMHZ() calibrates on the chip.
+void profileSetModulation(RadioProfile &profile, byte m);
+void profileSetPA(RadioProfile &profile, int dbm);
+void profileSetDeviation(RadioProfile &profile, float khz);
+void profileSetChannel(RadioProfile &profile, byte ch);
+void profileSetChsp(RadioProfile &profile, float khz);
+void profileSetRxBW(RadioProfile &profile, float khz);
+void profileSetDRate(RadioProfile &profile, float kbaud);
+void profileSetSyncMode(RadioProfile &profile, byte v);
+void profileSetSyncWord(RadioProfile &profile, byte sh, byte sl);
+void profileSetAdrChk(RadioProfile &profile, byte v);
+void profileSetAddr(RadioProfile &profile, byte v);
+void profileSetWhiteData(RadioProfile &profile, bool v);
+void profileSetPktFormat(RadioProfile &profile, byte v);
+void profileSetLengthConfig(RadioProfile &profile, byte v);
+void profileSetPacketLength(RadioProfile &profile, byte v);
+void profileSetCrc(RadioProfile &profile, bool v);
+void profileSetCRC_AF(RadioProfile &profile, bool v);
+void profileSetDcFilterOff(RadioProfile &profile, bool v);
+void profileSetManchester(RadioProfile &profile, bool v);
+void profileSetFEC(RadioProfile &profile, bool v);
+void profileSetPRE(RadioProfile &profile, byte v);
+void profileSetPQT(RadioProfile &profile, byte v);
+void profileSetAppendStatus(RadioProfile &profile, bool v);
+
+#endif
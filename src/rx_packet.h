@@ -0,0 +1,19 @@
+// Received packet as it travels from a radio task to its consumers
+//
+#ifndef RX_PACKET_H
+#define RX_PACKET_H
+
+#include <Arduino.h>
+
+#define RX_PACKET_MAX 64  // same as CCBUFFERSIZE, one RX FIFO worth
+
+struct RxPacket {
+  uint32_t timestamp;  // micros() when the packet was read from the FIFO
+  uint8_t radio;       // index into radios[], 0 = CC#1
+  uint8_t len;
+  int8_t rssi;         // dBm
+  uint8_t lqi;         // 0..127, lower is better
+  byte data[RX_PACKET_MAX];
+};
+
+#endif
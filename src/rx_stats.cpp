@@ -0,0 +1,62 @@
+#include "rx_stats.h"
+
+static inline void binAdd(uint16_t &bin) {
+  if (bin != 0xFFFF) bin++;  // saturate instead of wrapping
+}
+
+uint32_t rxStatsHz(const RxStats &stats) {
+  return ((uint64_t)(stats.key >> 8) * 26000000) >> 16;
+}
+
+void rxStatsReset(RxStatsTable &table) {
+  memset(&table, 0, sizeof(table));
+}
+
+RxStats &rxStatsFor(RxStatsTable &table, uint32_t key) {
+  table.tick++;
+  RxStats *entry = &table.freqs[table.current];
+  if (entry->key != key) {
+    RxStats *oldest = &table.freqs[0];
+    int i;
+    for (i = 0; i < RX_STATS_FREQS; i++) {
+      if (table.freqs[i].key == key) break;
+      if (table.freqs[i].lastused < oldest->lastused) oldest = &table.freqs[i];
+    }
+    if (i < RX_STATS_FREQS) {
+      entry = &table.freqs[i];
+    } else {
+      entry = oldest;
+      memset(entry, 0, sizeof(*entry));
+      entry->key = key;
+      entry->rssimin = 127;
+      entry->rssimax = -128;
+    }
+    table.current = entry - table.freqs;
+  }
+  entry->lastused = table.tick;
+  return *entry;
+}
+
+const RxStats *rxStatsCurrent(const RxStatsTable &table) {
+  const RxStats &entry = table.freqs[table.current];
+  return entry.key ? &entry : NULL;
+}
+
+void rxStatsPacket(RxStats &stats, const RxPacket &pkt) {
+  stats.packets++;
+  stats.rssisum += pkt.rssi;
+  if (pkt.rssi < stats.rssimin) stats.rssimin = pkt.rssi;
+  if (pkt.rssi > stats.rssimax) stats.rssimax = pkt.rssi;
+
+  int bin = (pkt.rssi - RX_RSSI_FLOOR) / 10;
+  binAdd(stats.rssihist[constrain(bin, 0, RX_RSSI_BINS - 1)]);
+  binAdd(stats.lqihist[(pkt.lqi & 0x7F) >> 4]);
+
+  if (stats.lastpacket) {
+    uint32_t ms = (pkt.timestamp - stats.lastpacket) / 1000;
+    // each bin is 4x the previous one: 0 -> 0, 1..3 -> 1, 4..15 -> 2, ...
+    bin = ms ? (33 - __builtin_clz(ms)) / 2 : 0;
+    binAdd(stats.gaphist[constrain(bin, 0, RX_GAP_BINS - 1)]);
+  }
+  stats.lastpacket = pkt.timestamp | 1;  // 0 means none yet
+}
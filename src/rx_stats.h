@@ -0,0 +1,63 @@
+// Receive statistics - counters and histograms per radio and frequency
+//
+// Each radio owns a table of RX_STATS_FREQS entries keyed by frequency word and
+// channel. The radio task updates it in constant time: the entry used last is
+// checked first, else the small table is scanned and the least recently used
+// entry recycled. All memory is static, nothing is allocated on the receive path.
+//
+#ifndef RX_STATS_H
+#define RX_STATS_H
+
+#include <Arduino.h>
+#include "rx_packet.h"
+
+#define RX_STATS_FREQS 4    // frequencies tracked per radio
+#define RX_RSSI_BINS 8      // 10 dB wide, from RX_RSSI_FLOOR
+#define RX_RSSI_FLOOR -110  // dBm, lower values go into the first bin
+#define RX_LQI_BINS 8       // 16 wide, 0..127
+#define RX_GAP_BINS 8       // inter-packet interval: <1, <4, <16, <64, <256 ms, <1, <4, >=4 s
+
+struct RxStats {
+  uint32_t key;         // FREQ2..FREQ0 << 8 | CHANNR, 0 = unused
+  uint32_t lastused;    // table tick, for recycling
+  uint32_t packets;
+  uint32_t crcfails;
+  uint32_t overflows;
+  uint32_t lastpacket;  // micros() of the last good packet, 0 = none yet
+  int32_t rssisum;      // for the mean
+  int8_t rssimin;
+  int8_t rssimax;
+  uint16_t rssihist[RX_RSSI_BINS];
+  uint16_t lqihist[RX_LQI_BINS];
+  uint16_t gaphist[RX_GAP_BINS];
+};
+
+struct RxStatsTable {
+  RxStats freqs[RX_STATS_FREQS];
+  uint8_t current;  // entry used last
+  uint32_t tick;
+};
+
+// Builds the table key from the FREQ2, FREQ1, FREQ0 and CHANNR registers
+static inline uint32_t rxStatsKey(uint8_t freq2, uint8_t freq1, uint8_t freq0, uint8_t channel) {
+  return ((uint32_t)freq2 << 24) | ((uint32_t)freq1 << 16) | ((uint32_t)freq0 << 8) | channel;
+}
+
+// Base frequency in Hz and channel of an entry
+uint32_t rxStatsHz(const RxStats &stats);
+static inline uint8_t rxStatsChannel(const RxStats &stats) {
+  return stats.key & 0xFF;
+}
+
+void rxStatsReset(RxStatsTable &table);
+
+// Entry for key, recycling the least recently used one if key is new
+RxStats &rxStatsFor(RxStatsTable &table, uint32_t key);
+
+// Entry used last, NULL if nothing was counted yet
+const RxStats *rxStatsCurrent(const RxStatsTable &table);
+
+// Counts a good packet into its RSSI / LQI / interval histograms
+void rxStatsPacket(RxStats &stats, const RxPacket &pkt);
+
+#endif
@@ -0,0 +1,49 @@
+#include "text_render.h"
+
+size_t bitStrip(const uint8_t *in, size_t len, char *out, size_t outsize) {
+  if (outsize == 0) {
+    return 0;
+  }
+  size_t bytes = (outsize - 1) / 8;
+  if (bytes > len) {
+    bytes = len;
+  }
+  char *p = out;
+  for (size_t i = 0; i < bytes; i++) {
+    for (uint8_t mask = 0x80; mask; mask >>= 1) {
+      *p++ = (in[i] & mask) ? '-' : '_';
+    }
+  }
+  *p = '\0';
+  return p - out;
+}
+
+void textBegin(TextOut &out, Print &dest) {
+  out.dest = &dest;
+  out.len = 0;
+}
+
+void textWrite(TextOut &out, const char *s, size_t n) {
+  while (n) {
+    size_t room = TEXT_OUT_SIZE - out.len;
+    size_t chunk = n < room ? n : room;
+    memcpy(out.buf + out.len, s, chunk);
+    out.len += chunk;
+    s += chunk;
+    n -= chunk;
+    if (out.len == TEXT_OUT_SIZE) {
+      textFlush(out);
+    }
+  }
+}
+
+void textPrint(TextOut &out, const char *s) {
+  textWrite(out, s, strlen(s));
+}
+
+void textFlush(TextOut &out) {
+  if (out.len) {
+    out.dest->write((const uint8_t *)out.buf, out.len);
+    out.len = 0;
+  }
+}
@@ -0,0 +1,29 @@
+// Text rendering without the heap - bit strips and a fixed serial output buffer
+//
+// Replaces Arduino String building for the capture views: everything is written
+// into caller owned or static buffers, nothing is allocated.
+//
+#ifndef TEXT_RENDER_H
+#define TEXT_RENDER_H
+
+#include <Arduino.h>
+
+#define TEXT_OUT_SIZE 128
+
+// len bytes as 8 * len chars, MSB first, '-' for 1 and '_' for 0, plus a NUL.
+// Stops at whole bytes when out is too small. Returns the number of chars.
+size_t bitStrip(const uint8_t *in, size_t len, char *out, size_t outsize);
+
+// Collects output and hands it to dest in TEXT_OUT_SIZE chunks
+struct TextOut {
+  Print *dest;
+  size_t len;
+  char buf[TEXT_OUT_SIZE];
+};
+
+void textBegin(TextOut &out, Print &dest);
+void textWrite(TextOut &out, const char *s, size_t n);
+void textPrint(TextOut &out, const char *s);
+void textFlush(TextOut &out);
+
+#endif
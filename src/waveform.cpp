@@ -0,0 +1,109 @@
+#include "waveform.h"
+
+static inline uint8_t byteFlags(uint8_t b) {
+  return (b != 0x00 ? WAVE_HIGH : 0) | (b != 0xFF ? WAVE_LOW : 0);
+}
+
+void waveBuild(WaveSummary &wave, const uint8_t *bits, size_t len, uint8_t *store, size_t storesize) {
+  memset(&wave, 0, sizeof(wave));
+  wave.bits = bits;
+  wave.len = len;
+  wave.nlevels = 1;
+  wave.bins[0] = len;
+
+  size_t used = 0;
+  while (wave.nlevels < WAVE_MAX_LEVELS && wave.bins[wave.nlevels - 1] > 1) {
+    uint8_t level = wave.nlevels;
+    size_t below = wave.bins[level - 1];
+    size_t n = (below + 1) / 2;
+    if (used + n > storesize) {
+      break;
+    }
+    uint8_t *out = &store[used];
+    for (size_t i = 0; i < n; i++) {
+      size_t a = 2 * i, b = a + 1;
+      uint8_t flags;
+      if (level == 1) {
+        flags = byteFlags(bits[a]) | (b < below ? byteFlags(bits[b]) : 0);
+      } else {
+        flags = wave.levels[level - 1][a] | (b < below ? wave.levels[level - 1][b] : 0);
+      }
+      out[i] = flags;
+    }
+    wave.levels[level] = out;
+    wave.bins[level] = n;
+    used += n;
+    wave.nlevels++;
+  }
+}
+
+bool waveSample(const WaveSummary &wave, uint32_t index) {
+  return (wave.bits[index >> 3] >> (7 - (index & 7))) & 1;
+}
+
+uint8_t waveSpan(const WaveSummary &wave, uint32_t first, uint8_t shift) {
+  uint32_t samples = waveSamples(wave);
+  if (first >= samples) {
+    return 0;
+  }
+  uint32_t last = first + (1UL << shift);
+  if (last > samples) {
+    last = samples;
+  }
+
+  // Below a byte, or not aligned to a bin: sample by sample up to the next bin edge
+  uint8_t flags = 0;
+  uint32_t i = first;
+  while (i < last && (shift < 3 || (i & 7))) {
+    flags |= waveSample(wave, i) ? WAVE_HIGH : WAVE_LOW;
+    i++;
+  }
+  // Then the largest bins that are aligned and fit
+  while (i + 8 <= last) {
+    uint8_t level = 0;
+    while (level + 1 < wave.nlevels && ((i >> 3) & ((2UL << level) - 1)) == 0 && i + (16UL << level) <= last) {
+      level++;
+    }
+    flags |= level ? wave.levels[level][i >> (3 + level)] : byteFlags(wave.bits[i >> 3]);
+    i += 8UL << level;
+    if (flags == (WAVE_HIGH | WAVE_LOW)) {
+      return flags;
+    }
+  }
+  while (i < last) {
+    flags |= waveSample(wave, i) ? WAVE_HIGH : WAVE_LOW;
+    i++;
+  }
+  return flags;
+}
+
+uint32_t waveRun(const WaveSummary &wave, uint32_t index, uint32_t *start) {
+  uint32_t samples = waveSamples(wave);
+  if (index >= samples) {
+    *start = samples;
+    return 0;
+  }
+  bool level = waveSample(wave, index);
+  uint8_t full = level ? 0xFF : 0x00;
+
+  // Left: single samples to a byte edge, whole bytes while they are all the same level
+  uint32_t first = index;
+  while (first > 0 && waveSample(wave, first - 1) == level) {
+    if ((first & 7) == 0 && first >= 8 && wave.bits[(first >> 3) - 1] == full) {
+      first -= 8;
+    } else {
+      first--;
+    }
+  }
+  // Right, the same
+  uint32_t end = index + 1;
+  while (end < samples && waveSample(wave, end) == level) {
+    if ((end & 7) == 0 && end + 8 <= samples && wave.bits[end >> 3] == full) {
+      end += 8;
+    } else {
+      end++;
+    }
+  }
+  *start = first;
+  return end - first;
+}
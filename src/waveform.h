@@ -0,0 +1,47 @@
+// Waveform summary - min/max mipmaps over a raw capture for the OLED viewer
+//
+// A raw capture is a bit stream, one sample per bit, MSB first. To draw it at
+// any zoom without walking every sample of a column, each level L holds one
+// flag byte per bin of 8 << L samples: WAVE_HIGH if any sample in the bin is
+// 1, WAVE_LOW if any is 0, both for a bin with an edge. Level 0 is the capture
+// itself (one byte is one bin), levels 1.. are built from the level below by
+// OR-ing pairs, so all of them together take at most len bytes of storage.
+//
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <Arduino.h>
+
+#define WAVE_HIGH 0x01
+#define WAVE_LOW 0x02
+#define WAVE_MAX_LEVELS 16
+
+struct WaveSummary {
+  const uint8_t *bits;
+  size_t len;        // bytes in bits
+  uint8_t nlevels;   // levels built, including level 0
+  uint8_t *levels[WAVE_MAX_LEVELS];  // levels[0] unused, the capture is read directly
+  size_t bins[WAVE_MAX_LEVELS];
+};
+
+// Builds the summary of len bytes of capture into store (len bytes are always
+// enough). Levels that do not fit are left out, waveSpan() then falls back to
+// the highest one built.
+void waveBuild(WaveSummary &wave, const uint8_t *bits, size_t len, uint8_t *store, size_t storesize);
+
+static inline uint32_t waveSamples(const WaveSummary &wave) {
+  return wave.len * 8;
+}
+
+bool waveSample(const WaveSummary &wave, uint32_t index);
+
+// WAVE_HIGH / WAVE_LOW flags of the samples [first, first + (1 << shift)).
+// first should be a multiple of 1 << shift, the cost then does not depend on
+// shift.
+uint8_t waveSpan(const WaveSummary &wave, uint32_t first, uint8_t shift);
+
+// The run of equal samples containing index: first sample in *start, returns
+// its length
+uint32_t waveRun(const WaveSummary &wave, uint32_t index, uint32_t *start);
+
+#endif
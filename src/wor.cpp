@@ -0,0 +1,30 @@
+#include "wor.h"
+
+void worConfigure(RadioPort &radio, uint32_t intervalms, uint8_t rxtime) {
+  // t_event0 = 750 / fxosc * EVENT0
+  uint32_t event0 = min(intervalms * 26000 / 750, (uint32_t)0xFFFF);
+  radio.SpiWriteReg(CC1101_WOREVT1, event0 >> 8);
+  radio.SpiWriteReg(CC1101_WOREVT0, event0);
+  radio.SpiWriteReg(CC1101_WORCTRL, 0x78);  // RC_PD = 0, EVENT1 = 7, RC_CAL, WOR_RES = 0
+  radio.SpiWriteReg(CC1101_MCSM2, min(rxtime, (uint8_t)WOR_MAX_RX_TIME));  // no RSSI / PQI stop
+  radio.SpiWriteReg(CC1101_MCSM1, radio.SpiReadReg(CC1101_MCSM1) & ~0x0C);  // RXOFF_MODE IDLE
+  radio.SpiWriteReg(CC1101_MCSM0, radio.SpiReadReg(CC1101_MCSM0) | 0x30);   // FS_AUTOCAL every 4th time
+  radio.SpiWriteReg(CC1101_IOCFG0, 0x06);
+}
+
+void worArm(RadioPort &radio) {
+  radio.SpiStrobe(CC1101_SIDLE);
+  radio.SpiStrobe(CC1101_SFRX);
+  radio.SpiStrobe(CC1101_SWORRST);
+  radio.SpiStrobe(CC1101_SWOR);
+}
+
+uint32_t worRxDutyPpm(uint8_t rxtime) {
+  return 125000 >> min(rxtime, (uint8_t)WOR_MAX_RX_TIME);
+}
+
+uint32_t worCurrentUa(uint32_t rxppm, uint32_t awakeppm) {
+  uint64_t radio = (uint64_t)rxppm * WOR_RADIO_RX_UA + (uint64_t)(1000000 - rxppm) * WOR_RADIO_SLEEP_UA;
+  uint64_t mcu = (uint64_t)awakeppm * WOR_MCU_AWAKE_UA + (uint64_t)(1000000 - awakeppm) * WOR_MCU_LIGHT_SLEEP_UA;
+  return (uint32_t)((radio + mcu + 500000) / 1000000);
+}
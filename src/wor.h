@@ -0,0 +1,42 @@
+// Wake-on-Radio - the CC1101 polls the channel on its own while everything else sleeps
+//
+// In WOR the chip sleeps on its RC oscillator and wakes every EVENT0 to listen
+// for an RX window of 12.5 % >> RX_TIME of the interval (WOR_RES = 0). When it
+// finds a sync word it stays in RX to the end of the packet, then goes to IDLE
+// with the packet in the FIFO and GDO0 (0x06) falling. Nothing else wakes it,
+// so a transmitter has to send a preamble longer than the interval to be heard,
+// and the window has to be long enough for preamble and sync at the data rate.
+// Any SPI access (CS low) takes the chip out of SLEEP as well.
+//
+#ifndef WOR_H
+#define WOR_H
+
+#include <Arduino.h>
+#include "radio_port.h"
+
+#define WOR_MAX_INTERVAL_MS 1890  // EVENT0 = 0xFFFF
+#define WOR_MAX_RX_TIME 6         // 7 would be "until end of packet", no timeout
+
+// Supply currents the estimate works with, in uA (CC1101 and ESP32 datasheets)
+#define WOR_RADIO_RX_UA 16000
+#define WOR_RADIO_SLEEP_UA 1        // SLEEP with the RC oscillator running
+#define WOR_MCU_AWAKE_UA 40000      // both cores idling at 240 MHz
+#define WOR_MCU_LIGHT_SLEEP_UA 800
+
+// Sets up WOR on the current channel and packet settings: the interval, the RX
+// window, GDO0 on sync / end of packet, IDLE after RX, calibration every 4th
+// wake. Called with the radio in IDLE.
+void worConfigure(RadioPort &radio, uint32_t intervalms, uint8_t rxtime);
+
+// (Re)starts WOR: IDLE, RX FIFO flushed, RC timer reset, SWOR. After worConfigure()
+// and after every packet taken out of the FIFO.
+void worArm(RadioPort &radio);
+
+// Share of the time in RX, in ppm
+uint32_t worRxDutyPpm(uint8_t rxtime);
+
+// Average supply current of radio and MCU in uA, from the share of the time (ppm)
+// the radio is in RX and the MCU is awake
+uint32_t worCurrentUa(uint32_t rxppm, uint32_t awakeppm);
+
+#endif
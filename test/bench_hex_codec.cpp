@@ -0,0 +1,82 @@
+// Sources: hex_codec.cpp
+// hexEncode / hexDecode against the asciitohex / hextoascii they replaced, on
+// 60 byte packets (the CC1101 payload the RX printer and "tx" handle)
+#include <Arduino.h>
+#include "src/hex_codec.h"
+#include <chrono>
+#include <stdio.h>
+
+// The old sketch functions, unchanged
+void asciitohex(byte *ascii_ptr, byte *hex_ptr, int len) {
+  byte i, j, k;
+  for (i = 0; i < len; i++) {
+    j = ascii_ptr[i] / 16;
+    if (j > 9) {
+      k = j - 10 + 65;
+    } else {
+      k = j + 48;
+    }
+    hex_ptr[2 * i] = k;
+    j = ascii_ptr[i] % 16;
+    if (j > 9) {
+      k = j - 10 + 65;
+    } else {
+      k = j + 48;
+    }
+    hex_ptr[(2 * i) + 1] = k;
+  };
+  hex_ptr[(2 * i) + 2] = '\0';
+}
+
+void hextoascii(byte *ascii_ptr, byte *hex_ptr, int len) {
+  byte i, j;
+  for (i = 0; i < (len / 2); i++) {
+    j = hex_ptr[i * 2];
+    if ((j > 47) && (j < 58))
+      ascii_ptr[i] = (j - 48) * 16;
+    if ((j > 64) && (j < 71))
+      ascii_ptr[i] = (j - 55) * 16;
+    if ((j > 96) && (j < 103))
+      ascii_ptr[i] = (j - 87) * 16;
+    j = hex_ptr[i * 2 + 1];
+    if ((j > 47) && (j < 58))
+      ascii_ptr[i] = ascii_ptr[i] + (j - 48);
+    if ((j > 64) && (j < 71))
+      ascii_ptr[i] = ascii_ptr[i] + (j - 55);
+    if ((j > 96) && (j < 103))
+      ascii_ptr[i] = ascii_ptr[i] + (j - 87);
+  };
+  ascii_ptr[i++] = '\0';
+}
+
+#define PACKET 60
+#define ROUNDS 2000000
+
+static volatile uint8_t sink;
+
+template <class Fn>
+static double nsPerPacket(Fn fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < ROUNDS; r++) {
+    fn(r);
+  }
+  std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+  return ns.count() / ROUNDS;
+}
+
+int main() {
+  uint8_t bytes[PACKET + 1], back[PACKET + 1];
+  uint8_t hex[2 * PACKET + 3];
+  for (int i = 0; i < PACKET; i++) {
+    bytes[i] = i * 37;
+  }
+
+  double oldenc = nsPerPacket([&](int r) { bytes[0] = r; asciitohex(bytes, hex, PACKET); sink = hex[1]; });
+  double newenc = nsPerPacket([&](int r) { bytes[0] = r; hexEncode(bytes, PACKET, (char *)hex, sizeof(hex)); sink = hex[1]; });
+  double olddec = nsPerPacket([&](int r) { hex[0] = '0' + (r & 7); hextoascii(back, hex, 2 * PACKET); sink = back[0]; });
+  double newdec = nsPerPacket([&](int r) { hex[0] = '0' + (r & 7); hexDecode((char *)hex, 2 * PACKET, back, sizeof(back)); sink = back[0]; });
+
+  printf("encode %d bytes: asciitohex %.1f ns, hexEncode %.1f ns (%.1fx)\n", PACKET, oldenc, newenc, oldenc / newenc);
+  printf("decode %d bytes: hextoascii %.1f ns, hexDecode %.1f ns (%.1fx)\n", PACKET, olddec, newdec, olddec / newdec);
+  return 0;
+}
@@ -0,0 +1,53 @@
+// Host stand-in for the few Arduino calls the portable modules in src/ use, so
+// they build and run as plain C++ on a PC. The clock only moves when a test
+// moves it (hostMillis() / hostMicros()) or something waits in delayMicroseconds().
+//
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define IRAM_ATTR
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+template <class A, class B>
+static inline auto min(A a, B b) -> decltype(true ? A() : B()) { return a < b ? a : b; }
+template <class A, class B>
+static inline auto max(A a, B b) -> decltype(true ? A() : B()) { return a > b ? a : b; }
+
+inline uint32_t &hostMillis() {
+  static uint32_t ms;
+  return ms;
+}
+
+inline uint32_t &hostMicros() {
+  static uint32_t us;
+  return us;
+}
+
+// Only the block write the modules use, Serial and the display are not needed
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+};
+
+static inline unsigned long millis() { return hostMillis(); }
+static inline unsigned long micros() { return hostMicros(); }
+static inline void delayMicroseconds(uint32_t us) { hostMicros() += us; }
+static inline long random(long howbig) { return howbig > 0 ? rand() % howbig : 0; }
+static inline uint32_t esp_random() { return ((uint32_t)rand() << 16) ^ (uint32_t)rand(); }
+
+#endif
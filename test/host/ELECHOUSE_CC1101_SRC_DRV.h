@@ -0,0 +1,11 @@
+// Host stand-in for the stock CC1 driver, which is not part of the tree. The
+// modules only reach it through RadioPort, so the class name is all they need.
+//
+#ifndef HOST_ELECHOUSE_CC1101_SRC_DRV_H
+#define HOST_ELECHOUSE_CC1101_SRC_DRV_H
+
+#include <ELECHOUSE_CC1101_SRC_DRV2.h>
+
+class ELECHOUSE_CC1101 {};
+
+#endif
@@ -0,0 +1,151 @@
+// A CC1101 behind the RadioPort interface, modelled as far as the host tests need
+// it: configuration registers, PATABLE, MARCSTATE, the FIFO byte counts and the
+// strobes that move between IDLE, RX, TX and SLEEP. STX from RX is ignored while
+// channelbusy is set, as the chip does with MCSM1.CCA_MODE on a busy channel.
+// Every strobe is logged.
+//
+#ifndef HOST_FAKE_RADIO_H
+#define HOST_FAKE_RADIO_H
+
+#include "src/radio_port.h"
+
+#define FAKE_MAX_STROBES 256
+
+#define MARC_SLEEP 0x00
+#define MARC_IDLE 0x01
+#define MARC_RX 0x0D
+#define MARC_RXFIFO_OVERFLOW 0x11
+#define MARC_TX 0x13
+
+class FakeRadio : public RadioPort {
+public:
+  FakeRadio(const char *name = "FAKE") : RadioPort(name, 2, 4) { reset(); }
+
+  byte regs[0x30];
+  byte patable[8];
+  byte marcstate;
+  byte txbytes;
+  byte rxbytes;
+  bool channelbusy;
+  byte strobes[FAKE_MAX_STROBES];
+  int nstrobes;
+  int transfers;  // SPI transactions of any kind
+
+  void reset(void) {
+    memset(regs, 0, sizeof(regs));
+    memset(patable, 0, sizeof(patable));
+    marcstate = MARC_IDLE;
+    txbytes = rxbytes = 0;
+    channelbusy = false;
+    nstrobes = 0;
+    transfers = 0;
+  }
+
+  int strobeCount(byte strobe) const {
+    int n = 0;
+    for (int i = 0; i < nstrobes && i < FAKE_MAX_STROBES; i++) {
+      if (strobes[i] == strobe) n++;
+    }
+    return n;
+  }
+
+  // The packet in the TX FIFO is out, the chip goes back to RX (MCSM1.TXOFF_MODE)
+  void endOfPacket(void) {
+    txbytes = 0;
+    marcstate = MARC_RX;
+  }
+
+  void SpiStrobe(byte strobe) {
+    transfers++;
+    if (nstrobes < FAKE_MAX_STROBES) strobes[nstrobes] = strobe;
+    nstrobes++;
+    switch (strobe) {
+      case CC1101_SIDLE:
+        marcstate = MARC_IDLE;
+        break;
+      case CC1101_SRX:
+        if (marcstate == MARC_IDLE) marcstate = MARC_RX;
+        break;
+      case CC1101_STX:
+        if (marcstate == MARC_IDLE || (marcstate == MARC_RX && !channelbusy)) marcstate = MARC_TX;
+        break;
+      case CC1101_SFRX:
+        if (marcstate == MARC_IDLE || marcstate == MARC_RXFIFO_OVERFLOW) rxbytes = 0;
+        break;
+      case CC1101_SFTX:
+        if (marcstate == MARC_IDLE) txbytes = 0;
+        break;
+      case CC1101_SPWD:
+        if (marcstate == MARC_IDLE) marcstate = MARC_SLEEP;
+        break;
+      case CC1101_SWOR:
+        if (marcstate == MARC_IDLE) marcstate = MARC_SLEEP;
+        break;
+    }
+  }
+  void SpiWriteReg(byte addr, byte value) {
+    transfers++;
+    if (addr == CC1101_TXFIFO) {
+      txbytes++;
+    } else if (addr < sizeof(regs)) {
+      regs[addr] = value;
+    }
+  }
+  void SpiWriteBurstReg(byte addr, byte *buffer, byte num) {
+    transfers++;
+    if (addr == CC1101_TXFIFO) {
+      txbytes += num;
+    } else if (addr == CC1101_PATABLE) {
+      memcpy(patable, buffer, num < sizeof(patable) ? num : sizeof(patable));
+    } else {
+      for (int i = 0; i < num && addr + i < (int)sizeof(regs); i++) regs[addr + i] = buffer[i];
+    }
+  }
+  byte SpiReadReg(byte addr) {
+    transfers++;
+    return addr < sizeof(regs) ? regs[addr] : 0;
+  }
+  void SpiReadBurstReg(byte addr, byte *buffer, byte num) {
+    transfers++;
+    for (int i = 0; i < num; i++) {
+      buffer[i] = addr == CC1101_PATABLE ? (i < 8 ? patable[i] : 0) : (addr + i < (int)sizeof(regs) ? regs[addr + i] : 0);
+    }
+  }
+  byte SpiReadStatus(byte addr) {
+    transfers++;
+    switch (addr) {
+      case CC1101_MARCSTATE:
+        return marcstate;
+      case CC1101_TXBYTES:
+        return txbytes;
+      case CC1101_RXBYTES:
+        return rxbytes;
+    }
+    return 0;
+  }
+  bool getCC1101(void) { return true; }
+  void setMHZ(float) {}
+  void setModulation(byte) {}
+  void setPA(int) {}
+  void setRxBW(float) {}
+  void SetRx(void) {
+    SpiStrobe(CC1101_SIDLE);
+    SpiStrobe(CC1101_SRX);
+  }
+  void SetTx(void) {
+    SpiStrobe(CC1101_SIDLE);
+    SpiStrobe(CC1101_STX);
+  }
+  void setSidle(void) { SpiStrobe(CC1101_SIDLE); }
+  int getRssi(void) { return -100; }
+  byte getLqi(void) { return 0; }
+  bool CheckCRC(void) { return true; }
+  byte ReceiveData(byte *) { return 0; }
+  void SendData(byte *, byte) {}
+  void goSleep(void) {
+    SpiStrobe(CC1101_SIDLE);
+    SpiStrobe(CC1101_SPWD);
+  }
+};
+
+#endif
@@ -0,0 +1,13 @@
+// Host stand-in for the FreeRTOS types the radio lock uses, see semphr.h
+//
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+
+typedef void *SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+
+#define portMAX_DELAY 0xFFFFFFFF
+
+#endif
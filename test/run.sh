@@ -0,0 +1,32 @@
+#!/bin/sh
+# Host tests for the portable modules in src/. Every test/test_*.cpp is built
+# with the host compiler against the stand-ins in test/host, together with the
+# src/ files named on its "// Sources:" line, and run. "test/run.sh bench" also
+# builds and runs the bench_*.cpp microbenchmarks (-O2).
+set -e
+dir=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$dir")
+out=${TMPDIR:-/tmp}/cypher-pulse-tests
+mkdir -p "$out"
+CXX=${CXX:-c++}
+
+run() {
+  srcs=""
+  for s in $(sed -n 's|^// Sources: ||p' "$1"); do
+    srcs="$srcs $root/src/$s"
+  done
+  bin="$out/$(basename "$1" .cpp)"
+  $CXX -std=gnu++11 -Wall $2 -I"$dir/host" -I"$root/SmartRC-CC1101-Driver-Lib2" -I"$root" -o "$bin" "$1" $srcs
+  "$bin"
+}
+
+status=0
+for t in "$dir"/test_*.cpp; do
+  run "$t" "-O1 -g" || status=1
+done
+if [ "$1" = "bench" ]; then
+  for b in "$dir"/bench_*.cpp; do
+    run "$b" "-O2" || status=1
+  done
+fi
+exit $status
@@ -0,0 +1,30 @@
+// Checks for the host tests: a failed CHECK() prints the line and is counted,
+// return TEST_DONE() from main() for the summary and the exit code
+//
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+static int testfailures = 0;
+
+#define CHECK(cond)                                                       \
+  do {                                                                    \
+    if (!(cond)) {                                                        \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);     \
+      testfailures++;                                                     \
+    }                                                                     \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                                              \
+  do {                                                                                              \
+    long long va = (long long)(a), vb = (long long)(b);                                             \
+    if (va != vb) {                                                                                 \
+      printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, va, vb); \
+      testfailures++;                                                                               \
+    }                                                                                               \
+  } while (0)
+
+#define TEST_DONE() (printf("%s: %s\n", __FILE__, testfailures ? "FAILED" : "ok"), testfailures ? 1 : 0)
+
+#endif
@@ -0,0 +1,273 @@
+// Sources: chat_link.cpp
+#include "src/chat_link.h"
+#include "test.h"
+#include <string.h>
+
+// Two simulated radios: every frame goes on the air with a delivery time, may be
+// lost, and with a random delay frames overtake each other.
+#define AIR_SLOTS 256
+#define STEP_MS 5
+
+struct AirFrame {
+  bool used;
+  uint32_t at;
+  uint8_t len;
+  uint8_t data[CHAT_FRAME_MAX];
+};
+
+struct Node {
+  ChatLink link;
+  struct Node *peer;
+  AirFrame air[AIR_SLOTS];  // frames on their way to peer
+  int delivered;
+  size_t lastlen;
+  uint8_t lastmsg[CHAT_MAX_MESSAGE];
+  int done;
+  bool doneok;
+};
+
+static Node nodea, nodeb;
+static uint32_t now;
+static int losspct;
+static int maxdelayms;
+static uint32_t seed = 1;
+
+static uint32_t nextRand() {
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7FFF;
+}
+
+static bool airSend(void *ctx, const uint8_t *frame, uint8_t len) {
+  Node *node = (Node *)ctx;
+  if ((int)(nextRand() % 100) < losspct) {
+    return true;  // sent, but nobody heard it
+  }
+  for (int i = 0; i < AIR_SLOTS; i++) {
+    if (!node->air[i].used) {
+      node->air[i].used = true;
+      node->air[i].at = now + (maxdelayms ? nextRand() % (maxdelayms + 1) : 0);
+      node->air[i].len = len;
+      memcpy(node->air[i].data, frame, len);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void deliver(void *ctx, const uint8_t *msg, size_t len) {
+  Node *node = (Node *)ctx;
+  node->delivered++;
+  node->lastlen = len;
+  memcpy(node->lastmsg, msg, len);
+}
+
+static void done(void *ctx, bool ok, size_t, uint32_t) {
+  Node *node = (Node *)ctx;
+  node->done++;
+  node->doneok = ok;
+}
+
+static void boot(Node &node, uint16_t session) {
+  memset(node.air, 0, sizeof(node.air));
+  chatInit(node.link, airSend, deliver, done, &node, session);
+}
+
+static void setup(int loss, int delay) {
+  losspct = loss;
+  maxdelayms = delay;
+  now = 0;
+  memset(&nodea, 0, sizeof(nodea));
+  memset(&nodeb, 0, sizeof(nodeb));
+  nodea.peer = &nodeb;
+  nodeb.peer = &nodea;
+  boot(nodea, 0x1111);
+  boot(nodeb, 0x2222);
+}
+
+static void airStep(Node &from) {
+  for (int i = 0; i < AIR_SLOTS; i++) {
+    AirFrame &f = from.air[i];
+    if (f.used && (int32_t)(now - f.at) >= 0) {
+      f.used = false;
+      chatReceive(from.peer->link, f.data, f.len, now);
+    }
+  }
+}
+
+// Runs both links until a's message is done or the time is up
+static void runUntilDone(int donebefore, uint32_t limitms) {
+  uint32_t end = now + limitms;
+  while (nodea.done == donebefore && (int32_t)(now - end) < 0) {
+    now += STEP_MS;
+    airStep(nodea);
+    airStep(nodeb);
+    chatPoll(nodea.link, now);
+    chatPoll(nodeb.link, now);
+  }
+}
+
+static void fill(uint8_t *msg, size_t len, uint8_t salt) {
+  for (size_t i = 0; i < len; i++) {
+    msg[i] = (uint8_t)(i * 31 + salt);
+  }
+}
+
+static bool sendAndWait(const uint8_t *msg, size_t len) {
+  int before = nodea.done;
+  if (!chatSend(nodea.link, msg, len, now)) {
+    return false;
+  }
+  runUntilDone(before, 60000);
+  return nodea.done == before + 1 && nodea.doneok;
+}
+
+static void testClean() {
+  static uint8_t msg[CHAT_MAX_MESSAGE];
+  setup(0, 0);
+  fill(msg, sizeof(msg), 7);
+  CHECK(sendAndWait(msg, sizeof(msg)));
+  CHECK_EQ(nodeb.delivered, 1);
+  CHECK_EQ(nodeb.lastlen, sizeof(msg));
+  CHECK(memcmp(nodeb.lastmsg, msg, sizeof(msg)) == 0);
+  CHECK_EQ(nodea.link.stats.retransmits, 0);
+  CHECK_EQ(nodea.link.stats.framessent, CHAT_MAX_FRAGS);
+
+  // busy, empty and too long are refused
+  CHECK(chatSend(nodea.link, msg, 10, now));
+  CHECK(!chatSend(nodea.link, msg, 10, now));
+  chatAbort(nodea.link);
+  CHECK(!chatSend(nodea.link, msg, 0, now));
+  CHECK(!chatSend(nodea.link, msg, CHAT_MAX_MESSAGE + 1, now));
+
+  // not a link frame, left to the caller
+  CHECK(!chatReceive(nodeb.link, (const uint8_t *)"hello", 5, now));
+}
+
+static void testLoss() {
+  static uint8_t msg[3000];
+  setup(20, 0);  // at 30 % a burst and its ack now and then fail CHAT_MAX_RETRIES times in a row
+  for (int m = 0; m < 5; m++) {
+    fill(msg, sizeof(msg), m);
+    CHECK(sendAndWait(msg, sizeof(msg)));
+    CHECK_EQ(nodeb.delivered, m + 1);
+    CHECK(nodeb.lastlen == sizeof(msg) && memcmp(nodeb.lastmsg, msg, sizeof(msg)) == 0);
+  }
+  CHECK(nodea.link.stats.retransmits > 0);
+  CHECK_EQ(nodea.link.stats.messagessent, 5);
+  CHECK_EQ(nodeb.link.stats.messagesreceived, 5);
+}
+
+static void testReorder() {
+  static uint8_t msg[1000];
+  setup(10, 60);  // up to 60 ms on the air, fragments and acks arrive out of order
+  for (int m = 0; m < 8; m++) {
+    size_t len = 100 + m * 120;
+    fill(msg, len, 0x40 + m);
+    CHECK(sendAndWait(msg, len));
+    CHECK_EQ(nodeb.delivered, m + 1);
+    CHECK(nodeb.lastlen == len && memcmp(nodeb.lastmsg, msg, len) == 0);
+  }
+}
+
+static void testGiveUp() {
+  uint8_t msg[20];
+  setup(100, 0);
+  fill(msg, sizeof(msg), 1);
+  CHECK(!sendAndWait(msg, sizeof(msg)));
+  CHECK_EQ(nodea.done, 1);
+  CHECK_EQ(nodea.link.stats.messagesfailed, 1);
+  CHECK_EQ(nodeb.delivered, 0);
+}
+
+static void testReboot() {
+  uint8_t one[20], two[20];
+  fill(one, sizeof(one), 1);
+  fill(two, sizeof(two), 2);
+
+  // the sender reboots and its first message has the same id and fragment count
+  // as the last one the receiver delivered
+  setup(0, 0);
+  CHECK(sendAndWait(one, sizeof(one)));
+  CHECK_EQ(nodeb.delivered, 1);
+  boot(nodea, 0x3333);
+  CHECK(sendAndWait(two, sizeof(two)));
+  CHECK_EQ(nodeb.delivered, 2);
+  CHECK(memcmp(nodeb.lastmsg, two, sizeof(two)) == 0);
+
+  // with the same session it would be acked as the old message and lost, which is
+  // why the session has to change from boot to boot
+  setup(0, 0);
+  CHECK(sendAndWait(one, sizeof(one)));
+  boot(nodea, 0x1111);
+  CHECK(sendAndWait(two, sizeof(two)));
+  CHECK_EQ(nodeb.delivered, 1);
+
+  // an ack of the previous boot still on the air does not finish the new message
+  setup(0, 0);
+  CHECK(sendAndWait(one, sizeof(one)));
+  uint8_t staleack[CHAT_ACK_HEADER + 1] = {CHAT_KIND_ACK, 0x11, 0x11, 1, 1, 0x01};
+  boot(nodea, 0x4444);
+  losspct = 100;  // keep the new message from b
+  int before = nodea.done;
+  CHECK(chatSend(nodea.link, two, sizeof(two), now));
+  CHECK(chatReceive(nodea.link, staleack, sizeof(staleack), now));
+  CHECK(nodea.link.txbusy);
+  CHECK_EQ(nodea.link.stats.acksreceived, 0);
+  losspct = 0;
+  runUntilDone(before, 60000);
+  CHECK(nodea.doneok);
+  CHECK_EQ(nodeb.delivered, 2);
+  CHECK(memcmp(nodeb.lastmsg, two, sizeof(two)) == 0);
+
+  // the receiver reboots in the middle of a message, the sender fills it in again
+  static uint8_t big[2000];
+  fill(big, sizeof(big), 9);
+  setup(0, 0);
+  CHECK(chatSend(nodea.link, big, sizeof(big), now));
+  now += STEP_MS;
+  airStep(nodea);  // first burst in
+  boot(nodeb, 0x5555);
+  runUntilDone(0, 60000);
+  CHECK(nodea.doneok);
+  CHECK_EQ(nodeb.delivered, 1);
+  CHECK(nodeb.lastlen == sizeof(big) && memcmp(nodeb.lastmsg, big, sizeof(big)) == 0);
+}
+
+// The last of CHAT_MAX_FRAGS fragments can only be short. A full one would write
+// past rxbuf and deliver more than CHAT_MAX_MESSAGE.
+static void testOversize() {
+  setup(0, 0);
+  uint8_t frame[CHAT_FRAME_MAX];
+  memset(frame, 0x5A, sizeof(frame));
+  frame[0] = CHAT_KIND_DATA;
+  frame[1] = 0x11;
+  frame[2] = 0x11;
+  frame[3] = 1;
+  frame[5] = CHAT_MAX_FRAGS;
+  for (int i = 0; i < CHAT_MAX_FRAGS - 1; i++) {
+    frame[4] = i;
+    CHECK(chatReceive(nodeb.link, frame, sizeof(frame), now));
+  }
+  ChatStats before = nodeb.link.stats;
+  frame[4] = CHAT_MAX_FRAGS - 1;
+  CHECK(chatReceive(nodeb.link, frame, sizeof(frame), now));
+  CHECK(memcmp(&before, &nodeb.link.stats, sizeof(before)) == 0);
+  CHECK_EQ(nodeb.delivered, 0);
+  CHECK(!nodeb.link.rxdelivered);
+
+  // the same fragment cut to what still fits completes the message
+  int last = CHAT_MAX_MESSAGE - (CHAT_MAX_FRAGS - 1) * CHAT_FRAG_PAYLOAD;
+  CHECK(chatReceive(nodeb.link, frame, CHAT_DATA_HEADER + last, now));
+  CHECK_EQ(nodeb.delivered, 1);
+  CHECK_EQ(nodeb.lastlen, CHAT_MAX_MESSAGE);
+}
+
+int main() {
+  testClean();
+  testOversize();
+  testLoss();
+  testReorder();
+  testGiveUp();
+  testReboot();
+  return TEST_DONE();
+}
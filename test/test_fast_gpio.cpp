@@ -0,0 +1,54 @@
+// fast_gpio.h is header only, on the host it is the array fallback
+#include "src/fast_gpio.h"
+#include "test.h"
+
+typedef FastPin<4> Gdo0;
+typedef FastPin<33> HighBank;  // second register bank on the ESP32
+
+static void testLevels() {
+  for (int pin = 0; pin < FAST_GPIO_HOST_PINS; pin++) {
+    CHECK(!fastRead(pin));
+  }
+  fastWrite(4, true);
+  CHECK(fastRead(4));
+  CHECK(fastGpioLevel(4));
+  CHECK(Gdo0::read());
+  CHECK(!fastRead(3));
+  CHECK(!fastRead(5));
+  CHECK(!HighBank::read());
+
+  HighBank::high();
+  CHECK(fastRead(33));
+  CHECK(!fastRead(1));  // no aliasing between the banks
+  HighBank::low();
+  CHECK(!fastRead(33));
+
+  Gdo0::write(false);
+  CHECK(!fastRead(4));
+  fastGpioSet(4, true);  // a test driving an input
+  CHECK(Gdo0::read());
+  Gdo0::low();
+}
+
+// The raw recording loop: one byte sampled MSB first from the pin
+static uint8_t sampleByte(const bool *bits) {
+  uint8_t value = 0;
+  for (int j = 7; j > -1; j--) {
+    fastGpioSet(4, bits[7 - j]);
+    if (Gdo0::read()) value |= 1 << j;
+  }
+  return value;
+}
+
+static void testSampling() {
+  const bool bits[8] = {1, 0, 1, 1, 0, 0, 1, 0};
+  CHECK_EQ(sampleByte(bits), 0xB2);
+  const bool ones[8] = {1, 1, 1, 1, 1, 1, 1, 1};
+  CHECK_EQ(sampleByte(ones), 0xFF);
+}
+
+int main() {
+  testLevels();
+  testSampling();
+  return TEST_DONE();
+}
@@ -0,0 +1,63 @@
+// Sources: hex_codec.cpp
+#include "src/hex_codec.h"
+#include "test.h"
+#include <string.h>
+
+static void testEncode() {
+  uint8_t in[256];
+  for (int i = 0; i < 256; i++) {
+    in[i] = i;
+  }
+  char out[513];
+  CHECK_EQ(hexEncode(in, 256, out, sizeof(out)), 512);
+  CHECK_EQ(out[512], '\0');
+  CHECK(strncmp(out, "000102", 6) == 0);
+  CHECK(strcmp(out + 506, "FDFEFF") == 0);
+  CHECK(strncmp(out + 2 * 0xA5, "A5", 2) == 0);
+
+  // no room for the NUL
+  CHECK_EQ(hexEncode(in, 256, out, 512), 0);
+  CHECK_EQ(hexEncode(in, 0, out, 1), 0 * 2);
+  CHECK_EQ(out[0], '\0');
+}
+
+static void testDecode() {
+  uint8_t in[256], back[256];
+  char hex[513];
+  for (int i = 0; i < 256; i++) {
+    in[i] = 255 - i;
+  }
+  hexEncode(in, 256, hex, sizeof(hex));
+  CHECK_EQ(hexDecode(hex, 512, back, sizeof(back)), 256);
+  CHECK(memcmp(back, in, 256) == 0);
+
+  CHECK_EQ(hexDecode("0a0B", 4, back, 2), 2);
+  CHECK_EQ(back[0], 0x0A);
+  CHECK_EQ(back[1], 0x0B);
+  CHECK_EQ(hexDecode("fF", 2, back, 1), 1);
+  CHECK_EQ(back[0], 0xFF);
+
+  CHECK_EQ(hexDecode("012", 3, back, 2), 0);   // odd length
+  CHECK_EQ(hexDecode("0102", 4, back, 1), 0);  // does not fit
+  CHECK_EQ(hexDecode("0g", 2, back, 1), 0);
+  CHECK_EQ(hexDecode(" 1", 2, back, 1), 0);
+}
+
+// Every char that is not 0-9, A-F, a-f is rejected, as high or low digit
+static void testEveryChar() {
+  uint8_t out;
+  for (int c = 0; c < 256; c++) {
+    bool hex = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+    char hi[2] = { (char)c, '0' };
+    char lo[2] = { '0', (char)c };
+    CHECK_EQ(hexDecode(hi, 2, &out, 1), hex ? 1 : 0);
+    CHECK_EQ(hexDecode(lo, 2, &out, 1), hex ? 1 : 0);
+  }
+}
+
+int main() {
+  testEncode();
+  testDecode();
+  testEveryChar();
+  return TEST_DONE();
+}
@@ -0,0 +1,128 @@
+// Sources: loopback.cpp radio_profile.cpp radio_port.cpp crc16.cpp
+#include "src/loopback.h"
+#include "fake_radio.h"
+#include "test.h"
+
+static const LoopbackPoint point433 = {433920000, 38400};
+static const LoopbackPoint point868 = {868300000, 250000};
+
+// An image of a radio with a few registers set the test point must keep
+static void baseImage(RadioProfile &image) {
+  FakeRadio radio;
+  radio.regs[CC1101_MDMCFG2] = 0x80 | 0x30;  // DEM_DCFILT_OFF, ASK
+  radio.regs[CC1101_MDMCFG1] = 0x02;         // CHANSPC_E
+  radio.regs[CC1101_MCSM0] = 0x08;
+  radio.regs[CC1101_FREND0] = 0x11;
+  radio.regs[CC1101_CHANNR] = 5;
+  profileCapture(radio, image);
+}
+
+static void testImage() {
+  RadioProfile image;
+  baseImage(image);
+  loopbackImage(image, point433);
+  CHECK(profileIsValid(image));
+
+  // 433.92 MHz within one synthesizer step, channel 0
+  CHECK(profileHz(image) <= point433.hz && point433.hz - profileHz(image) < 400);
+  CHECK_EQ(image.regs[CC1101_CHANNR], 0);
+  CHECK_EQ(profileModulation(image), 1);  // GFSK
+  CHECK_EQ(image.regs[CC1101_MDMCFG2], 0x80 | 0x12);
+  CHECK_EQ(image.regs[CC1101_MDMCFG1], 0x22);
+
+  // 38.4 kBd is DRATE_E 10 / DRATE_M 0x83 (38383 Bd) as in SmartRF Studio,
+  // 19.2 kHz deviation 0x34 (19043 Hz), 116 kHz filter for signal and crystal margin
+  CHECK_EQ(image.regs[CC1101_MDMCFG4], 0xB0 | 10);
+  CHECK_EQ(image.regs[CC1101_MDMCFG3], 0x83);
+  CHECK_EQ(image.regs[CC1101_DEVIATN], 0x34);
+  CHECK_EQ(image.regs[CC1101_FSCTRL1], 0x06);
+
+  CHECK_EQ(image.regs[CC1101_PKTCTRL1], 0x04);
+  CHECK_EQ(image.regs[CC1101_PKTCTRL0], 0x05);
+  CHECK_EQ(image.regs[CC1101_MCSM1], 0x00);
+  CHECK_EQ(image.regs[CC1101_MCSM0], 0x18);
+  CHECK_EQ(image.regs[CC1101_FREND0], 0x10);
+  CHECK_EQ(image.patable[0], 0x12);
+  CHECK_EQ(profilePa(image), -30);
+
+  // 250 kBd at 868 MHz: the widest IF, the 868 MHz PA table
+  baseImage(image);
+  loopbackImage(image, point868);
+  CHECK(point868.hz - profileHz(image) < 400);
+  CHECK_EQ(image.regs[CC1101_FSCTRL1], 0x0C);
+  CHECK_EQ(image.regs[CC1101_MDMCFG4] & 0x0F, 13);
+  CHECK_EQ(image.patable[0], 0x03);
+  CHECK_EQ(profilePa(image), -30);
+
+  // the image goes on a radio like any profile
+  FakeRadio radio;
+  CHECK(profileApply(radio, image));
+  CHECK(memcmp(radio.regs, image.regs, PROFILE_NUM_REGS) == 0);
+  CHECK_EQ(radio.patable[0], 0x03);
+}
+
+static void testAirtime() {
+  // 4 preamble, 2 sync, length, 16 payload, 2 CRC = 200 bits
+  CHECK_EQ(loopbackAirtimeUs(point433), 200 * 1000000 / 38400);
+  CHECK_EQ(loopbackAirtimeUs(point868), 800);
+}
+
+static void testAccount() {
+  LoopbackResult result;
+  memset(&result, 0, sizeof(result));
+  uint8_t buf[LOOPBACK_PAYLOAD];
+  const uint8_t good[2] = {0xD0, 0x80 | 20};  // -98 dBm, CRC ok, LQI 20
+  const uint8_t bad[2] = {0xD0, 20};
+
+  // payloads differ by sequence number and test point
+  uint8_t other[LOOPBACK_PAYLOAD];
+  loopbackPayload(buf, 1, 7);
+  loopbackPayload(other, 1, 8);
+  CHECK(memcmp(buf, other, LOOPBACK_PAYLOAD) != 0);
+  loopbackPayload(other, 2, 7);
+  CHECK(memcmp(buf, other, LOOPBACK_PAYLOAD) != 0);
+
+  for (uint16_t seq = 0; seq < 20; seq++) {
+    loopbackPayload(buf, 1, seq);
+    if (seq == 3) {
+      loopbackAccount(result, 1, seq, buf, 0, good, 0);  // lost
+    } else if (seq == 4) {
+      loopbackAccount(result, 1, seq, buf, LOOPBACK_PAYLOAD, bad, 0);
+    } else if (seq == 5) {
+      loopbackAccount(result, 1, seq, other, LOOPBACK_PAYLOAD, good, 0);  // stale packet
+    } else if (seq == 6) {
+      loopbackAccount(result, 1, seq, buf, LOOPBACK_PAYLOAD - 1, good, 0);
+    } else {
+      loopbackAccount(result, 1, seq, buf, LOOPBACK_PAYLOAD, good, 10);
+    }
+  }
+  CHECK_EQ(result.sent, 20);
+  CHECK_EQ(result.received, 16);
+  CHECK_EQ(result.crcfails, 1);
+  CHECK_EQ(result.wrong, 2);
+  CHECK_EQ(result.rssisum, 16 * -98);
+  CHECK_EQ(result.lqisum, 16 * 20);
+  CHECK_EQ(loopbackPer(result), 200);
+
+  // FREQEST 10 is 10 * 26 MHz / 2^14
+  CHECK_EQ(loopbackOffsetHz(result), 10 * 26000000 / 16384);
+  result.freqestsum = -16 * 10;
+  CHECK_EQ(loopbackOffsetHz(result), -10 * 26000000 / 16384);
+
+  result.us = 1000000;
+  CHECK_EQ(loopbackThroughput(result), 16 * LOOPBACK_PAYLOAD);
+
+  // nothing sent or received is not a division by zero
+  LoopbackResult none;
+  memset(&none, 0, sizeof(none));
+  CHECK_EQ(loopbackPer(none), 0);
+  CHECK_EQ(loopbackOffsetHz(none), 0);
+  CHECK_EQ(loopbackThroughput(none), 0);
+}
+
+int main() {
+  testImage();
+  testAirtime();
+  testAccount();
+  return TEST_DONE();
+}
@@ -0,0 +1,216 @@
+// Sources: radio_port.cpp
+#include "src/radio_port.h"
+#include "fake_radio.h"
+#include "freertos/semphr.h"
+#include "test.h"
+
+static int donecalls;
+static TxState donestate;
+
+static void onDone(RadioPort &, TxState state, void *) {
+  donecalls++;
+  donestate = state;
+}
+
+static const byte packet[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+
+static void start(FakeRadio &radio, byte marcstate) {
+  radio.reset();
+  radio.marcstate = marcstate;
+  radio.onTxDone(onDone, NULL);
+  donecalls = 0;
+  hostMillis() = 1000;
+  hostMicros() = 1000000;
+}
+
+// Moves the clock on by ms, polling every millisecond like the radio task does
+static TxState pollFor(FakeRadio &radio, uint32_t ms) {
+  TxState state = TX_BUSY;
+  for (uint32_t i = 0; i < ms && state == TX_BUSY; i++) {
+    hostMillis() += 1;
+    hostMicros() += 1000;
+    state = radio.txPoll();
+  }
+  return state;
+}
+
+static void testPlain() {
+  FakeRadio radio;
+
+  // from RX straight to TX, no SIDLE in between
+  start(radio, MARC_RX);
+  CHECK(radio.sendAsync(packet, sizeof(packet), 500));
+  CHECK_EQ(radio.txbytes, sizeof(packet) + 1);
+  CHECK_EQ(radio.strobeCount(CC1101_SIDLE), 0);
+  CHECK_EQ(radio.strobes[0], CC1101_STX);
+  CHECK_EQ(radio.marcstate, MARC_TX);
+  CHECK(radio.txBusy());
+  CHECK(!radio.txCcaWaiting());
+  CHECK(!radio.sendAsync(packet, sizeof(packet), 500));  // one at a time
+  CHECK_EQ(radio.txPoll(), TX_BUSY);
+  radio.endOfPacket();
+  CHECK_EQ(radio.txPoll(), TX_DONE);
+  CHECK_EQ(donecalls, 1);
+  CHECK_EQ(donestate, TX_DONE);
+  CHECK(!radio.txBusy());
+  CHECK_EQ(radio.strobeCount(CC1101_SFTX), 0);  // back in RX, where SFTX is not allowed
+  CHECK_EQ(radio.marcstate, MARC_RX);
+  CHECK_EQ(radio.txPoll(), TX_IDLE);
+  CHECK_EQ(radio.txResult(), TX_DONE);  // for whoever did not poll it
+
+  // from IDLE
+  start(radio, MARC_IDLE);
+  CHECK(radio.sendAsync(packet, sizeof(packet), 500));
+  CHECK_EQ(radio.marcstate, MARC_TX);
+
+  // stuck in TX, flushed from IDLE
+  CHECK_EQ(pollFor(radio, 600), TX_TIMEOUT);
+  CHECK_EQ(donestate, TX_TIMEOUT);
+  CHECK_EQ(radio.marcstate, MARC_IDLE);
+  CHECK_EQ(radio.strobes[radio.nstrobes - 2], CC1101_SIDLE);
+  CHECK_EQ(radio.strobes[radio.nstrobes - 1], CC1101_SFTX);
+  CHECK_EQ(radio.txbytes, 0);
+  CHECK_EQ(radio.txResult(), TX_TIMEOUT);
+
+  CHECK(!radio.sendAsync(packet, 0, 500));
+  CHECK(!radio.sendAsync(packet, 62, 500));
+}
+
+static void testCcaClear() {
+  FakeRadio radio;
+  start(radio, MARC_RX);
+  CHECK(radio.sendAsync(packet, sizeof(packet), 500, 50));
+  CHECK_EQ(radio.marcstate, MARC_TX);
+  CHECK_EQ(radio.strobeCount(CC1101_SIDLE), 0);
+  CHECK(!radio.txCcaWaiting());
+  CHECK_EQ(radio.ccaStats().sent, 1);
+  CHECK_EQ(radio.ccaStats().deferrals, 0);
+  radio.endOfPacket();
+  CHECK_EQ(radio.txPoll(), TX_DONE);
+
+  // from IDLE the RSSI has to settle in RX before the first STX. A packet waiting in
+  // the RX FIFO is left for the RX service.
+  start(radio, MARC_IDLE);
+  radio.rxbytes = 12;
+  CHECK(radio.sendAsync(packet, sizeof(packet), 500, 50));
+  CHECK_EQ(radio.marcstate, MARC_RX);
+  CHECK_EQ(radio.rxbytes, 12);
+  CHECK(radio.txCcaWaiting());
+  CHECK_EQ(radio.strobeCount(CC1101_STX), 0);
+  hostMicros() += LBT_RSSI_SETTLE_US - 1;
+  CHECK_EQ(radio.txPoll(), TX_BUSY);
+  CHECK_EQ(radio.strobeCount(CC1101_STX), 0);
+  hostMicros() += 1;
+  CHECK_EQ(radio.txPoll(), TX_BUSY);
+  CHECK_EQ(radio.marcstate, MARC_TX);
+  CHECK(!radio.txCcaWaiting());
+  radio.endOfPacket();
+  CHECK_EQ(radio.txPoll(), TX_DONE);
+
+  // an overflowed RX FIFO is flushed on the way
+  start(radio, MARC_RXFIFO_OVERFLOW);
+  radio.rxbytes = 0x80 | 64;
+  CHECK(radio.sendAsync(packet, sizeof(packet), 500, 50));
+  CHECK_EQ(radio.rxbytes, 0);
+  CHECK_EQ(radio.marcstate, MARC_RX);
+}
+
+static void testCcaBusy() {
+  FakeRadio radio;
+  start(radio, MARC_RX);
+  radio.channelbusy = true;
+  CHECK(radio.sendAsync(packet, sizeof(packet), 500, 50));
+  CHECK_EQ(radio.marcstate, MARC_RX);
+  CHECK(radio.txCcaWaiting());
+  CHECK_EQ(radio.ccaStats().deferrals, 1);
+
+  // the retries back off 1..2^n slots, and give the channel back once it is clear
+  uint32_t last = hostMicros();
+  int tries = radio.strobeCount(CC1101_STX);
+  for (int i = 0; i < 20000 && radio.strobeCount(CC1101_STX) < 6; i++) {
+    hostMicros() += 10;
+    radio.txPoll();
+    if (radio.strobeCount(CC1101_STX) != tries) {
+      tries = radio.strobeCount(CC1101_STX);
+      uint32_t gap = hostMicros() - last - 20;  // less the wait after the strobe
+      CHECK(gap >= LBT_SLOT_US);
+      CHECK(gap <= LBT_SLOT_US * (1 << LBT_MAX_BACKOFF) + 10);
+      last = hostMicros();
+    }
+  }
+  CHECK_EQ(radio.ccaStats().deferrals, 6);
+  CHECK_EQ(radio.strobeCount(CC1101_SIDLE), 0);  // never left RX, so the CCA held
+  radio.channelbusy = false;
+  CHECK_EQ(pollFor(radio, 20), TX_BUSY);
+  CHECK_EQ(radio.marcstate, MARC_TX);
+  CHECK_EQ(radio.ccaStats().sent, 1);
+  radio.endOfPacket();
+  CHECK_EQ(radio.txPoll(), TX_DONE);
+  CHECK_EQ(donestate, TX_DONE);
+
+  // busy for good: dropped after the wait, the TX FIFO flushed
+  FakeRadio jammed;
+  start(jammed, MARC_RX);
+  jammed.channelbusy = true;
+  CHECK(jammed.sendAsync(packet, sizeof(packet), 500, 50));
+  CHECK_EQ(pollFor(jammed, 49), TX_BUSY);
+  CHECK_EQ(pollFor(jammed, 20), TX_NO_CHANNEL);
+  CHECK_EQ(hostMillis(), 1000 + 50);
+  CHECK_EQ(donecalls, 1);
+  CHECK_EQ(donestate, TX_NO_CHANNEL);
+  CHECK_EQ(jammed.ccaStats().failures, 1);
+  CHECK_EQ(jammed.ccaStats().sent, 0);
+  CHECK_EQ(jammed.txbytes, 0);
+  CHECK(!jammed.txBusy());
+
+  // a packet coming in ends RX meanwhile, back to RX and wait for the RSSI again
+  start(radio, MARC_RX);
+  radio.channelbusy = true;
+  CHECK(radio.sendAsync(packet, sizeof(packet), 500, 50));
+  radio.marcstate = MARC_IDLE;  // MCSM1.RXOFF_MODE after the packet
+  radio.rxbytes = 8;
+  radio.channelbusy = false;
+  int stx = radio.strobeCount(CC1101_STX);
+  hostMicros() += LBT_SLOT_US * (1 << LBT_MAX_BACKOFF) + 20;
+  CHECK_EQ(radio.txPoll(), TX_BUSY);
+  CHECK_EQ(radio.strobeCount(CC1101_STX), stx);  // STX from IDLE would skip the CCA
+  CHECK_EQ(radio.marcstate, MARC_RX);
+  CHECK_EQ(radio.rxbytes, 8);
+  CHECK(radio.txCcaWaiting());
+  hostMicros() += LBT_RSSI_SETTLE_US;
+  CHECK_EQ(radio.txPoll(), TX_BUSY);
+  CHECK_EQ(radio.marcstate, MARC_TX);
+}
+
+// The lock hook runs once per outermost take, not for nested ones
+static int hookcalls;
+static void hook(void) {
+  hookcalls++;
+}
+
+static void testLockHook() {
+  radioLockInit();
+  radioLockSetHook(hook);
+  {
+    RadioLock outer;
+    CHECK_EQ(hookcalls, 1);
+    {
+      RadioLock inner;
+      CHECK_EQ(hookcalls, 1);
+    }
+  }
+  CHECK_EQ(hostLockDepth(), 0);
+  {
+    RadioLock again;
+    CHECK_EQ(hookcalls, 2);
+  }
+  radioLockSetHook(NULL);
+}
+
+int main() {
+  testPlain();
+  testCcaClear();
+  testCcaBusy();
+  testLockHook();
+  return TEST_DONE();
+}
@@ -0,0 +1,145 @@
+// Sources: radio_power.cpp radio_profile.cpp radio_port.cpp crc16.cpp
+#include "src/radio_power.h"
+#include "fake_radio.h"
+#include "freertos/semphr.h"
+#include "test.h"
+
+#define CRYSTAL_START_US 240
+
+// A FakeRadio that forgets what SPWD loses and takes its time to wake up
+class SleepyRadio : public FakeRadio {
+public:
+  void SpiStrobe(byte strobe) {
+    bool sleeping = marcstate == MARC_SLEEP;
+    FakeRadio::SpiStrobe(strobe);
+    if (strobe == CC1101_SPWD && marcstate == MARC_SLEEP) {
+      memset(patable, 0, sizeof(patable));
+      regs[CC1101_TEST2] = regs[CC1101_TEST1] = regs[CC1101_TEST0] = 0;
+    } else if (sleeping && strobe == CC1101_SIDLE) {
+      hostMicros() += CRYSTAL_START_US;
+    }
+  }
+};
+
+static void configure(SleepyRadio &radio) {
+  for (int i = 0; i < PROFILE_NUM_REGS; i++) radio.regs[i] = (byte)(0x40 + i);
+  radio.regs[CC1101_FREQ2] = 0x10;  // 433.92 MHz
+  radio.regs[CC1101_FREQ1] = 0xB0;
+  radio.regs[CC1101_FREQ0] = 0x71;
+  for (int i = 0; i < 8; i++) radio.patable[i] = (byte)(0xC0 + i);
+}
+
+static void testDownUp() {
+  SleepyRadio radio;
+  configure(radio);
+  RadioPower power;
+  memset(&power, 0, sizeof(power));
+  byte regs[PROFILE_NUM_REGS], patable[8];
+  memcpy(regs, radio.regs, sizeof(regs));
+  memcpy(patable, radio.patable, sizeof(patable));
+
+  hostMillis() = 1000;
+  hostMicros() = 1000000;
+  CHECK_EQ(radioPowerUp(radio, power), 0);  // awake, nothing to do
+  CHECK_EQ(radio.transfers, 0);
+
+  radioPowerDown(radio, power);
+  CHECK(power.asleep);
+  CHECK_EQ(radio.marcstate, MARC_SLEEP);
+  CHECK_EQ(radio.strobes[radio.nstrobes - 1], CC1101_SPWD);
+  CHECK_EQ(power.sleeps, 1);
+  CHECK_EQ(power.downat, 1000);
+  CHECK_EQ(radio.patable[0], 0);
+  CHECK_EQ(radio.regs[CC1101_TEST0], 0);
+
+  // the wake-up restores all of it and is timed
+  hostMillis() = 3000;
+  uint32_t us = radioPowerUp(radio, power);
+  CHECK(!power.asleep);
+  CHECK_EQ(radio.marcstate, MARC_IDLE);
+  CHECK(memcmp(radio.regs, regs, sizeof(regs)) == 0);
+  CHECK(memcmp(radio.patable, patable, sizeof(patable)) == 0);
+  CHECK_EQ(us, CRYSTAL_START_US);
+  CHECK_EQ(power.wakeussum, CRYSTAL_START_US);
+  CHECK_EQ(power.wakeusmax, CRYSTAL_START_US);
+  CHECK_EQ(power.asleepms, 2000);
+  CHECK_EQ(radioPowerUp(radio, power), 0);
+  CHECK_EQ(power.wakeussum, CRYSTAL_START_US);
+
+  // a second sleep: the sum grows, the max stays
+  radioPowerDown(radio, power);
+  hostMillis() = 3500;
+  radioPowerUp(radio, power);
+  CHECK_EQ(power.sleeps, 2);
+  CHECK_EQ(power.wakeussum, 2 * CRYSTAL_START_US);
+  CHECK_EQ(power.wakeusmax, CRYSTAL_START_US);
+  CHECK_EQ(power.asleepms, 2500);
+}
+
+static void testPermille() {
+  SleepyRadio radio;
+  configure(radio);
+  RadioPower power;
+  memset(&power, 0, sizeof(power));
+
+  hostMillis() = 0;
+  CHECK_EQ(radioPowerAsleepPermille(power), 0);  // no division by zero at boot
+  hostMillis() = 1000;
+  CHECK_EQ(radioPowerAsleepPermille(power), 0);
+
+  // the current sleep counts as well
+  radioPowerDown(radio, power);
+  hostMillis() = 4000;
+  CHECK_EQ(radioPowerAsleepPermille(power), 750);
+  radioPowerUp(radio, power);
+  hostMillis() = 6000;
+  CHECK_EQ(radioPowerAsleepPermille(power), 500);
+}
+
+// The sketch wakes the radios from the lock hook, so whoever takes the lock
+// finds them awake
+static SleepyRadio *hookradio;
+static RadioPower hookpower;
+static int hookwakes;
+
+static void wakeHook(void) {
+  if (hookpower.asleep) {
+    radioPowerUp(*hookradio, hookpower);
+    hookwakes++;
+  }
+}
+
+static void testLockHook() {
+  SleepyRadio radio;
+  configure(radio);
+  hookradio = &radio;
+  memset(&hookpower, 0, sizeof(hookpower));
+  radioLockInit();
+  radioLockSetHook(wakeHook);
+
+  {
+    RadioLock lock;
+    radioPowerDown(radio, hookpower);
+  }
+  CHECK(hookpower.asleep);
+  {
+    RadioLock lock;
+    CHECK(!hookpower.asleep);
+    CHECK_EQ(radio.marcstate, MARC_IDLE);
+    CHECK_EQ(radio.patable[0], 0xC0);
+    {
+      RadioLock inner;
+      CHECK_EQ(hookwakes, 1);
+    }
+  }
+  CHECK_EQ(hookwakes, 1);
+  CHECK_EQ(hostLockDepth(), 0);
+  radioLockSetHook(NULL);
+}
+
+int main() {
+  testDownUp();
+  testPermille();
+  testLockHook();
+  return TEST_DONE();
+}
@@ -0,0 +1,184 @@
+// Sources: radio_profile.cpp radio_port.cpp crc16.cpp
+#include "src/radio_profile.h"
+#include "fake_radio.h"
+#include "test.h"
+
+// 433.92 MHz, GFSK, 10 dBm, the other registers with a pattern, so a setter
+// that touches more than its field shows
+static void baseImage(RadioProfile &image) {
+  FakeRadio radio;
+  for (int i = 0; i < PROFILE_NUM_REGS; i++) radio.regs[i] = (byte)(0xA5 ^ (i * 7));
+  radio.regs[CC1101_FREQ2] = 0x10;
+  radio.regs[CC1101_FREQ1] = 0xB0;
+  radio.regs[CC1101_FREQ0] = 0x71;
+  radio.regs[CC1101_MDMCFG2] = 0x13;
+  radio.patable[0] = 0xC0;
+  profileCapture(radio, image);
+}
+
+// Only the bits in mask may differ from the base image
+static bool onlyChanged(const RadioProfile &image, byte addr, byte mask) {
+  RadioProfile base;
+  baseImage(base);
+  for (int i = 0; i < PROFILE_NUM_REGS; i++) {
+    byte keep = i == addr ? (byte)~mask : 0xFF;
+    if ((image.regs[i] & keep) != (base.regs[i] & keep)) return false;
+  }
+  return profileIsValid(image);
+}
+
+static void testFields() {
+  RadioProfile image;
+  baseImage(image);
+  profileSetPRE(image, 5);
+  CHECK_EQ(image.regs[CC1101_MDMCFG1] & 0x70, 0x50);
+  CHECK(onlyChanged(image, CC1101_MDMCFG1, 0x70));
+  profileSetPRE(image, 9);  // clamped like the driver
+  CHECK_EQ(image.regs[CC1101_MDMCFG1] & 0x70, 0x70);
+
+  baseImage(image);
+  profileSetPQT(image, 3);
+  CHECK_EQ(image.regs[CC1101_PKTCTRL1] >> 5, 3);
+  CHECK(onlyChanged(image, CC1101_PKTCTRL1, 0xE0));
+
+  baseImage(image);
+  profileSetCRC_AF(image, true);
+  CHECK_EQ(image.regs[CC1101_PKTCTRL1] & 0x18, 0x08);
+  CHECK(onlyChanged(image, CC1101_PKTCTRL1, 0x18));
+  profileSetAppendStatus(image, false);
+  CHECK_EQ(image.regs[CC1101_PKTCTRL1] & 0x04, 0);
+  profileSetAdrChk(image, 2);
+  CHECK_EQ(image.regs[CC1101_PKTCTRL1] & 0x03, 2);
+
+  baseImage(image);
+  profileSetPktFormat(image, 3);
+  CHECK_EQ(image.regs[CC1101_PKTCTRL0] & 0x30, 0x30);
+  CHECK(onlyChanged(image, CC1101_PKTCTRL0, 0x30));
+  profileSetWhiteData(image, true);
+  profileSetCrc(image, true);
+  profileSetLengthConfig(image, 1);
+  CHECK_EQ(image.regs[CC1101_PKTCTRL0], 0x75);
+
+  baseImage(image);
+  profileSetDcFilterOff(image, true);
+  profileSetManchester(image, true);
+  profileSetSyncMode(image, 6);
+  CHECK_EQ(image.regs[CC1101_MDMCFG2], 0x80 | 0x10 | 0x08 | 6);
+  CHECK(onlyChanged(image, CC1101_MDMCFG2, 0x8F));
+  profileSetFEC(image, true);
+  CHECK_EQ(image.regs[CC1101_MDMCFG1] & 0x80, 0x80);
+
+  baseImage(image);
+  profileSetSyncWord(image, 0xD3, 0x91);
+  profileSetAddr(image, 0x42);
+  profileSetPacketLength(image, 61);
+  profileSetChannel(image, 7);
+  CHECK_EQ(image.regs[CC1101_SYNC1], 0xD3);
+  CHECK_EQ(image.regs[CC1101_SYNC0], 0x91);
+  CHECK_EQ(image.regs[CC1101_ADDR], 0x42);
+  CHECK_EQ(image.regs[CC1101_PKTLEN], 61);
+  CHECK_EQ(image.regs[CC1101_CHANNR], 7);
+  CHECK(profileIsValid(image));
+}
+
+// The modem values against SmartRF Studio's for the same settings
+static void testModem() {
+  RadioProfile image;
+  baseImage(image);
+  profileSetDRate(image, 38.4);
+  CHECK_EQ(image.regs[CC1101_MDMCFG4] & 0x0F, 10);
+  CHECK_EQ(image.regs[CC1101_MDMCFG3], 0x83);
+  profileSetRxBW(image, 100);
+  CHECK_EQ(image.regs[CC1101_MDMCFG4], 0xC0 | 10);  // 101.6 kHz, the data rate kept
+  profileSetRxBW(image, 812);
+  CHECK_EQ(image.regs[CC1101_MDMCFG4] >> 4, 0);
+  profileSetRxBW(image, 58);
+  CHECK_EQ(image.regs[CC1101_MDMCFG4] >> 4, 0x0F);
+  CHECK_EQ(image.regs[CC1101_MDMCFG4] & 0x0F, 10);
+
+  profileSetDRate(image, 250);
+  CHECK_EQ(image.regs[CC1101_MDMCFG4] & 0x0F, 13);
+  CHECK_EQ(image.regs[CC1101_MDMCFG3], 0x3B);
+
+  profileSetDeviation(image, 47.6);
+  CHECK_EQ(image.regs[CC1101_DEVIATN], 0x47);
+  profileSetDeviation(image, 100);  // the next step up, 101.6 kHz
+  CHECK_EQ(image.regs[CC1101_DEVIATN], 0x60);
+
+  baseImage(image);
+  profileSetChsp(image, 199.95);
+  CHECK_EQ(image.regs[CC1101_MDMCFG1] & 0x0F, 2);
+  CHECK_EQ(image.regs[CC1101_MDMCFG0], 0xF8);
+  CHECK_EQ(image.regs[CC1101_MDMCFG1] & 0xF0, (0xA5 ^ (CC1101_MDMCFG1 * 7)) & 0xF0);
+  CHECK(profileIsValid(image));
+}
+
+static void testPa() {
+  RadioProfile image;
+  baseImage(image);
+  CHECK_EQ(profilePa(image), 10);
+
+  // every level of the 433 MHz table comes back as it went in
+  static const int levels[8] = {-30, -20, -15, -10, 0, 5, 7, 10};
+  for (int i = 0; i < 8; i++) {
+    profileSetPA(image, levels[i]);
+    CHECK_EQ(profilePa(image), levels[i]);
+  }
+  profileSetPA(image, -12);  // between levels, the next one up
+  CHECK_EQ(profilePa(image), -10);
+  profileSetPA(image, 20);
+  CHECK_EQ(image.patable[0], 0xC0);
+
+  // ASK moves the level to PATABLE[1] and keeps it
+  profileSetPA(image, 5);
+  profileSetModulation(image, 2);
+  CHECK_EQ(profileModulation(image), 2);
+  CHECK_EQ(image.regs[CC1101_FREND0], 0x11);
+  CHECK_EQ(image.patable[0], 0);
+  CHECK_EQ(image.patable[1], 0x84);
+  CHECK_EQ(profilePa(image), 5);
+  profileSetModulation(image, 4);
+  CHECK_EQ(profileModulation(image), 4);
+  CHECK_EQ(image.regs[CC1101_FREND0], 0x10);
+  CHECK_EQ(image.patable[0], 0x84);
+  CHECK_EQ(image.patable[1], 0);
+  profileSetModulation(image, 9);
+  CHECK_EQ(profileModulation(image), 4);
+
+  // the 868 MHz table has 10 levels
+  image.regs[CC1101_FREQ2] = 0x21;
+  image.regs[CC1101_FREQ1] = 0x65;
+  image.regs[CC1101_FREQ0] = 0x6A;
+  profileSetPA(image, -6);
+  CHECK_EQ(image.patable[0], 0x37);
+  profileSetPA(image, 12);
+  CHECK_EQ(profilePa(image), 12);
+
+  // no band, no change
+  image.regs[CC1101_FREQ2] = 0x1A;
+  byte before = image.patable[0];
+  profileSetPA(image, -30);
+  CHECK_EQ(image.patable[0], before);
+  CHECK(profileIsValid(image));
+}
+
+// An edited image goes on the radio with one burst
+static void testApply() {
+  RadioProfile image;
+  baseImage(image);
+  profileSetPRE(image, 2);
+  profileSetSyncWord(image, 0x12, 0x34);
+  profileSetDRate(image, 4.8);
+  FakeRadio radio;
+  CHECK(profileApply(radio, image));
+  CHECK(memcmp(radio.regs, image.regs, PROFILE_NUM_REGS) == 0);
+  CHECK_EQ(radio.regs[CC1101_SYNC1], 0x12);
+}
+
+int main() {
+  testFields();
+  testModem();
+  testPa();
+  testApply();
+  return TEST_DONE();
+}
@@ -0,0 +1,108 @@
+// Sources: text_render.cpp hex_codec.cpp
+#include "src/text_render.h"
+#include "src/hex_codec.h"
+#include "test.h"
+
+// A Print that keeps everything written to it and how it came in
+class Capture : public Print {
+public:
+  char data[2048];
+  size_t len;
+  int writes;
+  size_t largest;
+
+  Capture() : len(0), writes(0), largest(0) {}
+  size_t write(const uint8_t *buffer, size_t size) {
+    memcpy(data + len, buffer, size);
+    len += size;
+    writes++;
+    if (size > largest) largest = size;
+    return size;
+  }
+};
+
+// The hex digit table showBitData() used before bitStrip()
+static const char *const nibbles[16] = {"____", "___-", "__-_", "__--", "_-__", "_-_-", "_--_", "_---",
+                                        "-___", "-__-", "-_-_", "-_--", "--__", "--_-", "---_", "----"};
+
+static void testBitStrip() {
+  uint8_t in[256];
+  for (int i = 0; i < 256; i++) in[i] = (uint8_t)i;
+
+  // every byte value as the old String code rendered it from the hex dump
+  char hex[2 * 256 + 1];
+  hexEncode(in, sizeof(in), hex, sizeof(hex));
+  static char strip[8 * 256 + 1];
+  CHECK_EQ(bitStrip(in, sizeof(in), strip, sizeof(strip)), 8 * 256);
+  bool same = true;
+  for (int i = 0; i < 2 * 256; i++) {
+    int v = hex[i] <= '9' ? hex[i] - '0' : hex[i] - 'A' + 10;
+    same = same && memcmp(&strip[4 * i], nibbles[v], 4) == 0;
+  }
+  CHECK(same);
+  CHECK_EQ(strip[8 * 256], '\0');
+
+  // whole bytes only when the buffer is short
+  char small[8 * 2 + 5];
+  const uint8_t two[3] = {0xA5, 0x0F, 0xFF};
+  CHECK_EQ(bitStrip(two, 3, small, sizeof(small)), 16);
+  CHECK(strcmp(small, "-_-__-_-____----") == 0);
+  CHECK_EQ(bitStrip(two, 3, small, 8), 0);
+  CHECK_EQ(small[0], '\0');
+  CHECK_EQ(bitStrip(two, 0, small, sizeof(small)), 0);
+  small[0] = 'x';
+  CHECK_EQ(bitStrip(two, 3, small, 0), 0);
+  CHECK_EQ(small[0], 'x');  // not even the NUL
+}
+
+static void testTextOut() {
+  Capture cap;
+  TextOut out;
+  textBegin(out, cap);
+
+  // short writes stay in the buffer until the flush
+  textPrint(out, "abc");
+  textPrint(out, "");
+  CHECK_EQ(cap.writes, 0);
+  textFlush(out);
+  CHECK_EQ(cap.writes, 1);
+  CHECK(cap.len == 3 && memcmp(cap.data, "abc", 3) == 0);
+  textFlush(out);
+  CHECK_EQ(cap.writes, 1);  // nothing left, nothing written
+
+  // a capture dump: 64 char strips go out in TEXT_OUT_SIZE chunks, in order
+  Capture dump;
+  textBegin(out, dump);
+  char expect[1024];
+  size_t n = 0;
+  char strip[8 * 8 + 1];
+  uint8_t bytes[8];
+  for (int row = 0; row < 12; row++) {
+    for (int i = 0; i < 8; i++) bytes[i] = (uint8_t)(row * 8 + i);
+    size_t len = bitStrip(bytes, 8, strip, sizeof(strip));
+    textWrite(out, strip, len);
+    memcpy(expect + n, strip, len);
+    n += len;
+  }
+  CHECK_EQ(dump.writes, (int)(n / TEXT_OUT_SIZE));
+  CHECK_EQ(dump.largest, TEXT_OUT_SIZE);
+  textFlush(out);
+  CHECK(dump.len == n && memcmp(dump.data, expect, n) == 0);
+
+  // one write larger than the buffer is split, not truncated
+  Capture big;
+  textBegin(out, big);
+  char text[3 * TEXT_OUT_SIZE + 10];
+  for (size_t i = 0; i < sizeof(text); i++) text[i] = (char)('a' + i % 26);
+  textWrite(out, text, sizeof(text));
+  CHECK_EQ(big.writes, 3);
+  textFlush(out);
+  CHECK_EQ(big.writes, 4);
+  CHECK(big.len == sizeof(text) && memcmp(big.data, text, sizeof(text)) == 0);
+}
+
+int main() {
+  testBitStrip();
+  testTextOut();
+  return TEST_DONE();
+}
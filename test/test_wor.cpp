@@ -0,0 +1,80 @@
+// Sources: wor.cpp radio_port.cpp
+#include "src/wor.h"
+#include "fake_radio.h"
+#include "test.h"
+
+static void testConfigure() {
+  FakeRadio radio;
+  radio.regs[CC1101_MCSM1] = 0x3F;  // CCA, RXOFF_MODE RX, TXOFF_MODE RX
+  radio.regs[CC1101_MCSM0] = 0x08;
+  radio.regs[CC1101_IOCFG0] = 0x0D;
+
+  // EVENT0 = interval * fxosc / 750
+  worConfigure(radio, 500, 3);
+  CHECK_EQ((radio.regs[CC1101_WOREVT1] << 8) | radio.regs[CC1101_WOREVT0], 500 * 26000 / 750);
+  CHECK_EQ(radio.regs[CC1101_WORCTRL], 0x78);
+  CHECK_EQ(radio.regs[CC1101_MCSM2], 3);
+  CHECK_EQ(radio.regs[CC1101_MCSM1], 0x33);  // only RXOFF_MODE changes, to IDLE
+  CHECK_EQ(radio.regs[CC1101_MCSM0], 0x38);
+  CHECK_EQ(radio.regs[CC1101_IOCFG0], 0x06);
+  CHECK_EQ(radio.nstrobes, 0);  // nothing starts yet
+
+  // the longest interval fits, longer ones and RX_TIME 7 (no timeout) are clamped
+  worConfigure(radio, WOR_MAX_INTERVAL_MS, 0);
+  CHECK_EQ((radio.regs[CC1101_WOREVT1] << 8) | radio.regs[CC1101_WOREVT0], WOR_MAX_INTERVAL_MS * 26000 / 750);
+  CHECK(WOR_MAX_INTERVAL_MS * 26000 / 750 <= 0xFFFF);
+  worConfigure(radio, 5000, 7);
+  CHECK_EQ(radio.regs[CC1101_WOREVT1], 0xFF);
+  CHECK_EQ(radio.regs[CC1101_WOREVT0], 0xFF);
+  CHECK_EQ(radio.regs[CC1101_MCSM2], WOR_MAX_RX_TIME);
+}
+
+static void testArm() {
+  // from RX as after a packet was read: IDLE first, then the FIFO, timer and WOR
+  FakeRadio radio;
+  radio.marcstate = MARC_RX;
+  radio.rxbytes = 20;
+  worArm(radio);
+  CHECK_EQ(radio.nstrobes, 4);
+  CHECK_EQ(radio.strobes[0], CC1101_SIDLE);
+  CHECK_EQ(radio.strobes[1], CC1101_SFRX);
+  CHECK_EQ(radio.strobes[2], CC1101_SWORRST);
+  CHECK_EQ(radio.strobes[3], CC1101_SWOR);
+  CHECK_EQ(radio.rxbytes, 0);
+  CHECK_EQ(radio.marcstate, MARC_SLEEP);
+
+  // rearming does the same from SLEEP
+  worArm(radio);
+  CHECK_EQ(radio.strobeCount(CC1101_SWOR), 2);
+  CHECK_EQ(radio.marcstate, MARC_SLEEP);
+}
+
+static void testDuty() {
+  CHECK_EQ(worRxDutyPpm(0), 125000);  // 12.5 %
+  CHECK_EQ(worRxDutyPpm(1), 62500);
+  CHECK_EQ(worRxDutyPpm(6), 1953);
+  CHECK_EQ(worRxDutyPpm(7), worRxDutyPpm(6));
+
+  // the ends of the range are the datasheet currents
+  CHECK_EQ(worCurrentUa(0, 0), WOR_RADIO_SLEEP_UA + WOR_MCU_LIGHT_SLEEP_UA);
+  CHECK_EQ(worCurrentUa(1000000, 1000000), WOR_RADIO_RX_UA + WOR_MCU_AWAKE_UA);
+
+  // RX_TIME 3 (1.56 %) with the MCU awake 1 % of the time:
+  // 16 mA * 1.5625 % + 1 uA * 98.4 % + 40 mA * 1 % + 0.8 mA * 99 % = 1442.98 uA
+  CHECK_EQ(worCurrentUa(worRxDutyPpm(3), 10000), 1443);
+
+  // the current only rises with the duty cycles
+  uint32_t last = 0;
+  for (int rxtime = WOR_MAX_RX_TIME; rxtime >= 0; rxtime--) {
+    uint32_t ua = worCurrentUa(worRxDutyPpm(rxtime), 10000);
+    CHECK(ua > last);
+    last = ua;
+  }
+}
+
+int main() {
+  testConfigure();
+  testArm();
+  testDuty();
+  return TEST_DONE();
+}
@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+"""Host side decoder for the cypher-pulse binary serial protocol ("proto bin").
+
+Frames are COBS encoded and end with 0x00. Decoded frame:
+    type (u8) | seq (u8) | len (u8) | payload (len bytes) | crc16 (u16 LE)
+crc16 is CRC-16/CCITT-FALSE over type..payload. See src/frame_proto.h.
+
+    python3 tools/frame_decode.py /dev/ttyUSB0            # switch to binary and decode
+    python3 tools/frame_decode.py /dev/ttyUSB0 -c "rx"    # also send a command frame
+    python3 tools/frame_decode.py capture.bin             # decode a recorded stream
+
+Bytes that do not form a valid frame (text the device printed) are shown as text.
+Needs pyserial for serial ports.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import time
+
+MSG_PACKET = 0x01
+MSG_META = 0x02
+MSG_SWEEP = 0x03
+MSG_CAPTURE = 0x04
+MSG_COMMAND = 0x10
+
+MODULATIONS = {0: "2-FSK", 1: "GFSK", 2: "ASK/OOK", 3: "4-FSK", 4: "MSK"}
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_pos, code = 0, 1
+    for b in data:
+        if b == 0:
+            out[code_pos] = code
+            code_pos, code = len(out), 1
+            out.append(0)
+        else:
+            out.append(b)
+            code += 1
+            if code == 0xFF:
+                out[code_pos] = code
+                code_pos, code = len(out), 1
+                out.append(0)
+    out[code_pos] = code
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            return None
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(msg_type, seq, payload):
+    raw = bytes([msg_type, seq, len(payload)]) + payload
+    return cobs_encode(raw + struct.pack("<H", crc16(raw))) + b"\x00"
+
+
+def decode_frame(encoded):
+    raw = cobs_decode(encoded)
+    if raw is None or len(raw) < 5 or len(raw) != 5 + raw[2]:
+        return None
+    if struct.unpack("<H", raw[-2:])[0] != crc16(raw[:-2]):
+        return None
+    return raw[0], raw[1], raw[3:-2]
+
+
+class Decoder:
+    def __init__(self, out=sys.stdout):
+        self.out = out
+        self.buffer = bytearray()
+        self.last_seq = None
+        self.frames = 0
+        self.lost = 0
+        self.capture = None
+
+    def feed(self, data):
+        self.buffer += data
+        while True:
+            end = self.buffer.find(b"\x00")
+            if end < 0:
+                return
+            chunk = bytes(self.buffer[:end])
+            del self.buffer[:end + 1]
+            if chunk:
+                self.handle(chunk)
+
+    def handle(self, chunk):
+        frame = decode_frame(chunk)
+        if frame is None:
+            text = chunk.decode("ascii", "replace").strip()
+            if text:
+                self.out.write("text    %s\n" % text)
+            return
+        msg_type, seq, payload = frame
+        if self.last_seq is not None and seq != (self.last_seq + 1) & 0xFF:
+            missed = (seq - self.last_seq - 1) & 0xFF
+            self.lost += missed
+            self.out.write("gap     %d frame(s) lost before seq %d\n" % (missed, seq))
+        self.last_seq = seq
+        self.frames += 1
+        self.show(msg_type, seq, payload)
+
+    def show(self, msg_type, seq, p):
+        w = self.out.write
+        if msg_type == MSG_PACKET and len(p) >= 7:
+            radio, rssi, lqi, ts = struct.unpack("<BbBI", p[:7])
+            w("packet  #%03d CC%d t=%dus rssi=%d lqi=%d len=%d %s\n" % (seq, radio + 1, ts, rssi, lqi, len(p) - 7, p[7:].hex().upper()))
+        elif msg_type == MSG_META and len(p) >= 10:
+            radio, hz, mod, rxbw, pa, chan = struct.unpack("<BIBHbB", p[:10])
+            w("meta    #%03d CC%d %.6f MHz %s rxbw=%d kHz pa=%d dBm chan=%d\n" % (seq, radio + 1, hz / 1e6, MODULATIONS.get(mod, mod), rxbw, pa, chan))
+        elif msg_type == MSG_SWEEP and len(p) >= 5:
+            khz, rssi = struct.unpack("<Ib", p[:5])
+            w("sweep   #%03d %.3f MHz rssi=%d\n" % (seq, khz / 1e3, rssi))
+        elif msg_type == MSG_CAPTURE and len(p) >= 4:
+            offset, total = struct.unpack("<HH", p[:4])
+            if offset == 0 or self.capture is None or len(self.capture) != total:
+                self.capture = bytearray(total)
+            self.capture[offset:offset + len(p) - 4] = p[4:]
+            w("capture #%03d %d..%d of %d\n" % (seq, offset, offset + len(p) - 4, total))
+            if offset + len(p) - 4 >= total:
+                w("capture complete: %s\n" % self.capture.hex().upper())
+        else:
+            w("type %02X #%03d %s\n" % (msg_type, seq, p.hex().upper()))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("source", help="serial port or file with a recorded stream")
+    parser.add_argument("-b", "--baud", type=int, default=115200)
+    parser.add_argument("-c", "--command", action="append", default=[], help="command line to send as a command frame")
+    parser.add_argument("--no-switch", action="store_true", help="do not send 'proto bin' first")
+    args = parser.parse_args()
+
+    decoder = Decoder()
+    if os.path.isfile(args.source):
+        with open(args.source, "rb") as f:
+            decoder.feed(f.read())
+        print("%d frames, %d lost" % (decoder.frames, decoder.lost))
+        return
+
+    import serial
+    port = serial.Serial(args.source, args.baud, timeout=0.1)
+    if not args.no_switch:
+        port.write(b"proto bin\r")
+        time.sleep(0.2)
+    for seq, line in enumerate(args.command):
+        port.write(encode_frame(MSG_COMMAND, seq, line.encode("ascii")))
+    try:
+        while True:
+            decoder.feed(port.read(4096))
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        port.write(encode_frame(MSG_COMMAND, 0, b"proto text"))
+        print("\n%d frames, %d lost" % (decoder.frames, decoder.lost))
+
+
+if __name__ == "__main__":
+    main()